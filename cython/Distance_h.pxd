@@ -19,11 +19,52 @@ cdef extern from "../src/Bipartition.h":
         bool crosses(Bipartition other) except +
         bool isCompatibleWith(libcpp_vector[Bipartition] splits) except +
 
+cdef extern from "../src/GeodesicCostModel.h":
+    double estimateGeodesicCost "GeodesicCostModel::estimate"(PhyloTree t1, PhyloTree t2) except +
+
+cdef extern from "../src/Distance.h":
+    cdef enum DistanceMetric "DistanceMetric":
+        RobinsonFoulds "DistanceMetric::RobinsonFoulds"
+        WeightedRobinsonFoulds "DistanceMetric::WeightedRobinsonFoulds"
+        Euclidean "DistanceMetric::Euclidean"
+        Geodesic "DistanceMetric::Geodesic"
+
 cdef extern from "../src/Distance.h" namespace "Distance":
     double getEuclideanDistance(PhyloTree t1, PhyloTree t2, bool normalise) except +
     double getGeodesicDistance(PhyloTree t1, PhyloTree t2, bool normalise) except +
     double getRobinsonFouldsDistance(PhyloTree t1, PhyloTree t2, bool normalise) except +
     double getWeightedRobinsonFouldsDistance(PhyloTree t1, PhyloTree t2, bool normalise) except +
+    double getClusterTableRobinsonFouldsDistance(libcpp_string t1, libcpp_string t2, bool normalise, bool rooted1, bool rooted2) except +
+    libcpp_vector[double] getDistanceMatrix(libcpp_vector[PhyloTree] trees, DistanceMetric metric, bool normalise, size_t numThreads) except +
+    void getCrossDistanceMatrix "Distance::getDistanceMatrix"(libcpp_vector[PhyloTree] queries, libcpp_vector[PhyloTree] references, DistanceMetric metric, bool normalise, double *out, size_t numThreads) except +
+    libcpp_vector[double] extendDistanceMatrix(libcpp_vector[double] matrix, libcpp_vector[PhyloTree] trees, libcpp_vector[PhyloTree] newTrees, DistanceMetric metric, bool normalise, size_t numThreads) except +
+
+cdef extern from "../src/CondensedMatrixFile.h":
+    cdef enum MatrixDtype "MatrixDtype":
+        Float32 "MatrixDtype::Float32"
+        Float64 "MatrixDtype::Float64"
+
+    cdef cppclass CondensedMatrixFile:
+        CondensedMatrixFile(libcpp_string path, bool writable) except +
+
+cdef extern from "../src/Distance.h":
+    void extendCondensedMatrixFile "Distance::extendDistanceMatrix"(CondensedMatrixFile &matrix, libcpp_vector[PhyloTree] trees, libcpp_vector[PhyloTree] newTrees, libcpp_string path, size_t numThreads) except +
+
+cdef extern from "../src/TiledDistanceMatrix.h":
+    cdef cppclass TiledDistanceMatrix:
+        TiledDistanceMatrix(libcpp_string directory, libcpp_vector[PhyloTree] trees, DistanceMetric metric, bool normalise, size_t memoryBudget, MatrixDtype dtype) except +
+        size_t blockSize() except +
+        size_t numTiles() except +
+        size_t numFinishedTiles() except +
+        bool isComplete() except +
+        size_t run(size_t numThreads, size_t maxTiles) except +
+        libcpp_vector[double] assemble() except +
+
+cdef extern from "../src/ReferenceDistances.h":
+    cdef cppclass ReferenceDistances:
+        ReferenceDistances(PhyloTree reference, DistanceMetric metric, bool normalise, size_t numThreads) except +
+        void getDistances(libcpp_vector[PhyloTree] &trees, double *out) except +
+        libcpp_vector[double] getDistances(libcpp_vector[libcpp_string] newicks, bool rooted) except +
 
 #cdef extern from "../src/PhyloTreeEdge.h":
 #    cdef cppclass PhyloTreeEdge:
@@ -13,7 +13,21 @@ from Distance_h cimport getEuclideanDistance as _getEuclideanDistance_Distance_h
 from Distance_h cimport getGeodesicDistance as _getGeodesicDistance_Distance_h
 from Distance_h cimport getRobinsonFouldsDistance as _getRobinsonFouldsDistance_Distance_h
 from Distance_h cimport getWeightedRobinsonFouldsDistance as _getWeightedRobinsonFouldsDistance_Distance_h
+from Distance_h cimport getClusterTableRobinsonFouldsDistance as _getClusterTableRobinsonFouldsDistance_Distance_h
+from Distance_h cimport getDistanceMatrix as _getDistanceMatrix_Distance_h
+from Distance_h cimport extendDistanceMatrix as _extendDistanceMatrix_Distance_h
+from Distance_h cimport getCrossDistanceMatrix as _getCrossDistanceMatrix_Distance_h
+from Distance_h cimport extendCondensedMatrixFile as _extendCondensedMatrixFile
+from Distance_h cimport CondensedMatrixFile as _CondensedMatrixFile
+from Distance_h cimport estimateGeodesicCost as _estimateGeodesicCost
+from Distance_h cimport DistanceMetric as _DistanceMetric
+from Distance_h cimport RobinsonFoulds as _RobinsonFoulds, WeightedRobinsonFoulds as _WeightedRobinsonFoulds
+from Distance_h cimport Euclidean as _Euclidean, Geodesic as _Geodesic
 from Distance_h cimport PhyloTree as _PhyloTree
+from Distance_h cimport TiledDistanceMatrix as _TiledDistanceMatrix
+from Distance_h cimport ReferenceDistances as _ReferenceDistances
+from Distance_h cimport MatrixDtype as _MatrixDtype, Float32 as _Float32, Float64 as _Float64
+import struct
 from Distance_h cimport Bipartition as _Bipartition
 # cdef extern from "autowrap_tools.hpp":             # <--
 #     char * _cast_const_away(char *)                # <--
@@ -99,6 +113,332 @@ def getWeightedRobinsonFouldsDistance(PhyloTree t1, PhyloTree t2, normalise=Fals
     py_result = <double>_r
     return py_result 
 
+def getClusterTableRobinsonFouldsDistance(bytes t1, bytes t2, normalise=False, rooted1=False, rooted2=False):
+    """
+    getClusterTableRobinsonFouldsDistance(bytes t1, bytes t2, normalise, rooted1, rooted2)
+
+    Arguments:
+    ----------
+    string, t1; string, t2; bool, normalise (DEFAULT=False); bool, rooted1 (DEFAULT=False);
+    bool, rooted2 (DEFAULT=False).
+
+    Returns the Robinson Foulds distance between the newick trees t1 and t2, as
+    getRobinsonFouldsDistance does, but using Day's cluster table on the bare tree
+    shapes: time and memory are linear in the number of leaves, so it can be used on
+    trees too large to build PhyloTrees for.
+    """
+    assert isinstance(t1, bytes), 'arg t1 wrong type'
+    assert isinstance(t2, bytes), 'arg t2 wrong type'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(rooted1, (int, long)), 'arg rooted1 wrong type'
+    assert isinstance(rooted2, (int, long)), 'arg rooted2 wrong type'
+
+    cdef double _r = _getClusterTableRobinsonFouldsDistance_Distance_h((<libcpp_string>t1), (<libcpp_string>t2), (<bool>normalise), (<bool>rooted1), (<bool>rooted2))
+    py_result = <double>_r
+    return py_result
+
+cdef _DistanceMetric _metricByName(metric):
+    if metric == 'rf':
+        return _RobinsonFoulds
+    elif metric == 'wrf':
+        return _WeightedRobinsonFoulds
+    elif metric == 'euc':
+        return _Euclidean
+    return _Geodesic
+
+def getDistanceMatrix(list trees, metric='geodesic', normalise=False, threads=0):
+    """
+    getDistanceMatrix(list trees, metric, normalise, threads)
+
+    Arguments:
+    ----------
+    list of PhyloTree objects, trees; string, metric (one of 'rf', 'wrf', 'euc', 'geodesic',
+    DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int, threads (DEFAULT=0).
+
+    Returns all pairwise distances between the trees as a condensed upper triangle, in the
+    order used by scipy.spatial.distance (squareform converts it to a square matrix).
+    The pairs are computed on 'threads' threads, or one per core if threads is 0.
+    The trees are not modified.
+    """
+    assert all(isinstance(t, PhyloTree) for t in trees), 'arg trees wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef _DistanceMetric _metric = _metricByName(metric)
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef PhyloTree tree
+    for tree in trees:
+        v1.push_back(deref(tree.inst))
+    cdef libcpp_vector[double] _r = _getDistanceMatrix_Distance_h(v1, _metric, (<bool>normalise), (<size_t>threads))
+    cdef list py_result = _r
+    return py_result
+
+def getCrossDistanceMatrix(list queries, list references, metric='geodesic', normalise=False, threads=0):
+    """
+    getCrossDistanceMatrix(list queries, list references, metric, normalise, threads)
+
+    Arguments:
+    ----------
+    list of PhyloTree objects, queries; list of PhyloTree objects, references; string, metric (one of
+    'rf', 'wrf', 'euc', 'geodesic', DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int,
+    threads (DEFAULT=0).
+
+    Returns the distances between every query and every reference tree as a list of rows, one per
+    query, like scipy.spatial.distance.cdist. Each tree is prepared once and reused for all of its
+    pairs, which are computed on 'threads' threads, or one per core if threads is 0.
+    """
+    assert all(isinstance(t, PhyloTree) for t in queries), 'arg queries wrong type'
+    assert all(isinstance(t, PhyloTree) for t in references), 'arg references wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef libcpp_vector[_PhyloTree] v2
+    cdef PhyloTree tree
+    for tree in queries:
+        v1.push_back(deref(tree.inst))
+    for tree in references:
+        v2.push_back(deref(tree.inst))
+    cdef size_t columns = v2.size()
+    cdef libcpp_vector[double] _r
+    _r.resize(v1.size() * columns)
+    if _r.size() > 0:
+        _getCrossDistanceMatrix_Distance_h(v1, v2, _metricByName(metric), (<bool>normalise), &_r[0],
+                                           (<size_t>threads))
+    cdef list py_result = [[_r[q * columns + r] for r in range(columns)] for q in range(v1.size())]
+    return py_result
+
+def getDistancesToReference(PhyloTree reference, list trees, metric='geodesic', normalise=False, threads=0):
+    """
+    getDistancesToReference(PhyloTree reference, list trees, metric, normalise, threads)
+
+    Arguments:
+    ----------
+    PhyloTree, reference; list of PhyloTree objects, trees; string, metric (one of 'rf', 'wrf',
+    'euc', 'geodesic', DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int, threads (DEFAULT=0).
+
+    Returns the distance from the reference to each of the trees, e.g. from a consensus tree to the
+    samples of a posterior. The reference is prepared once for all of them, and the trees are
+    computed on 'threads' threads, or one per core if threads is 0.
+    """
+    assert all(isinstance(t, PhyloTree) for t in trees), 'arg trees wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef PhyloTree tree
+    for tree in trees:
+        v1.push_back(deref(tree.inst))
+    cdef libcpp_vector[double] _r
+    _r.resize(v1.size())
+    cdef _ReferenceDistances *distances = new _ReferenceDistances(deref(reference.inst), _metricByName(metric),
+                                                                  (<bool>normalise), (<size_t>threads))
+    try:
+        if _r.size() > 0:
+            distances.getDistances(v1, &_r[0])
+    finally:
+        del distances
+    cdef list py_result = _r
+    return py_result
+
+def getDistancesToReferenceFromNewicks(PhyloTree reference, list newicks, rooted=False, metric='geodesic',
+                                       normalise=False, threads=0):
+    """
+    getDistancesToReferenceFromNewicks(PhyloTree reference, list newicks, rooted, metric, normalise, threads)
+
+    Arguments:
+    ----------
+    PhyloTree, reference; list of bytes, newicks; bool, rooted (DEFAULT=False); string, metric (one
+    of 'rf', 'wrf', 'euc', 'geodesic', DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int,
+    threads (DEFAULT=0).
+
+    Like getDistancesToReference, for trees given as newick strings. The strings are parsed on the
+    worker threads against the reference's leaves, a batch at a time, so the trees are never all in
+    memory at once. A tree with other leaves than the reference's raises an error.
+    """
+    assert all(isinstance(t, bytes) for t in newicks), 'arg newicks wrong type'
+    assert isinstance(rooted, (int, long)), 'arg rooted wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef libcpp_vector[libcpp_string] v1 = newicks
+    cdef libcpp_vector[double] _r
+    cdef _ReferenceDistances *distances = new _ReferenceDistances(deref(reference.inst), _metricByName(metric),
+                                                                  (<bool>normalise), (<size_t>threads))
+    try:
+        _r = distances.getDistances(v1, (<bool>rooted))
+    finally:
+        del distances
+    cdef list py_result = _r
+    return py_result
+
+def extendDistanceMatrix(list matrix, list trees, list new_trees, metric='geodesic', normalise=False, threads=0):
+    """
+    extendDistanceMatrix(list matrix, list trees, list new_trees, metric, normalise, threads)
+
+    Arguments:
+    ----------
+    list of floats, matrix (the condensed matrix of trees); list of PhyloTree objects, trees; list of
+    PhyloTree objects, new_trees; string, metric (one of 'rf', 'wrf', 'euc', 'geodesic',
+    DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int, threads (DEFAULT=0).
+
+    Returns the condensed matrix of trees followed by new_trees, as getDistanceMatrix would, computing
+    only the distances that involve a new tree; the others are copied from matrix.
+    """
+    assert all(isinstance(t, PhyloTree) for t in trees), 'arg trees wrong type'
+    assert all(isinstance(t, PhyloTree) for t in new_trees), 'arg new_trees wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef libcpp_vector[double] v0 = matrix
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef libcpp_vector[_PhyloTree] v2
+    cdef PhyloTree tree
+    for tree in trees:
+        v1.push_back(deref(tree.inst))
+    for tree in new_trees:
+        v2.push_back(deref(tree.inst))
+    cdef libcpp_vector[double] _r = _extendDistanceMatrix_Distance_h(v0, v1, v2, _metricByName(metric),
+                                                                     (<bool>normalise), (<size_t>threads))
+    cdef list py_result = _r
+    return py_result
+
+def extendCondensedMatrix(bytes path, list trees, list new_trees, bytes new_path, threads=0):
+    """
+    extendCondensedMatrix(bytes path, list trees, list new_trees, bytes new_path, threads)
+
+    Arguments:
+    ----------
+    bytes, path of the condensed matrix file of trees; list of PhyloTree objects, trees; list of
+    PhyloTree objects, new_trees; bytes, new_path; int, threads (DEFAULT=0).
+
+    Writes the condensed matrix of trees followed by new_trees to a new file at new_path, with the
+    metric, normalisation and dtype of the file at path, computing only the distances that involve
+    a new tree. The file is built as new_path + '.tmp' and renamed to new_path once complete; new_path
+    may not be the file at path, under any name.
+    """
+    assert all(isinstance(t, PhyloTree) for t in trees), 'arg trees wrong type'
+    assert all(isinstance(t, PhyloTree) for t in new_trees), 'arg new_trees wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef libcpp_vector[_PhyloTree] v2
+    cdef PhyloTree tree
+    for tree in trees:
+        v1.push_back(deref(tree.inst))
+    for tree in new_trees:
+        v2.push_back(deref(tree.inst))
+    cdef _CondensedMatrixFile *matrix = new _CondensedMatrixFile((<libcpp_string>path), False)
+    try:
+        _extendCondensedMatrixFile(deref(matrix), v1, v2, (<libcpp_string>new_path), (<size_t>threads))
+    finally:
+        del matrix
+
+def estimateGeodesicCost(PhyloTree t1, PhyloTree t2):
+    """
+    estimateGeodesicCost(PhyloTree t1, PhyloTree t2)
+
+    Arguments:
+    ----------
+    PhyloTree object, t1; PhyloTree object, t2.
+
+    Returns a cheap estimate of the relative time getGeodesicDistance takes on t1 and t2,
+    for ordering and balancing batches of pairs. The estimate grows with the number of
+    leaves and with the product of the numbers of splits found in only one of the trees.
+    """
+    assert isinstance(t1, PhyloTree), 'arg t1 wrong type'
+    assert isinstance(t2, PhyloTree), 'arg t2 wrong type'
+
+    cdef double _r = _estimateGeodesicCost((deref(t1.inst)), (deref(t2.inst)))
+    py_result = <double>_r
+    return py_result
+
+def runTiledDistanceMatrix(list trees, bytes directory, metric='geodesic', normalise=False, memory=1 << 30,
+                           threads=0, max_tiles=0, dtype='float64'):
+    """
+    runTiledDistanceMatrix(list trees, bytes directory, metric, normalise, memory, threads, max_tiles, dtype)
+
+    Arguments:
+    ----------
+    list of PhyloTree objects, trees; bytes, directory; string, metric (one of 'rf', 'wrf', 'euc',
+    'geodesic', DEFAULT='geodesic'); bool, normalise (DEFAULT=False); int, memory in bytes per tile
+    (DEFAULT=1 GiB); int, threads (DEFAULT=0); int, max_tiles (DEFAULT=0, no limit); string, dtype
+    (one of 'float32', 'float64', DEFAULT='float64').
+
+    Works on the tiled distance matrix run kept in 'directory' until no tile is left unclaimed or
+    'max_tiles' tiles are done. Several processes on one machine may call this on the same directory
+    with the same trees and settings; a run that was interrupted resumes from the finished tiles.
+    The distances go straight into the condensed matrix file directory/matrix (see
+    openCondensedMatrix). Returns True once every tile is finished, and False while tiles are still
+    missing or being computed elsewhere.
+    """
+    assert all(isinstance(t, PhyloTree) for t in trees), 'arg trees wrong type'
+    assert metric in ('rf', 'wrf', 'euc', 'geodesic'), 'arg metric must be one of rf, wrf, euc, geodesic'
+    assert isinstance(normalise, (int, long)), 'arg normalise wrong type'
+    assert isinstance(memory, (int, long)) and memory > 0, 'arg memory wrong type'
+    assert isinstance(threads, (int, long)) and threads >= 0, 'arg threads wrong type'
+    assert isinstance(max_tiles, (int, long)) and max_tiles >= 0, 'arg max_tiles wrong type'
+    assert dtype in ('float32', 'float64'), 'arg dtype must be one of float32, float64'
+
+    cdef libcpp_vector[_PhyloTree] v1
+    cdef PhyloTree tree
+    for tree in trees:
+        v1.push_back(deref(tree.inst))
+    cdef _MatrixDtype _dtype = _Float32 if dtype == 'float32' else _Float64
+    cdef _TiledDistanceMatrix *matrix = new _TiledDistanceMatrix((<libcpp_string>directory), v1,
+                                                                 _metricByName(metric), (<bool>normalise),
+                                                                 (<size_t>memory), _dtype)
+    try:
+        matrix.run((<size_t>threads), (<size_t>max_tiles))
+        return matrix.isComplete()
+    finally:
+        del matrix
+
+def readCondensedMatrixHeader(bytes path):
+    """
+    readCondensedMatrixHeader(bytes path)
+
+    Arguments:
+    ----------
+    bytes, path of a condensed matrix file.
+
+    Returns the header of the file as a dict with the keys 'n', 'metric' (one of 'rf', 'wrf', 'euc',
+    'geodesic'), 'normalise', 'dtype' (a numpy dtype string, '<f4' or '<f8'), 'taxon_hash' and
+    'offset', the byte offset of the entries.
+    """
+    with open(path, 'rb') as f:
+        header = f.read(64)
+    if len(header) != 64 or header[:8] != b'CGTPDMAT':
+        raise ValueError('not a condensed matrix file')
+    version, itemsize, n, taxon_hash, metric, normalise = struct.unpack('<IIQQiI', header[8:40])
+    if version != 1 or itemsize not in (4, 8):
+        raise ValueError('unsupported condensed matrix file')
+    return {'n': n, 'metric': ('rf', 'wrf', 'euc', 'geodesic')[metric], 'normalise': bool(normalise),
+            'dtype': '<f%d' % itemsize, 'taxon_hash': taxon_hash, 'offset': 64}
+
+def openCondensedMatrix(bytes path, mode='r'):
+    """
+    openCondensedMatrix(bytes path, mode)
+
+    Arguments:
+    ----------
+    bytes, path of a condensed matrix file; string, mode (a numpy.memmap mode, DEFAULT='r').
+
+    Returns the entries of the file as a numpy.memmap, the condensed vector of
+    scipy.spatial.distance, without reading them into memory.
+    """
+    import numpy
+    header = readCondensedMatrixHeader(path)
+    n = header['n']
+    if n < 2:
+        return numpy.zeros(0, dtype=header['dtype'])
+    return numpy.memmap(path, dtype=header['dtype'], mode=mode, offset=header['offset'], shape=(n * (n - 1) // 2,))
+
 cdef class PhyloTree:
 
     cdef _PhyloTree *inst
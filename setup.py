@@ -35,17 +35,32 @@ except ImportError:
 ext = Extension("tree_distance",
                 language='c++',
                 sources = ['src/BipartiteGraph.cpp',
+                           'src/ClusterTable.cpp',
+                           'src/CompatibilityIndex.cpp',
+                           'src/CondensedMatrixFile.cpp',
                            'src/Bipartition.cpp',
                            'src/Distance.cpp',
                            'src/Geodesic.cpp',
+                           'src/GeodesicCostModel.cpp',
+                           'src/GeodesicWorkspace.cpp',
+                           'src/MonotonicArena.cpp',
                            'src/PhyloTree.cpp',
                            'src/PhyloTreeEdge.cpp',
+                           'src/PreparedTree.cpp',
                            'src/Ratio.cpp',
                            'src/RatioSequence.cpp',
+                           'src/ReferenceDistances.cpp',
+                           'src/SplitMatching.cpp',
+                           'src/SplitMatrix.cpp',
+                           'src/TaxonNamespace.cpp',
+                           'src/TiledDistanceMatrix.cpp',
+                           'src/Topology.cpp',
+                           'src/WorkStealingScheduler.cpp',
                            'src/Tools.cpp',
                            'cython/tree_distance.pyx'],
                 include_dirs = ['src/include'], # removed data_dir
-                extra_compile_args=['-std=c++11'],
+                extra_compile_args=['-std=c++11', '-pthread'],
+                extra_link_args=['-pthread'],
                )
 
 setup(cmdclass={'build_ext':my_build_ext},
@@ -2,17 +2,65 @@
 #define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #endif
 #include "BipartiteGraph.h"
+#include <algorithm>
+#include <limits>
 
-BipartiteGraph::BipartiteGraph(vector<deque<bool>>& IncidenceMatrix, const vector<double>& Aweight, const vector<double>& Bweight) : edge(IncidenceMatrix), nA(Aweight.size()), nB(Bweight.size()) {
-    this->n = max(nA, nB);
-    Avertex.reserve(nA);
-    Bvertex.reserve(nB);
+BipartiteGraph::BipartiteGraph(vector<deque<bool>>& IncidenceMatrix, const vector<double>& Aweight, const vector<double>& Bweight) : nA(Aweight.size()), nB(Bweight.size()) {
+    allocate();
+    for (size_t i = 0; i < nA; i++)
+        for (size_t j = 0; j < nB; j++)
+            if (IncidenceMatrix[i][j])
+                setEdge(i, j);
     for (auto dbl : Aweight)
         Avertex.push_back(Vertex(dbl));
     for (auto dbl : Bweight)
         Bvertex.push_back(Vertex(dbl));
 }
 
+/*
+ * Build the graph straight from two split matrices (rows in the same order as the sorted edges), with
+ * every buffer, including the flow and scan lists used by vertex_cover, taken from the arena.
+ */
+BipartiteGraph::BipartiteGraph(const SplitMatrix& splits1, const SplitMatrix& splits2, MonotonicArena& arena) :
+        nA(splits1.numSplits()), nB(splits2.numSplits()), rows(&arena), cols(&arena), Avertex(&arena),
+        Bvertex(&arena), ABflow(&arena), AScanList(&arena), BScanList(&arena), unlabeledA(&arena),
+        unlabeledB(&arena), subsetA(&arena), subsetB(&arena), height(&arena), arc(&arena), excess(&arena),
+        heightCount(&arena) {
+    allocate();
+    size_t nwords = splits1.wordsPerSplit();
+    for (size_t i = 0; i < nA; i++) {
+        const SplitMatrix::block_type *row = splits1.split(i);
+        for (size_t j = 0; j < nB; j++)
+            if (SplitMatrix::crosses(row, splits2.split(j), nwords))
+                setEdge(i, j);
+    }
+    for (double length : splits1.getLengths())
+        Avertex.push_back(Vertex(length));
+    for (double length : splits2.getLengths())
+        Bvertex.push_back(Vertex(length));
+}
+
+void BipartiteGraph::allocate() {
+    this->n = max(nA, nB);
+    strideA = SplitBitset::blocksFor(nA);
+    strideB = SplitBitset::blocksFor(nB);
+    rows.resize(nA * strideB, 0);
+    cols.resize(nB * strideA, 0);
+    Avertex.reserve(nA);
+    Bvertex.reserve(nB);
+    ABflow.resize(nA * nB, 0.0);
+    AScanList.resize(nA, 0);
+    BScanList.resize(nB, 0);
+    unlabeledA.resize(strideA, 0);
+    unlabeledB.resize(strideB, 0);
+}
+
+void BipartiteGraph::setEdge(size_t a, size_t b) {
+    const size_t bits = SplitBitset::bits_per_block;
+    rows[a * strideB + b / bits] |= block_type(1) << (b % bits);
+    cols[b * strideA + a / bits] |= block_type(1) << (a % bits);
+}
+
 vector<deque<bool>> BipartiteGraph::getIncidenceMatrix(vector<PhyloTreeEdge>& edges1, vector<PhyloTreeEdge>& edges2) {
     std::vector<std::deque<bool>> incidenceMatrix(edges1.size(), std::deque<bool>(edges2.size(), false));
     for (size_t i = 0; i < edges1.size(); i++) {
@@ -23,15 +71,48 @@ vector<deque<bool>> BipartiteGraph::getIncidenceMatrix(vector<PhyloTreeEdge>& ed
     return incidenceMatrix;
 };
 
-vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+vector<deque<bool>> BipartiteGraph::getIncidenceMatrix(const SplitMatrix& splits1, const SplitMatrix& splits2) {
+    size_t nwords = splits1.wordsPerSplit();
+    std::vector<std::deque<bool>> incidenceMatrix(splits1.numSplits(), std::deque<bool>(splits2.numSplits(), false));
+    for (size_t i = 0; i < splits1.numSplits(); i++) {
+        const SplitMatrix::block_type *row = splits1.split(i);
+        for (size_t j = 0; j < splits2.numSplits(); j++) {
+            incidenceMatrix[i][j] = SplitMatrix::crosses(row, splits2.split(j), nwords);
+        }
+    }
+    return incidenceMatrix;
+}
+
+VertexCover BipartiteGraph::vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+    VertexCover cover;
+    vertex_cover(Aindex, Bindex, cover);
+    return cover;
+}
+
+/*
+ * As above, writing into cover so a caller can reuse its buffer between calls. The graph's flow, label and
+ * scan buffers are reused as well, and only the cells belonging to Aindex x Bindex are touched, so repeated
+ * calls on shrinking subsets cost nothing beyond the subset itself.
+ *
+ * Each call leaves a maximum flow for its subset in those cells. With warmStart, a call on a subset of an
+ * earlier call's vertices (and whose cells no call in between has used, as for the two halves of a split
+ * ratio) starts from that flow, scaled to fit the new normalised capacities, instead of from zero.
+ */
+void BipartiteGraph::vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex, VertexCover& cover,
+                                  bool warmStart) {
     size_t nAVC = Aindex.size(), nBVC = Bindex.size(); //nAVC,nBVC=size of A and B
     double total = 0;
-    vector<vector<double>> ABflow(nA, vector<double>(nB, 0.0));
-    size_t i=0, j=0, k=0, AScanListSize=0, BScanListSize=0, augmentingPathEnd=0, Apathnode=0, Bpathnode=0;
+    size_t i=0, j=0, AScanListSize=0, BScanListSize=0, augmentingPathEnd=0, Apathnode=0, Bpathnode=0;
     bool augmentingPathEndMINUS1 = true;
-    vector<vector<size_t>> CD(4, vector<size_t>(this->n, 0)); //output: incidence vectors of vertex covers, CD[0]=Aside; CD[1]=Bside;
-    vector<size_t> AScanList(nA, 0);
-    vector<size_t> BScanList(nB, 0);
+    if (!warmStart) {
+        for (i = 0; i < nAVC; i++) {
+            double *flow = &ABflow[Aindex[i] * nB];
+            for (j = 0; j < nBVC; j++)
+                flow[Bindex[j]] = 0;
+        }
+    }
+    cover.indices.resize(nAVC + nBVC);
+    cover.aSize = cover.bSize = 0;
 
     /* First set normalized weights */
     total = 0;
@@ -46,12 +127,26 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
     for (j = 0; j < nBVC; j++)
         this->Bvertex[Bindex[j]].residual = Bvertex[Bindex[j]].weight / total;
 
+    if (warmStart)
+        scaleInitialFlow(Aindex, Bindex);
+
+    if (maxFlowAlgorithm == MaxFlowAlgorithm::Dinic)
+        dinic(Aindex, Bindex);
+    else if (maxFlowAlgorithm == MaxFlowAlgorithm::PushRelabel)
+        pushRelabel(Aindex, Bindex);
+
     /* Now comes the flow algorithm
+     * (after Dinic or PushRelabel the flow is already maximal, and the first scan just reads off the cover)
      * Flow on outside arcs are represented by Vertex[i].residual
      * Flow on inside arcs are represented by ABflow
      * Initialize ABflow to 0, start scanlist
      */
 
+    // With both subsets in ascending order, walking the set bits of a packed row visits neighbours in the
+    // same order as the loops over Aindex/Bindex, so the word-parallel scans find the same paths
+    const size_t bits = SplitBitset::bits_per_block;
+    bool wordScan = std::is_sorted(Aindex.begin(), Aindex.end()) && std::is_sorted(Bindex.begin(), Bindex.end());
+
     total = 1; //flow augmentation in last stage
     while (total > 0) {
         //Scan Phase
@@ -61,11 +156,13 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
             Avertex[Aindex[i]].label = -1;
             Avertex[Aindex[i]].pred = -1;
         }
+        std::fill(unlabeledB.begin(), unlabeledB.end(), 0);
         for (j = 0; j < nBVC; j++) {
             Bvertex[Bindex[j]].label = -1;
             Bvertex[Bindex[j]].pred = -1;
-            Bvertex[j].label = -1;
+            unlabeledB[Bindex[j] / bits] |= block_type(1) << (Bindex[j] % bits);
         }
+        std::fill(unlabeledA.begin(), unlabeledA.end(), 0);
         AScanListSize = 0;
         for (i = 0; i < nAVC; i++) {
             if (Avertex[Aindex[i]].residual > 0) {
@@ -75,6 +172,7 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
             }
             else {
                 Avertex[Aindex[i]].label = -1;
+                unlabeledA[Aindex[i] / bits] |= block_type(1) << (Aindex[i] % bits);
             }
         }
 //        for (i = 0; i < nBVC; i++) {
@@ -87,10 +185,25 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
             /* Scan the A side nodes*/
             BScanListSize = 0;
             for (i = 0; i < AScanListSize; i++) {
+                size_t a = AScanList[i];
+                if (wordScan) {
+                    const block_type *row = &rows[a * strideB];
+                    for (size_t w = 0; w < strideB; w++) {
+                        block_type found = row[w] & unlabeledB[w];
+                        unlabeledB[w] &= ~found;
+                        for (; found; found &= found - 1) {
+                            size_t b = w * bits + __builtin_ctzll(found);
+                            Bvertex[b].label = Avertex[a].label;
+                            Bvertex[b].pred = a;
+                            BScanList[BScanListSize++] = b;
+                        }
+                    }
+                    continue;
+                }
                 for (j = 0; j < nBVC; j++) {
-                    if (edge[AScanList[i]][Bindex[j]] && Bvertex[Bindex[j]].label == -1) {
-                        Bvertex[Bindex[j]].label = Avertex[AScanList[i]].label;
-                        Bvertex[Bindex[j]].pred = AScanList[i];
+                    if (isEdge(a, Bindex[j]) && Bvertex[Bindex[j]].label == -1) {
+                        Bvertex[Bindex[j]].label = Avertex[a].label;
+                        Bvertex[Bindex[j]].pred = a;
                         BScanList[BScanListSize] = Bindex[j];
                         BScanListSize++;
                     }
@@ -99,17 +212,31 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
             /* Scan the B side nodes*/
             AScanListSize = 0;
             for (j = 0; j < BScanListSize; j++) {
-                if (Bvertex[BScanList[j]].residual > 0) {
-                    total = min(Bvertex[BScanList[j]].residual, Bvertex[BScanList[j]].label);
-                    augmentingPathEnd = BScanList[j];
+                size_t b = BScanList[j];
+                if (Bvertex[b].residual > 0) {
+                    total = min(Bvertex[b].residual, Bvertex[b].label);
+                    augmentingPathEnd = b;
                     augmentingPathEndMINUS1 = false;
                     scanning = false;
                     break;
+                } else if (wordScan) {
+                    const block_type *col = &cols[b * strideA];
+                    for (size_t w = 0; w < strideA; w++) {
+                        for (block_type found = col[w] & unlabeledA[w]; found; found &= found - 1) {
+                            size_t a = w * bits + __builtin_ctzll(found);
+                            if (ABflow[a * nB + b] > 0) {
+                                Avertex[a].label = min(Bvertex[b].label, ABflow[a * nB + b]);
+                                Avertex[a].pred = b;
+                                AScanList[AScanListSize++] = a;
+                                unlabeledA[w] &= ~(block_type(1) << (a % bits));
+                            }
+                        }
+                    }
                 } else {
                     for (i = 0; i < nAVC; i++) {
-                        if (edge[Aindex[i]][BScanList[j]] && Avertex[Aindex[i]].label == -1 && ABflow[Aindex[i]][BScanList[j]] > 0) {
-                            Avertex[Aindex[i]].label = min(Bvertex[BScanList[j]].label, ABflow[Aindex[i]][BScanList[j]]);
-                            Avertex[Aindex[i]].pred = BScanList[j];
+                        if (isEdge(Aindex[i], b) && Avertex[Aindex[i]].label == -1 && ABflow[Aindex[i] * nB + b] > 0) {
+                            Avertex[Aindex[i]].label = min(Bvertex[b].label, ABflow[Aindex[i] * nB + b]);
+                            Avertex[Aindex[i]].pred = b;
                             AScanList[AScanListSize] = Aindex[i];
                             AScanListSize++;
                         }
@@ -124,33 +251,394 @@ vector<vector<size_t>> BipartiteGraph::vertex_cover(const vector<size_t>& Aindex
                 Bpathnode = augmentingPathEnd;
                 Apathnode = Bvertex[Bpathnode].pred;
 
-                ABflow[Apathnode][Bpathnode] = ABflow[Apathnode][Bpathnode] + total;
+                ABflow[Apathnode * nB + Bpathnode] = ABflow[Apathnode * nB + Bpathnode] + total;
                 while (Avertex[Apathnode].pred != -1) {
                     Bpathnode = Avertex[Apathnode].pred;
-                    ABflow[Apathnode][Bpathnode] = ABflow[Apathnode][Bpathnode] - total;
+                    ABflow[Apathnode * nB + Bpathnode] = ABflow[Apathnode * nB + Bpathnode] - total;
                     Apathnode = Bvertex[Bpathnode].pred;
-                    ABflow[Apathnode][Bpathnode] = ABflow[Apathnode][Bpathnode] + total;
+                    ABflow[Apathnode * nB + Bpathnode] = ABflow[Apathnode * nB + Bpathnode] + total;
 
                 }
                 Avertex[Apathnode].residual = Avertex[Apathnode].residual - total;
             }
         } else { //min vertex cover found, unlabeled A's, labeled B's
-            k = 0;
             for (i = 0; i < nAVC; i++)
-                if (Avertex[Aindex[i]].label == -1) {
-                    CD[2][k] = Aindex[i];
-                    k++;
-                }
-            CD[0][0] = k;
-            k = 0;
+                if (Avertex[Aindex[i]].label == -1)
+                    cover.indices[cover.aSize++] = Aindex[i];
             for (j = 0; j < nBVC; j++)
-                if (Bvertex[Bindex[j]].label >= 0) {
-                    CD[3][k] = Bindex[j];
-                    k++;
-                }
-            CD[1][0] = k;
+                if (Bvertex[Bindex[j]].label >= 0)
+                    cover.indices[cover.aSize + cover.bSize++] = Bindex[j];
         }
     }//flow algorithm
-    return CD;
 
 } //vertex_cover;
+
+/*
+ * Turn the flow left in Aindex x Bindex into a feasible flow for the capacities just set in the residuals.
+ * The half of a split ratio inherits one side that its parent saturated; the flow is scaled up until that
+ * side is saturated again, and vertices on the other side pushed over their capacity have their arcs
+ * trimmed back to it. Bvertex labels hold the inflow sums; the scan phase sets them afresh.
+ */
+void BipartiteGraph::scaleInitialFlow(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+    const double infinity = std::numeric_limits<double>::infinity();
+    double scaleA = infinity, scaleB = infinity;
+    for (size_t b : Bindex)
+        Bvertex[b].label = 0;
+    for (size_t a : Aindex) {
+        const double *flow = &ABflow[a * nB];
+        double out = 0;
+        for (size_t b : Bindex) {
+            out += flow[b];
+            Bvertex[b].label += flow[b];
+        }
+        if (out > 0)
+            scaleA = min(scaleA, Avertex[a].residual / out);
+    }
+    for (size_t b : Bindex)
+        if (Bvertex[b].label > 0)
+            scaleB = min(scaleB, Bvertex[b].residual / Bvertex[b].label);
+    if (scaleA == infinity)
+        return; // no flow to start from
+    double scale = max(scaleA, scaleB);
+
+    // scale, trimming the rows of A vertices that overflow
+    for (size_t b : Bindex)
+        Bvertex[b].label = 0;
+    for (size_t a : Aindex) {
+        double *flow = &ABflow[a * nB];
+        double out = 0;
+        for (size_t b : Bindex)
+            out += flow[b];
+        double rowScale = out * scale > Avertex[a].residual ? Avertex[a].residual / out : scale;
+        for (size_t b : Bindex) {
+            flow[b] *= rowScale;
+            Bvertex[b].label += flow[b];
+        }
+    }
+    // then the columns of B vertices that overflow, which only lowers the A outflows
+    for (size_t b : Bindex) {
+        if (Bvertex[b].label > Bvertex[b].residual) {
+            double columnScale = Bvertex[b].residual / Bvertex[b].label;
+            for (size_t a : Aindex)
+                ABflow[a * nB + b] *= columnScale;
+            Bvertex[b].residual = 0;
+        } else {
+            Bvertex[b].residual -= Bvertex[b].label;
+        }
+    }
+    for (size_t a : Aindex) {
+        const double *flow = &ABflow[a * nB];
+        double out = 0;
+        for (size_t b : Bindex)
+            out += flow[b];
+        Avertex[a].residual = max(0.0, Avertex[a].residual - out);
+    }
+}
+
+/*
+ * First index at or after from whose bit is set in both x and y, or SplitBitset::npos
+ */
+static size_t nextCommonBit(const BipartiteGraph::block_type *x, const BipartiteGraph::block_type *y, size_t words,
+                            size_t from) {
+    const size_t bits = SplitBitset::bits_per_block;
+    size_t w = from / bits;
+    if (w >= words)
+        return SplitBitset::npos;
+    BipartiteGraph::block_type found = x[w] & y[w] & (~BipartiteGraph::block_type(0) << (from % bits));
+    while (!found) {
+        if (++w == words)
+            return SplitBitset::npos;
+        found = x[w] & y[w];
+    }
+    return w * bits + __builtin_ctzll(found);
+}
+
+void BipartiteGraph::prepareFlowScratch(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+    if (height.size() != nA + nB) {
+        subsetA.resize(strideA);
+        subsetB.resize(strideB);
+        height.resize(nA + nB);
+        arc.resize(nA + nB);
+        excess.resize(nA + nB);
+        heightCount.resize(nA + nB + 3);
+    }
+    const size_t bits = SplitBitset::bits_per_block;
+    std::fill(subsetA.begin(), subsetA.end(), 0);
+    std::fill(subsetB.begin(), subsetB.end(), 0);
+    for (size_t a : Aindex)
+        subsetA[a / bits] |= block_type(1) << (a % bits);
+    for (size_t b : Bindex)
+        subsetB[b / bits] |= block_type(1) << (b % bits);
+}
+
+/*
+ * Dinic: repeatedly build the level graph of the residual network by BFS from the source, then saturate it
+ * with a blocking flow found by depth-first search with current-arc pointers (arc[v]; for a B vertex, 0
+ * stands for its sink arc and a + 1 for the arc back to A vertex a).
+ */
+void BipartiteGraph::dinic(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+    prepareFlowScratch(Aindex, Bindex);
+    int sinkLevel;
+    while (dinicLevels(Aindex, Bindex, sinkLevel)) {
+        for (size_t a : Aindex)
+            arc[a] = 0;
+        for (size_t b : Bindex)
+            arc[nA + b] = 0;
+        for (size_t a : Aindex) {
+            if (height[a] != 0)
+                continue;
+            while (Avertex[a].residual > 0) {
+                double pushed = dinicPushA(a, Avertex[a].residual, sinkLevel);
+                if (pushed <= 0)
+                    break;
+                Avertex[a].residual -= pushed;
+            }
+        }
+    }
+}
+
+/*
+ * BFS levels of the residual network (arc doubles as the queue); false once the sink is unreachable
+ */
+bool BipartiteGraph::dinicLevels(const vector<size_t>& Aindex, const vector<size_t>& Bindex, int& sinkLevel) {
+    size_t head = 0, tail = 0;
+    sinkLevel = -1;
+    for (size_t b : Bindex)
+        height[nA + b] = -1;
+    for (size_t a : Aindex) {
+        height[a] = -1;
+        if (Avertex[a].residual > 0) {
+            height[a] = 0;
+            arc[tail++] = a;
+        }
+    }
+    while (head < tail) {
+        size_t v = arc[head++];
+        if (sinkLevel >= 0 && height[v] + 1 >= sinkLevel)
+            continue; // nothing further out lies on a shortest path
+        if (v < nA) {
+            const block_type *row = &rows[v * strideB];
+            for (size_t b = nextCommonBit(row, &subsetB[0], strideB, 0); b != SplitBitset::npos;
+                 b = nextCommonBit(row, &subsetB[0], strideB, b + 1)) {
+                if (height[nA + b] < 0) {
+                    height[nA + b] = height[v] + 1;
+                    arc[tail++] = nA + b;
+                }
+            }
+        } else {
+            size_t b = v - nA;
+            if (Bvertex[b].residual > 0 && sinkLevel < 0)
+                sinkLevel = height[v] + 1;
+            const block_type *col = &cols[b * strideA];
+            for (size_t a = nextCommonBit(col, &subsetA[0], strideA, 0); a != SplitBitset::npos;
+                 a = nextCommonBit(col, &subsetA[0], strideA, a + 1)) {
+                if (height[a] < 0 && ABflow[a * nB + b] > 0) {
+                    height[a] = height[v] + 1;
+                    arc[tail++] = a;
+                }
+            }
+        }
+    }
+    return sinkLevel >= 0;
+}
+
+double BipartiteGraph::dinicPushA(size_t a, double limit, int sinkLevel) {
+    const block_type *row = &rows[a * strideB];
+    for (size_t b = nextCommonBit(row, &subsetB[0], strideB, arc[a]); b != SplitBitset::npos;
+         b = nextCommonBit(row, &subsetB[0], strideB, b + 1)) {
+        arc[a] = b;
+        if (height[nA + b] == height[a] + 1) {
+            double pushed = dinicPushB(b, limit, sinkLevel);
+            if (pushed > 0) {
+                ABflow[a * nB + b] += pushed;
+                return pushed;
+            }
+        }
+    }
+    arc[a] = nB;
+    return 0;
+}
+
+double BipartiteGraph::dinicPushB(size_t b, double limit, int sinkLevel) {
+    size_t v = nA + b;
+    if (arc[v] == 0) {
+        if (height[v] + 1 == sinkLevel && Bvertex[b].residual > 0) {
+            double pushed = min(limit, Bvertex[b].residual);
+            Bvertex[b].residual -= pushed;
+            return pushed;
+        }
+        arc[v] = 1;
+    }
+    const block_type *col = &cols[b * strideA];
+    for (size_t a = nextCommonBit(col, &subsetA[0], strideA, arc[v] - 1); a != SplitBitset::npos;
+         a = nextCommonBit(col, &subsetA[0], strideA, a + 1)) {
+        arc[v] = a + 1;
+        double flow = ABflow[a * nB + b];
+        if (height[a] == height[v] + 1 && flow > 0) {
+            double pushed = dinicPushA(a, min(limit, flow), sinkLevel);
+            if (pushed > 0) {
+                ABflow[a * nB + b] -= pushed;
+                return pushed;
+            }
+        }
+    }
+    arc[v] = nA + 1;
+    return 0;
+}
+
+/*
+ * FIFO push-relabel with the gap heuristic. The first phase computes a maximum preflow, leaving stranded
+ * excess at vertices lifted to height N (no longer able to reach the sink); the second phase sends that
+ * excess back towards the source, which is direct here since the network has no cycles.
+ */
+void BipartiteGraph::pushRelabel(const vector<size_t>& Aindex, const vector<size_t>& Bindex) {
+    prepareFlowScratch(Aindex, Bindex);
+    const int N = (int) (Aindex.size() + Bindex.size() + 2);
+    size_t *queue = &arc[0];
+    size_t queueSize = Aindex.size() + Bindex.size(), head = 0, count = 0;
+    std::fill(heightCount.begin(), heightCount.begin() + N + 1, 0);
+
+    // exact distances to the sink in the residual network, by BFS backwards from the sink: a B vertex with
+    // sink capacity left is at 1, an A vertex one further than a B it crosses, a B vertex one further than
+    // an A it carries flow from. Whatever is not reached cannot get flow to the sink.
+    size_t tail = 0;
+    for (size_t b : Bindex) {
+        excess[nA + b] = 0;
+        height[nA + b] = N;
+        if (Bvertex[b].residual > 0) {
+            height[nA + b] = 1;
+            queue[tail++] = nA + b;
+        }
+    }
+    for (size_t a : Aindex) {
+        excess[a] = Avertex[a].residual; // saturate the source arcs
+        Avertex[a].residual = 0;
+        height[a] = N;
+    }
+    for (size_t next = 0; next < tail; next++) {
+        size_t v = queue[next];
+        if (v >= nA) {
+            const block_type *col = &cols[(v - nA) * strideA];
+            for (size_t a = nextCommonBit(col, &subsetA[0], strideA, 0); a != SplitBitset::npos;
+                 a = nextCommonBit(col, &subsetA[0], strideA, a + 1)) {
+                if (height[a] == N) {
+                    height[a] = height[v] + 1;
+                    queue[tail++] = a;
+                }
+            }
+        } else {
+            const block_type *row = &rows[v * strideB];
+            for (size_t b = nextCommonBit(row, &subsetB[0], strideB, 0); b != SplitBitset::npos;
+                 b = nextCommonBit(row, &subsetB[0], strideB, b + 1)) {
+                if (height[nA + b] == N && ABflow[v * nB + b] > 0) {
+                    height[nA + b] = height[v] + 1;
+                    queue[tail++] = nA + b;
+                }
+            }
+        }
+    }
+    for (size_t a : Aindex)
+        if (height[a] < N)
+            heightCount[height[a]]++;
+    for (size_t b : Bindex)
+        if (height[nA + b] < N)
+            heightCount[height[nA + b]]++;
+
+    auto activate = [&](size_t v) {
+        queue[(head + count++) % queueSize] = v;
+    };
+    auto relabel = [&](size_t v, int newHeight) {
+        int old = height[v];
+        if (--heightCount[old] == 0) {
+            // gap: nothing above old can reach the sink any more
+            for (size_t a : Aindex)
+                if (height[a] > old && height[a] < N) {
+                    heightCount[height[a]]--;
+                    height[a] = N;
+                }
+            for (size_t b : Bindex)
+                if (height[nA + b] > old && height[nA + b] < N) {
+                    heightCount[height[nA + b]]--;
+                    height[nA + b] = N;
+                }
+            height[v] = N;
+            return;
+        }
+        height[v] = min(newHeight, N);
+        if (height[v] < N)
+            heightCount[height[v]]++;
+    };
+
+    for (size_t a : Aindex)
+        if (excess[a] > 0 && height[a] < N)
+            activate(a);
+
+    while (count > 0) {
+        size_t v = queue[head];
+        head = (head + 1) % queueSize;
+        count--;
+        while (height[v] < N) {
+            int minHeight = N;
+            if (v < nA) {
+                // the inside arcs have unbounded capacity, so the first admissible one takes all the excess
+                const block_type *row = &rows[v * strideB];
+                for (size_t b = nextCommonBit(row, &subsetB[0], strideB, 0); b != SplitBitset::npos;
+                     b = nextCommonBit(row, &subsetB[0], strideB, b + 1)) {
+                    if (height[nA + b] == height[v] - 1) {
+                        ABflow[v * nB + b] += excess[v];
+                        if (excess[nA + b] == 0)
+                            activate(nA + b);
+                        excess[nA + b] += excess[v];
+                        excess[v] = 0;
+                        break;
+                    }
+                    minHeight = min(minHeight, height[nA + b]);
+                }
+            } else {
+                size_t b = v - nA;
+                if (Bvertex[b].residual > 0 && height[v] == 1) {
+                    double pushed = min(excess[v], Bvertex[b].residual);
+                    Bvertex[b].residual -= pushed;
+                    excess[v] -= pushed;
+                }
+                if (Bvertex[b].residual > 0)
+                    minHeight = 0;
+                const block_type *col = &cols[b * strideA];
+                for (size_t a = nextCommonBit(col, &subsetA[0], strideA, 0); a != SplitBitset::npos && excess[v] > 0;
+                     a = nextCommonBit(col, &subsetA[0], strideA, a + 1)) {
+                    double &flow = ABflow[a * nB + b];
+                    if (flow <= 0)
+                        continue;
+                    if (height[a] == height[v] - 1) {
+                        double pushed = min(excess[v], flow);
+                        flow -= pushed;
+                        if (excess[a] == 0)
+                            activate(a);
+                        excess[a] += pushed;
+                        excess[v] -= pushed;
+                    } else {
+                        minHeight = min(minHeight, height[a]);
+                    }
+                }
+            }
+            if (excess[v] == 0)
+                break;
+            relabel(v, minHeight + 1);
+        }
+    }
+
+    // return the stranded excess, turning the preflow into a flow of the same value
+    for (size_t b : Bindex) {
+        size_t v = nA + b;
+        const block_type *col = &cols[b * strideA];
+        for (size_t a = nextCommonBit(col, &subsetA[0], strideA, 0); a != SplitBitset::npos && excess[v] > 0;
+             a = nextCommonBit(col, &subsetA[0], strideA, a + 1)) {
+            double pushed = min(excess[v], ABflow[a * nB + b]);
+            ABflow[a * nB + b] -= pushed;
+            excess[a] += pushed;
+            excess[v] -= pushed;
+        }
+    }
+    for (size_t a : Aindex)
+        Avertex[a].residual += excess[a];
+}
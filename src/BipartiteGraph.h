@@ -5,20 +5,102 @@
 #endif
 #include <deque>
 #include <vector>
+#include "MonotonicArena.h"
 #include "PhyloTreeEdge.h"
+#include "SplitMatrix.h"
 #include "Vertex.h"
 
+/*
+ * Minimum vertex cover of a subgraph, as two compact spans of vertex indices: the A side is
+ * indices[0, aSize) and the B side indices[aSize, aSize + bSize), each in the order of the subset passed to
+ * BipartiteGraph::vertex_cover. The buffer keeps its capacity when the cover is reused.
+ */
+struct VertexCover {
+    vector<size_t> indices;
+    size_t aSize = 0, bSize = 0;
+
+    const size_t *aBegin() const { return indices.data(); }
+
+    const size_t *aEnd() const { return indices.data() + aSize; }
+
+    const size_t *bBegin() const { return aEnd(); }
+
+    const size_t *bEnd() const { return aEnd() + bSize; }
+};
+
+/*
+ * Max-flow algorithm behind BipartiteGraph::vertex_cover. Whichever one runs, the cover is read off the
+ * same final residual scan, and the vertices reachable from the source are the same for every maximum
+ * flow, so all of them give the same cover. The one exception is a tie between minimum covers that only
+ * rounding separates (e.g. all of A against all of B); the tied covers split a ratio into parts of equal
+ * ratio, so the geodesic comes out the same either way.
+ *
+ * LabelScan is the original augmenting-path scan, restarted after every augmentation. Dinic pushes a
+ * blocking flow per level graph. PushRelabel is FIFO push-relabel with the gap heuristic. Below about 30
+ * vertices a side the three are within a small factor of each other; above that Dinic (dense graphs) and
+ * PushRelabel (sparse graphs) win by up to an order of magnitude. See bench_vertex_cover.
+ */
+enum class MaxFlowAlgorithm {
+    LabelScan, Dinic, PushRelabel
+};
+
 class BipartiteGraph {
 
 public :
     BipartiteGraph(std::vector<std::deque<bool>>& IncidenceMatrix, const std::vector<double>& Aweight, const std::vector<double>& Bweight);
-    vector<vector<size_t>> vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+    BipartiteGraph(const SplitMatrix& splits1, const SplitMatrix& splits2, MonotonicArena& arena);
+    VertexCover vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+    void vertex_cover(const vector<size_t>& Aindex, const vector<size_t>& Bindex, VertexCover& cover, bool warmStart = false);
     static std::vector<std::deque<bool>> getIncidenceMatrix(std::vector<PhyloTreeEdge>& edges1, std::vector<PhyloTreeEdge>& edges2);
+    static std::vector<std::deque<bool>> getIncidenceMatrix(const SplitMatrix& splits1, const SplitMatrix& splits2);
+
+    typedef SplitBitset::block_type block_type;
+
+    MaxFlowAlgorithm getMaxFlowAlgorithm() const { return maxFlowAlgorithm; }
+
+    void setMaxFlowAlgorithm(MaxFlowAlgorithm algorithm) { maxFlowAlgorithm = algorithm; }
+
+    bool isEdge(size_t a, size_t b) const {
+        return (rows[a * strideB + b / SplitBitset::bits_per_block] >> (b % SplitBitset::bits_per_block)) & 1;
+    }
 
 public :
-    std::vector<std::deque<bool>> edge;
     size_t nA, nB, n;
-    std::vector<Vertex> Avertex, Bvertex;
+    size_t strideA, strideB; // words per column (over A) and per row (over B)
+    ArenaVector<block_type> rows; // incidence as packed bit rows: bit b of row a set if a and b cross
+    ArenaVector<block_type> cols; // transposed copy: bit a of column b
+    ArenaVector<Vertex> Avertex, Bvertex;
+
+private :
+    ArenaVector<double> ABflow; // flow on the inside arcs, nA x nB; only the current subset's cells are reset
+    ArenaVector<size_t> AScanList, BScanList;
+    ArenaVector<block_type> unlabeledA, unlabeledB; // vertices of the current subset still labelled -1
+    MaxFlowAlgorithm maxFlowAlgorithm = MaxFlowAlgorithm::LabelScan;
+
+    // scratch for Dinic and PushRelabel, sized on first use; A vertices at [0, nA), B vertices at nA + b
+    ArenaVector<block_type> subsetA, subsetB; // the current Aindex/Bindex as bit masks
+    ArenaVector<int> height; // BFS level (Dinic) or height (PushRelabel)
+    ArenaVector<size_t> arc; // current arc (Dinic) or FIFO queue (PushRelabel)
+    ArenaVector<double> excess;
+    ArenaVector<int> heightCount;
+
+    void allocate();
+
+    void scaleInitialFlow(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+
+    void prepareFlowScratch(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+
+    void dinic(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+
+    bool dinicLevels(const vector<size_t>& Aindex, const vector<size_t>& Bindex, int& sinkLevel);
+
+    double dinicPushA(size_t a, double limit, int sinkLevel);
+
+    double dinicPushB(size_t b, double limit, int sinkLevel);
+
+    void pushRelabel(const vector<size_t>& Aindex, const vector<size_t>& Bindex);
+
+    void setEdge(size_t a, size_t b);
 };
 
 #endif /* __BIPARTITE_GRAPH_H__ */
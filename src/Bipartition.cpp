@@ -6,23 +6,23 @@
 
 using namespace std;
 
-Bipartition::Bipartition() {
-    partition = boost::dynamic_bitset<>(0);
+Bipartition::Bipartition() : partition() {
 }
 
 // copy-constructor
 Bipartition::Bipartition(const Bipartition &e) : partition(e.partition) {
 }
 
-Bipartition::Bipartition(boost::dynamic_bitset<> &edge) : partition(edge) {
+Bipartition::Bipartition(Bipartition &&e) : partition(std::move(e.partition)) {
 }
 
-Bipartition::Bipartition(const boost::dynamic_bitset<> &edge) {
-    partition = boost::dynamic_bitset<>(edge);
+Bipartition::Bipartition(const SplitBitset &edge) : partition(edge) {
 }
 
-Bipartition::Bipartition(string s) {
-    partition = boost::dynamic_bitset<>(s);
+Bipartition::Bipartition(SplitBitset &&edge) : partition(std::move(edge)) {
+}
+
+Bipartition::Bipartition(string s) : partition(s) {
 }
 
 void Bipartition::addOne(size_t index) {
@@ -37,9 +37,7 @@ void Bipartition::complement(size_t numLeaves) {
 }
 
 bool Bipartition::contains(const Bipartition& e) const {
-    auto foreign = e.partition;
-    foreign &= partition;
-    return foreign == e.partition;
+    return e.partition.is_subset_of(partition);
 }
 
 bool Bipartition::contains(size_t i) {
@@ -62,7 +60,7 @@ bool Bipartition::equals(const Bipartition &e) const {
     return partition == (e.partition);
 }
 
-boost::dynamic_bitset<> Bipartition::getPartition() const {
+const SplitBitset &Bipartition::getPartition() const {
     return partition;
 }
 
@@ -87,7 +85,7 @@ void Bipartition::removeOne(size_t index) {
     partition[size() - index - 1] = false;
 }
 
-void Bipartition::setPartition(boost::dynamic_bitset<> edge) {
+void Bipartition::setPartition(const SplitBitset &edge) {
     partition = edge;
 }
 
@@ -96,12 +94,10 @@ void Bipartition::clear() {
 }
 
 string Bipartition::toString() {
-    string s;
-    to_string(partition, s);
-    return s;
+    return partition.to_string();
 }
 
-string Bipartition::toStringVerbose(boost::dynamic_bitset<> edge, vector<string> leaf2NumMap) {
+string Bipartition::toStringVerbose(const SplitBitset &edge, const vector<string> &leaf2NumMap) {
     string toDisplay = "";
     size_t edge_size = edge.size();
     for (size_t i = 0; i < edge_size; i++) {
@@ -3,9 +3,10 @@
 #ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #endif
-#include <boost/dynamic_bitset.hpp>
 #include <memory>
 #include <string>
+#include <vector>
+#include "SplitBitset.h"
 
 using namespace std;
 
@@ -15,13 +16,21 @@ public:
 
     Bipartition(const Bipartition &e); // copy-constructor
 
-    Bipartition(boost::dynamic_bitset<>& edge);
+    Bipartition(Bipartition &&e);
 
-    Bipartition(const boost::dynamic_bitset<>& edge);
+    Bipartition(const SplitBitset& edge);
+
+    Bipartition(SplitBitset&& edge);
 
     Bipartition(string s);
 
-    boost::dynamic_bitset<> getPartition() const;
+    Bipartition &operator=(const Bipartition &e) = default;
+
+    Bipartition &operator=(Bipartition &&e) = default;
+
+    virtual ~Bipartition() = default;
+
+    const SplitBitset &getPartition() const;
 
     inline bool operator==(const Bipartition& other) const {
         return (*this).equals(other);
@@ -56,7 +65,7 @@ public:
         return Bipartition(~(this->getPartition()));
     }
 
-    void setPartition(boost::dynamic_bitset<> edge);
+    void setPartition(const SplitBitset &edge);
 
     bool isEmpty();
 
@@ -85,16 +94,16 @@ public:
     bool isCompatibleWith(const vector<Bipartition> &splits);
 
     Bipartition &andNot(const Bipartition &other) {
-        partition &= ~(other.partition);
+        partition.andNot(other.partition);
         return *this;
     }
 
     size_t size();
 
-    static string toStringVerbose(boost::dynamic_bitset<> edge, vector<string> leaf2NumMap);
+    static string toStringVerbose(const SplitBitset &edge, const vector<string> &leaf2NumMap);
 
 protected:
-    boost::dynamic_bitset<> partition;
+    SplitBitset partition;
 };
 
 #endif /* __BIPARTITION_H__ */
@@ -0,0 +1,201 @@
+#include "ClusterTable.h"
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    const size_t npos = Topology::npos;
+
+    /*
+     * A tree hung from its split root: the parse root for a rooted tree, the leaf with the last label
+     * for an unrooted one, so that every split is the set of leaves below one node. Children appear in
+     * the preorder in string order, and firstChild[p] is the first of p's children to be visited.
+     */
+    struct Orientation {
+        size_t root;
+        vector<size_t> parent, preorder, firstChild;
+    };
+
+    void orient(const Topology &tree, Orientation &o) {
+        const size_t n = tree.numNodes();
+        o.root = 0;
+        if (!tree.isRooted() && tree.numLeaves() > 0) {
+            const vector<string> &labels = tree.getLabels();
+            size_t last = 0;
+            for (size_t l = 1; l < labels.size(); ++l) {
+                if (labels[last] < labels[l]) last = l;
+            }
+            o.root = tree.getLeafNode(last);
+        }
+
+        // undirected adjacency in CSR form, neighbours in string order with the parent first
+        vector<size_t> start(n + 1, 0), adjacent(2 * (n - 1));
+        for (size_t v = 1; v < n; ++v) {
+            start[v + 1]++;
+            start[tree.getParent(v) + 1]++;
+        }
+        for (size_t v = 0; v < n; ++v) start[v + 1] += start[v];
+        vector<size_t> fill(start.begin(), start.end() - 1);
+        for (size_t v = 1; v < n; ++v) {
+            size_t p = tree.getParent(v);
+            adjacent[fill[v]++] = p;
+            adjacent[fill[p]++] = v;
+        }
+
+        o.parent.assign(n, npos);
+        o.firstChild.assign(n, npos);
+        o.preorder.clear();
+        o.preorder.reserve(n);
+        vector<size_t> stack(1, o.root);
+        while (!stack.empty()) {
+            size_t v = stack.back();
+            stack.pop_back();
+            o.preorder.push_back(v);
+            for (size_t a = start[v + 1]; a-- > start[v];) {
+                size_t w = adjacent[a];
+                if (w == o.parent[v]) continue;
+                o.parent[w] = v;
+                stack.push_back(w);
+            }
+        }
+        for (size_t v: o.preorder) {
+            if (v != o.root && o.firstChild[o.parent[v]] == npos) o.firstChild[o.parent[v]] = v;
+        }
+    }
+
+    /*
+     * Min, max and count of the leaf numbers below each node, and for each node the highest node above
+     * it with the same count: nodes joined by unary nodes have the same leaves, so that node stands for
+     * their split.
+     */
+    void summarise(const Topology &tree, const Orientation &o, const vector<size_t> &number,
+                   vector<size_t> &low, vector<size_t> &high, vector<size_t> &count, vector<size_t> &top) {
+        const size_t n = tree.numNodes();
+        low.assign(n, npos);
+        high.assign(n, 0);
+        count.assign(n, 0);
+        for (size_t k = n; k-- > 0;) {
+            size_t v = o.preorder[k];
+            size_t leaf = tree.getLeaf(v);
+            if (leaf != npos) {
+                low[v] = min(low[v], number[leaf]);
+                high[v] = max(high[v], number[leaf]);
+                count[v]++;
+            }
+            size_t p = o.parent[v];
+            if (v != o.root) {
+                low[p] = min(low[p], low[v]);
+                high[p] = max(high[p], high[v]);
+                count[p] += count[v];
+            }
+        }
+        top.resize(n);
+        for (size_t v: o.preorder) {
+            top[v] = (v != o.root && count[o.parent[v]] == count[v]) ? top[o.parent[v]] : v;
+        }
+    }
+
+    /* Number of tree edges giving each split, on the split's top node */
+    void countSplits(const Topology &tree, const Orientation &o, const vector<size_t> &top, vector<size_t> &multiplicity) {
+        multiplicity.assign(tree.numNodes(), 0);
+        for (size_t v = 1; v < tree.numNodes(); ++v) {
+            if (tree.getLeaf(v) != npos) continue;
+            size_t p = tree.getParent(v);
+            size_t k = top[o.parent[v] == p ? v : p];
+            if (tree.isRooted()) multiplicity[k]++;
+            else multiplicity[k] = 1;
+        }
+    }
+}
+
+ClusterTable::ClusterTable(const Topology &tree) : emptySplits(0), splits(0) {
+    Orientation o;
+    orient(tree, o);
+
+    // number the leaves in depth-first order; an unrooted tree's root leaf is in no split and goes last
+    const size_t numLeaves = tree.numLeaves();
+    vector<size_t> number(numLeaves);
+    size_t next = 0;
+    for (size_t v: o.preorder) {
+        size_t leaf = tree.getLeaf(v);
+        if (leaf != npos && v != o.root) number[leaf] = next++;
+    }
+    if (tree.getLeaf(o.root) != npos) number[tree.getLeaf(o.root)] = next;
+    leafNumber.reserve(numLeaves);
+    for (size_t l = 0; l < numLeaves; ++l) leafNumber[tree.getLabels()[l]] = number[l];
+
+    vector<size_t> count, top;
+    summarise(tree, o, number, low, high, count, top);
+    countSplits(tree, o, top, multiplicity);
+
+    byLeft.assign(numLeaves, npos);
+    byRight.assign(numLeaves, npos);
+    for (size_t v = 0; v < tree.numNodes(); ++v) {
+        if (multiplicity[v] == 0) continue;
+        splits += multiplicity[v];
+        if (count[v] == 0) {
+            emptySplits += multiplicity[v];
+            multiplicity[v] = 0;
+        }
+        else if (v == o.root || o.firstChild[o.parent[v]] == v) {
+            byRight[high[v]] = v;
+        }
+        else {
+            byLeft[low[v]] = v;
+        }
+    }
+}
+
+size_t ClusterTable::numSplits() const {
+    return splits;
+}
+
+/* The node of the table's split with exactly the leaf numbers in [l, h], or npos */
+size_t ClusterTable::find(size_t l, size_t h, size_t count) const {
+    if (h - l + 1 != count) return npos;
+    size_t v = byRight[h];
+    if (v != npos && low[v] == l) return v;
+    v = byLeft[l];
+    if (v != npos && high[v] == h) return v;
+    return npos;
+}
+
+void ClusterTable::countDifferences(const Topology &other, size_t &onlyInTable, size_t &onlyInOther, size_t &otherSplits) const {
+    if (other.numLeaves() != leafNumber.size()) {
+        throw runtime_error("leaf2NumMaps are not equal");
+    }
+    vector<size_t> number(other.numLeaves());
+    for (size_t l = 0; l < other.numLeaves(); ++l) {
+        auto it = leafNumber.find(other.getLabels()[l]);
+        if (it == leafNumber.end()) throw runtime_error("leaf2NumMaps are not equal");
+        number[l] = it->second;
+    }
+
+    Orientation o;
+    orient(other, o);
+    vector<size_t> otherLow, otherHigh, count, top, otherMultiplicity;
+    summarise(other, o, number, otherLow, otherHigh, count, top);
+    countSplits(other, o, top, otherMultiplicity);
+
+    vector<bool> hit(multiplicity.size(), false);
+    size_t otherEmpty = 0;
+    onlyInOther = otherSplits = 0;
+    for (size_t v = 0; v < other.numNodes(); ++v) {
+        if (otherMultiplicity[v] == 0) continue;
+        otherSplits += otherMultiplicity[v];
+        if (count[v] == 0) {
+            otherEmpty += otherMultiplicity[v];
+            continue;
+        }
+        size_t match = find(otherLow[v], otherHigh[v], count[v]);
+        if (match == npos) onlyInOther += otherMultiplicity[v];
+        else hit[match] = true;
+    }
+
+    onlyInTable = 0;
+    for (size_t v = 0; v < multiplicity.size(); ++v) {
+        if (multiplicity[v] > 0 && !hit[v]) onlyInTable += multiplicity[v];
+    }
+    if (otherEmpty == 0) onlyInTable += emptySplits;
+    if (emptySplits == 0) onlyInOther += otherEmpty;
+}
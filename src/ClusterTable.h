@@ -0,0 +1,47 @@
+#ifndef __CLUSTER_TABLE_H__
+#define __CLUSTER_TABLE_H__
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Topology.h"
+
+using namespace std;
+
+/*
+ * Day's cluster table for one tree (W. H. E. Day, "Optimal algorithms for comparing trees with labeled
+ * leaves", 1985). The leaves are numbered in depth-first order so that every split of the tree is an
+ * interval [L, R] of leaf numbers; each interval is stored in row R if its node is the first child of
+ * its parent and in row L otherwise, which keeps the rows collision free. The splits of a second tree
+ * are then looked up in O(1) each from the min, max and size of their leaves' numbers, giving the
+ * Robinson-Foulds distance in linear time and memory without any bitsets.
+ *
+ * Splits follow PhyloTree's conventions: a rooted tree has one cluster per internal edge (duplicates
+ * counted separately), an unrooted tree has one split per distinct bipartition, taken on the side
+ * without the last leaf in label order.
+ */
+class ClusterTable {
+public:
+    explicit ClusterTable(const Topology &tree);
+
+    /* Number of splits of the table's tree (PhyloTree's edge count) */
+    size_t numSplits() const;
+
+    /*
+     * Count the splits of the table's tree that are not in other, and the splits of other that are not
+     * in the table's tree. Throws if the trees have different leaf sets.
+     */
+    void countDifferences(const Topology &other, size_t &onlyInTable, size_t &onlyInOther, size_t &otherSplits) const;
+
+private:
+    unordered_map<string, size_t> leafNumber;
+    // per node of the table's tree; multiplicity is non-zero only on the node representing each split
+    vector<size_t> low, high, multiplicity;
+    // per leaf number: the node whose interval is stored in that row, or Topology::npos
+    vector<size_t> byLeft, byRight;
+    size_t emptySplits, splits;
+
+    size_t find(size_t l, size_t h, size_t count) const;
+};
+
+#endif /* __CLUSTER_TABLE_H__ */
@@ -0,0 +1,194 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "CompatibilityIndex.h"
+#include <algorithm>
+
+using namespace std;
+
+CompatibilityIndex::CompatibilityIndex() {
+}
+
+CompatibilityIndex::CompatibilityIndex(const vector<PhyloTreeEdge> &edges) {
+    assign(edges);
+}
+
+CompatibilityIndex::CompatibilityIndex(const SplitMatrix &splits) {
+    assign(splits);
+}
+
+void CompatibilityIndex::assign(const vector<PhyloTreeEdge> &edges) {
+    nBits = edges.empty() ? 0 : edges.front().getPartition().size();
+    nSplits = edges.size();
+    stride = SplitBitset::blocksFor(nBits);
+    words.resize(nSplits * stride);
+    for (size_t i = 0; i < nSplits; ++i) {
+        auto &partition = edges[i].getPartition();
+        std::copy(partition.data(), partition.data() + stride, words.begin() + i * stride);
+    }
+    build();
+}
+
+void CompatibilityIndex::assign(const SplitMatrix &splits) {
+    nBits = splits.numSplits() == 0 ? 0 : splits.getSplit(0).size();
+    nSplits = splits.numSplits();
+    stride = splits.wordsPerSplit();
+    words.assign(splits.split(0), splits.split(0) + nSplits * stride);
+    build();
+}
+
+/*
+ * Link each split to its smallest proper superset, largest splits first: a split's parent is then the
+ * deepest split seen so far at any of its leaves, and all its leaves must agree on it.
+ */
+void CompatibilityIndex::build() {
+    const size_t npos = SplitBitset::npos;
+    size_t n = numNodes();
+    size_t root = n - 1;
+    nested = true;
+    size.assign(n, 1);
+    depth.assign(n, 0);
+    firstBit.assign(n, npos);
+    for (size_t v = 0; v < nBits; ++v) {
+        firstBit[v] = v;
+    }
+    parent.assign(n, root);
+    size[root] = nBits;
+
+    order.resize(nSplits);
+    for (size_t i = 0; i < nSplits; ++i) {
+        const block_type *row = words.data() + i * stride;
+        size_t count = 0;
+        for (size_t w = 0; w < stride; ++w) {
+            count += __builtin_popcountll(row[w]);
+        }
+        size[nBits + i] = count;
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return size[nBits + a] > size[nBits + b];
+    });
+    deepest.assign(nBits, root);
+    for (size_t i : order) {
+        size_t v = nBits + i;
+        const block_type *row = words.data() + i * stride;
+        size_t p = npos;
+        for (size_t w = 0; w < stride; ++w) {
+            for (block_type bits = row[w]; bits; bits &= bits - 1) {
+                size_t b = w * SplitBitset::bits_per_block + __builtin_ctzll(bits);
+                if (p == npos) {
+                    p = deepest[b];
+                    firstBit[v] = b;
+                } else if (deepest[b] != p) {
+                    nested = false;
+                }
+                deepest[b] = v;
+            }
+        }
+        if (p != npos) {
+            parent[v] = p;
+        }
+        depth[v] = depth[parent[v]] + 1;
+    }
+    size_t maxDepth = 0;
+    for (size_t b = 0; b < nBits; ++b) {
+        parent[b] = deepest[b];
+        depth[b] = depth[parent[b]] + 1;
+        maxDepth = std::max(maxDepth, depth[b]);
+    }
+    if (!nested) {
+        return;
+    }
+
+    levels = 1;
+    while ((size_t(1) << levels) <= maxDepth) {
+        levels++;
+    }
+    up.resize(levels * n);
+    std::copy(parent.begin(), parent.end(), up.begin());
+    for (size_t k = 1; k < levels; ++k) {
+        for (size_t v = 0; v < n; ++v) {
+            up[k * n + v] = up[(k - 1) * n + up[(k - 1) * n + v]];
+        }
+    }
+}
+
+size_t CompatibilityIndex::ancestor(size_t v, size_t levelsUp) const {
+    for (size_t k = 0; levelsUp; ++k, levelsUp >>= 1) {
+        if (levelsUp & 1) {
+            v = up[k * numNodes() + v];
+        }
+    }
+    return v;
+}
+
+size_t CompatibilityIndex::lca(size_t u, size_t v) const {
+    if (depth[u] < depth[v]) {
+        std::swap(u, v);
+    }
+    u = ancestor(u, depth[u] - depth[v]);
+    if (u == v) {
+        return u;
+    }
+    for (size_t k = levels; k > 0; --k) {
+        size_t a = up[(k - 1) * numNodes() + u], b = up[(k - 1) * numNodes() + v];
+        if (a != b) {
+            u = a;
+            v = b;
+        }
+    }
+    return up[u];
+}
+
+/*
+ * True if the split (a row of the same width as the indexed splits) crosses none of them
+ */
+bool CompatibilityIndex::isCompatibleWith(const block_type *split) const {
+    if (!nested) {
+        for (size_t i = 0; i < nSplits; ++i) {
+            if (SplitMatrix::crosses(split, words.data() + i * stride, stride)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // smallest node containing the split
+    size_t x = SplitBitset::npos;
+    size_t count = 0;
+    for (size_t w = 0; w < stride; ++w) {
+        for (block_type bits = split[w]; bits; bits &= bits - 1) {
+            size_t b = w * SplitBitset::bits_per_block + __builtin_ctzll(bits);
+            x = count++ == 0 ? b : lca(x, b);
+        }
+    }
+    if (count <= 1 || size[x] == count) {
+        return true;
+    }
+    // every child of x it meets must lie inside it; check each child once, from its first leaf
+    for (size_t w = 0; w < stride; ++w) {
+        for (block_type bits = split[w]; bits; bits &= bits - 1) {
+            size_t b = w * SplitBitset::bits_per_block + __builtin_ctzll(bits);
+            size_t y = ancestor(b, depth[b] - depth[x] - 1);
+            if (y < nBits) {
+                continue;
+            }
+            size_t first = firstBit[y];
+            if (!((split[first / SplitBitset::bits_per_block] >> (first % SplitBitset::bits_per_block)) & 1)) {
+                return false;
+            }
+            if (b == first) {
+                const block_type *row = words.data() + (y - nBits) * stride;
+                for (size_t i = 0; i < stride; ++i) {
+                    if (row[i] & ~split[i]) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool CompatibilityIndex::isCompatibleWith(const SplitBitset &split) const {
+    return isCompatibleWith(split.data());
+}
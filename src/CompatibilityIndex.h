@@ -0,0 +1,65 @@
+#ifndef __COMPATIBILITY_INDEX_H__
+#define __COMPATIBILITY_INDEX_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "PhyloTreeEdge.h"
+#include "SplitBitset.h"
+#include "SplitMatrix.h"
+#include <vector>
+
+using namespace std;
+
+/*
+ * Answers "does this split cross any split of the tree?" from the tree's cluster hierarchy.
+ *
+ * The splits of a tree are nested or disjoint, so they form a hierarchy over the leaves (one node per leaf
+ * bit, one per split, and a root). A split s crosses none of them exactly when s is a union of children of
+ * the smallest node X containing s. Children are found by climbing from each leaf of s (binary lifting), so
+ * a query costs O(|s| log n) rather than a crossing test against every split.
+ *
+ * Splits that are not nested (never the case for the edges of one tree) are still answered, by a scan.
+ */
+class CompatibilityIndex {
+public:
+    typedef SplitBitset::block_type block_type;
+
+    CompatibilityIndex();
+
+    explicit CompatibilityIndex(const vector<PhyloTreeEdge> &edges);
+
+    explicit CompatibilityIndex(const SplitMatrix &splits);
+
+    void assign(const vector<PhyloTreeEdge> &edges);
+
+    void assign(const SplitMatrix &splits);
+
+    size_t numSplits() const { return nSplits; }
+
+    bool isNested() const { return nested; }
+
+    bool isCompatibleWith(const block_type *split) const;
+
+    bool isCompatibleWith(const SplitBitset &split) const;
+
+private:
+    size_t nBits = 0;
+    size_t nSplits = 0;
+    size_t stride = 0;
+    size_t levels = 0; // number of binary lifting levels
+    bool nested = true;
+    vector<block_type> words; // split rows, as in SplitMatrix
+    vector<size_t> size, depth, firstBit; // per node: leaves 0..nBits-1, splits, then the root
+    vector<size_t> up; // up[k * numNodes + v]: ancestor 2^k levels above v (the root above itself)
+    vector<size_t> parent, order, deepest; // build scratch
+
+    void build();
+
+    size_t numNodes() const { return nBits + nSplits + 1; }
+
+    size_t ancestor(size_t v, size_t levelsUp) const;
+
+    size_t lca(size_t u, size_t v) const;
+};
+
+#endif /* __COMPATIBILITY_INDEX_H__ */
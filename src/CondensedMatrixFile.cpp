@@ -0,0 +1,224 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "CondensedMatrixFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t CondensedMatrixFile::HEADER_SIZE = 64;
+
+static const char MAGIC[8] = {'C', 'G', 'T', 'P', 'D', 'M', 'A', 'T'};
+static const uint32_t VERSION = 1;
+
+static runtime_error systemError(const string &what, const string &path) {
+    return runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+static void checkLittleEndian() {
+    const uint16_t one = 1;
+    if (*reinterpret_cast<const unsigned char *>(&one) != 1) {
+        throw runtime_error("CondensedMatrixFile needs a little-endian machine");
+    }
+}
+
+CondensedMatrixFile::CondensedMatrixFile(const string &path, size_t n, DistanceMetric metric, bool normalise,
+                                         MatrixDtype dtype, uint64_t taxonHash)
+        : path(path), fd(-1), writable(true), data(nullptr), mappedBytes(0), n(n), metric(metric),
+          normalise(normalise), dtype(dtype), taxonHash(taxonHash) {
+    checkLittleEndian();
+    fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0666);
+    if (fd < 0) {
+        throw systemError("Cannot create", path);
+    }
+    // the file starts sparse: untouched entries cost neither memory nor, on most file systems, disk
+    if (ftruncate(fd, HEADER_SIZE + numEntries() * itemSize()) != 0) {
+        close(fd);
+        throw systemError("Cannot resize", path);
+    }
+    map();
+
+    char header[HEADER_SIZE] = {};
+    uint32_t bytes = itemSize();
+    uint64_t size = n;
+    int32_t metricCode = static_cast<int32_t>(metric);
+    uint32_t normalised = normalise;
+    memcpy(header, MAGIC, sizeof(MAGIC));
+    memcpy(header + 8, &VERSION, 4);
+    memcpy(header + 12, &bytes, 4);
+    memcpy(header + 16, &size, 8);
+    memcpy(header + 24, &taxonHash, 8);
+    memcpy(header + 32, &metricCode, 4);
+    memcpy(header + 36, &normalised, 4);
+    memcpy(data, header, HEADER_SIZE);
+}
+
+CondensedMatrixFile::CondensedMatrixFile(const string &path, bool writable)
+        : path(path), fd(-1), writable(writable), data(nullptr), mappedBytes(0), n(0),
+          metric(DistanceMetric::Geodesic), normalise(false), dtype(MatrixDtype::Float64), taxonHash(0) {
+    checkLittleEndian();
+    fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        throw systemError("Cannot open", path);
+    }
+    char header[HEADER_SIZE];
+    if (pread(fd, header, HEADER_SIZE, 0) != (ssize_t) HEADER_SIZE || memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+        close(fd);
+        throw runtime_error(path + " is not a condensed matrix file");
+    }
+    uint32_t version, bytes, normalised;
+    uint64_t size;
+    int32_t metricCode;
+    memcpy(&version, header + 8, 4);
+    memcpy(&bytes, header + 12, 4);
+    memcpy(&size, header + 16, 8);
+    memcpy(&taxonHash, header + 24, 8);
+    memcpy(&metricCode, header + 32, 4);
+    memcpy(&normalised, header + 36, 4);
+    if (version != VERSION || (bytes != 4 && bytes != 8)) {
+        close(fd);
+        throw runtime_error("Unsupported condensed matrix file " + path);
+    }
+    n = size;
+    metric = static_cast<DistanceMetric>(metricCode);
+    normalise = normalised != 0;
+    dtype = bytes == 4 ? MatrixDtype::Float32 : MatrixDtype::Float64;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t) status.st_size < HEADER_SIZE + numEntries() * itemSize()) {
+        close(fd);
+        throw runtime_error("Truncated condensed matrix file " + path);
+    }
+    map();
+}
+
+CondensedMatrixFile::~CondensedMatrixFile() {
+    if (data != nullptr) {
+        munmap(data, mappedBytes);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void CondensedMatrixFile::map() {
+    mappedBytes = HEADER_SIZE + numEntries() * itemSize();
+    void *mapped = mmap(nullptr, mappedBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        fd = -1;
+        throw systemError("Cannot map", path);
+    }
+    data = static_cast<char *>(mapped);
+}
+
+size_t CondensedMatrixFile::itemSize() const {
+    return dtype == MatrixDtype::Float32 ? sizeof(float) : sizeof(double);
+}
+
+const string &CondensedMatrixFile::getPath() const {
+    return path;
+}
+
+size_t CondensedMatrixFile::size() const {
+    return n;
+}
+
+size_t CondensedMatrixFile::numEntries() const {
+    return n < 2 ? 0 : n * (n - 1) / 2;
+}
+
+DistanceMetric CondensedMatrixFile::getMetric() const {
+    return metric;
+}
+
+bool CondensedMatrixFile::isNormalised() const {
+    return normalise;
+}
+
+MatrixDtype CondensedMatrixFile::getDtype() const {
+    return dtype;
+}
+
+uint64_t CondensedMatrixFile::getTaxonHash() const {
+    return taxonHash;
+}
+
+void CondensedMatrixFile::checkPair(size_t i, size_t j) const {
+    if (i >= n || j >= n) {
+        throw out_of_range("Tree " + to_string(max(i, j)) + " of a matrix of " + to_string(n) + " trees");
+    }
+}
+
+void CondensedMatrixFile::checkEntry(size_t k) const {
+    if (k >= numEntries()) {
+        throw out_of_range("Entry " + to_string(k) + " of a matrix of " + to_string(numEntries()) + " entries");
+    }
+}
+
+double CondensedMatrixFile::get(size_t i, size_t j) const {
+    checkPair(i, j);
+    if (i == j) return 0;
+    if (i > j) swap(i, j);
+    return get(Distance::condensedIndex(n, i, j));
+}
+
+double CondensedMatrixFile::get(size_t k) const {
+    checkEntry(k);
+    const char *entry = data + HEADER_SIZE + k * itemSize();
+    if (dtype == MatrixDtype::Float32) {
+        float value;
+        memcpy(&value, entry, sizeof(value));
+        return value;
+    }
+    double value;
+    memcpy(&value, entry, sizeof(value));
+    return value;
+}
+
+void CondensedMatrixFile::set(size_t i, size_t j, double distance) {
+    checkPair(i, j);
+    // the diagonal is not stored
+    if (i == j) {
+        throw invalid_argument("Cannot set the distance of tree " + to_string(i) + " to itself");
+    }
+    if (i > j) swap(i, j);
+    set(Distance::condensedIndex(n, i, j), distance);
+}
+
+void CondensedMatrixFile::set(size_t k, double distance) {
+    checkEntry(k);
+    char *entry = data + HEADER_SIZE + k * itemSize();
+    if (dtype == MatrixDtype::Float32) {
+        float value = (float) distance;
+        memcpy(entry, &value, sizeof(value));
+    }
+    else {
+        memcpy(entry, &distance, sizeof(distance));
+    }
+}
+
+void CondensedMatrixFile::release(size_t begin, size_t end) {
+    if (begin >= end) return;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t first = (HEADER_SIZE + begin * itemSize()) / page * page;
+    size_t last = min(mappedBytes, HEADER_SIZE + end * itemSize());
+    if (writable && msync(data + first, last - first, MS_SYNC) != 0) {
+        throw systemError("Cannot write", path);
+    }
+    // the pages stay in the file and the page cache; this only unmaps them from the process
+    madvise(data + first, last - first, MADV_DONTNEED);
+}
+
+void CondensedMatrixFile::flush() {
+    if (writable && msync(data, mappedBytes, MS_SYNC) != 0) {
+        throw systemError("Cannot write", path);
+    }
+}
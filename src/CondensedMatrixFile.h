@@ -0,0 +1,100 @@
+#ifndef __CONDENSED_MATRIX_FILE_H__
+#define __CONDENSED_MATRIX_FILE_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+
+#include "Distance.h"
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+enum class MatrixDtype {
+    Float32, Float64
+};
+
+/*
+ * A condensed distance matrix kept in a memory-mapped file, for matrices larger than memory. The file is a
+ * 64 byte header followed by the n(n-1)/2 entries in the order of Distance::getDistanceMatrix, as little-endian
+ * float32 or float64 without padding, so numpy.memmap(path, dtype='<f8' or '<f4', offset=64) reads it as
+ * the condensed vector scipy expects. The header holds, at these byte offsets:
+ *
+ *      0   the magic "CGTPDMAT"         16   n, uint64
+ *      8   version, uint32               24   hash of the taxon namespace (TaxonNamespace::hash), uint64
+ *     12   bytes per entry, uint32       32   metric (DistanceMetric), int32
+ *                                        36   normalised, uint32
+ *
+ * and zeros up to the data. Entries are read and written in place; pages are only held in memory while in
+ * use, and release hands written ranges back to the kernel, so a writer's resident memory does not grow
+ * with n. Several processes may write disjoint entries of one file at once.
+ */
+class CondensedMatrixFile {
+public:
+    static const size_t HEADER_SIZE;
+
+    /* Creates the file for n trees, replacing any file at path; all entries start at 0 */
+    CondensedMatrixFile(const string &path, size_t n, DistanceMetric metric, bool normalise, MatrixDtype dtype,
+                        uint64_t taxonHash);
+
+    /* Opens an existing file */
+    explicit CondensedMatrixFile(const string &path, bool writable = false);
+
+    CondensedMatrixFile(const CondensedMatrixFile &) = delete;
+
+    CondensedMatrixFile &operator=(const CondensedMatrixFile &) = delete;
+
+    ~CondensedMatrixFile();
+
+    const string &getPath() const;
+
+    size_t size() const;
+
+    size_t numEntries() const;
+
+    DistanceMetric getMetric() const;
+
+    bool isNormalised() const;
+
+    MatrixDtype getDtype() const;
+
+    uint64_t getTaxonHash() const;
+
+    /* The distance between trees i and j, in either order; 0 for i == j. Throws out_of_range past n */
+    double get(size_t i, size_t j) const;
+
+    /* The entry at a condensed index */
+    double get(size_t k) const;
+
+    /* Throws invalid_argument for i == j, whose distance is not stored */
+    void set(size_t i, size_t j, double distance);
+
+    void set(size_t k, double distance);
+
+    /* Writes the entries in [begin, end) through to the file and drops their pages from this process */
+    void release(size_t begin, size_t end);
+
+    void flush();
+
+private:
+    string path;
+    int fd;
+    bool writable;
+    char *data;
+    size_t mappedBytes;
+    size_t n;
+    DistanceMetric metric;
+    bool normalise;
+    MatrixDtype dtype;
+    uint64_t taxonHash;
+
+    void map();
+
+    size_t itemSize() const;
+
+    void checkPair(size_t i, size_t j) const;
+
+    void checkEntry(size_t k) const;
+};
+
+#endif /* __CONDENSED_MATRIX_FILE_H__ */
@@ -1,46 +1,54 @@
 #ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #endif
+#include "ClusterTable.h"
+#include "CondensedMatrixFile.h"
 #include "Distance.h"
+#include "GeodesicCostModel.h"
+#include "PreparedTree.h"
+#include "SplitMatching.h"
+#include "WorkStealingScheduler.h"
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <sys/stat.h>
+
+/*
+ * Join the splits of two trees on the same leaves
+ */
+static void matchSplits(PhyloTree &t1, PhyloTree &t2, SplitMatching &matching) {
+    if (!t1.hasSameLeaves(t2)) {
+        throw runtime_error("leaf2NumMaps are not equal");
+    }
+    matching.match(t1.getEdgesByRef(), t2.getEdgesByRef());
+}
 
 double Distance::getRobinsonFouldsDistance(PhyloTree &t1, PhyloTree &t2, bool normalise) {
-    double rf_value = 0;
-    vector<PhyloTreeEdge> enic;
-    t1.getEdgesNotInCommonWith(t2, enic);
-    t2.getEdgesNotInCommonWith(t1, enic);
-    rf_value = enic.size();
+    SplitMatching matching;
+    matchSplits(t1, t2, matching);
+    double rf_value = matching.numOnlyIn1() + matching.numOnlyIn2();
     if (normalise)
         rf_value /= t1.numEdges() + t2.numEdges();
     return rf_value;
 }
 
 double Distance::getWeightedRobinsonFouldsDistance(PhyloTree &t1, PhyloTree &t2, bool normalise) {
-    double wrf_value = 0;
-
-    // Collect edges-in-common and edges-not-in-common...
-    vector<PhyloTreeEdge> eic;
-    PhyloTree::getCommonEdges(t1, t2, eic);
-    vector<PhyloTreeEdge> enic;
-    t1.getEdgesNotInCommonWith(t2, enic);
-    t2.getEdgesNotInCommonWith(t1, enic);
-    // ... and leaves
-    vector<double> leaves1 = t1.getLeafEdgeLengths();
-    vector<double> leaves2 = t2.getLeafEdgeLengths(); // Assuming these are the same leaves
-
-    // Collect length differences for internal edges...
-    for (PhyloTreeEdge &pte : eic) {
-        wrf_value += abs(pte.getLength());
-    }
+    double wrf_value = 0, squares = 0;
 
-    for (PhyloTreeEdge &pte : enic) {
-        wrf_value += abs(pte.getLength());
-    }
+    // length differences for internal edges...
+    SplitMatching matching;
+    matchSplits(t1, t2, matching);
+    matching.getDifferenceSums(wrf_value, squares);
 
     // ... and leaves
-    for (int i = 0; i < leaves1.size(); i++) {
+    auto &leaves1 = t1.getLeafEdgeLengthsByRef();
+    auto &leaves2 = t2.getLeafEdgeLengthsByRef(); // Assuming these are the same leaves
+    for (size_t i = 0; i < leaves1.size(); i++) {
         wrf_value += abs(leaves1[i] - leaves2[i]);
     }
 
@@ -49,29 +57,17 @@ double Distance::getWeightedRobinsonFouldsDistance(PhyloTree &t1, PhyloTree &t2,
 }
 
 double Distance::getEuclideanDistance(PhyloTree &t1, PhyloTree &t2, bool normalise) {
-    double euc_value = 0;
-
-    // Collect edges-in-common and edges-not-in-common...
-    vector<PhyloTreeEdge> eic;
-    PhyloTree::getCommonEdges(t1, t2, eic);
-    vector<PhyloTreeEdge> enic;
-    t1.getEdgesNotInCommonWith(t2, enic);
-    t2.getEdgesNotInCommonWith(t1, enic);
-    // ... and leaves
-    vector<double> leaves1 = t1.getLeafEdgeLengths();
-    vector<double> leaves2 = t2.getLeafEdgeLengths(); // Assuming these are the same
-
-    // Collect length differences for internal edges...
-    for (PhyloTreeEdge &pte : eic) {
-        euc_value += pow(pte.getLength(), 2);
-    }
+    double absolutes = 0, euc_value = 0;
 
-    for (PhyloTreeEdge &pte : enic) {
-        euc_value += pow(pte.getLength(), 2);
-    }
+    // length differences for internal edges...
+    SplitMatching matching;
+    matchSplits(t1, t2, matching);
+    matching.getDifferenceSums(absolutes, euc_value);
 
     // ... and leaves
-    for (int i = 0; i < leaves1.size(); i++) {
+    auto &leaves1 = t1.getLeafEdgeLengthsByRef();
+    auto &leaves2 = t2.getLeafEdgeLengthsByRef(); // Assuming these are the same
+    for (size_t i = 0; i < leaves1.size(); i++) {
         euc_value += pow(leaves1[i] - leaves2[i], 2);
     }
 
@@ -80,8 +76,16 @@ double Distance::getEuclideanDistance(PhyloTree &t1, PhyloTree &t2, bool normali
 }
 
 double Distance::getGeodesicDistance(PhyloTree &t1, PhyloTree &t2, bool normalise) {
+    GeodesicWorkspace workspace;
+    return getGeodesicDistance(t1, t2, normalise, workspace);
+}
+
+/*
+ * Reuses the workspace's buffers; keep one workspace per thread when computing many distances
+ */
+double Distance::getGeodesicDistance(PhyloTree &t1, PhyloTree &t2, bool normalise, GeodesicWorkspace &workspace) {
     try {
-        double distance = Geodesic::getGeodesic(t1, t2).getDist();
+        double distance = Geodesic::getGeodesic(t1, t2, workspace).getDist();
         if (normalise) return distance / (t1.getDistanceFromOrigin() + t2.getDistanceFromOrigin());
         return distance;
     } catch (std::invalid_argument e) {
@@ -108,8 +112,368 @@ double Distance::getRobinsonFouldsDistance(const string& t1, const string& t2, b
     return getRobinsonFouldsDistance(a, b, normalise);
 }
 
+double Distance::getRobinsonFouldsDistance(const Topology &t1, const Topology &t2, bool normalise) {
+    ClusterTable table(t1);
+    size_t onlyIn1, onlyIn2, splits2;
+    table.countDifferences(t2, onlyIn1, onlyIn2, splits2);
+    double rf_value = onlyIn1 + onlyIn2;
+    if (normalise)
+        rf_value /= table.numSplits() + splits2;
+    return rf_value;
+}
+
+double Distance::getClusterTableRobinsonFouldsDistance(const string &t1, const string &t2, bool normalise, bool rooted1, bool rooted2) {
+    Topology a(t1, rooted1);
+    Topology b(t2, rooted2);
+    return getRobinsonFouldsDistance(a, b, normalise);
+}
+
 double Distance::getWeightedRobinsonFouldsDistance(const string& t1, const string& t2, bool normalise, bool rooted1, bool rooted2) {
     PhyloTree a(t1, rooted1);
     PhyloTree b(t2, rooted2);
     return getWeightedRobinsonFouldsDistance(a, b, normalise);
 }
+
+double Distance::getDistance(PhyloTree &t1, PhyloTree &t2, DistanceMetric metric, bool normalise, GeodesicWorkspace &workspace) {
+    switch (metric) {
+        case DistanceMetric::RobinsonFoulds:
+            return getRobinsonFouldsDistance(t1, t2, normalise);
+        case DistanceMetric::WeightedRobinsonFoulds:
+            return getWeightedRobinsonFouldsDistance(t1, t2, normalise);
+        case DistanceMetric::Euclidean:
+            return getEuclideanDistance(t1, t2, normalise);
+        case DistanceMetric::Geodesic:
+            return getGeodesicDistance(t1, t2, normalise, workspace);
+    }
+    throw invalid_argument("Unknown distance metric");
+}
+
+/*
+ * The single-pair functions above, term for term, on what the trees have prepared
+ */
+double Distance::getDistance(PreparedTree &t1, PreparedTree &t2, bool normalise, GeodesicWorkspace &workspace,
+                             SplitMatching &matching) {
+    if (t1.getMetric() != t2.getMetric()) {
+        throw invalid_argument("The trees are prepared for different metrics");
+    }
+    if (t1.getLeafHash() != t2.getLeafHash()) {
+        throw runtime_error("leaf2NumMaps are not equal");
+    }
+    const DistanceMetric metric = t1.getMetric();
+    if (metric == DistanceMetric::Geodesic) {
+        try {
+            double distance = Geodesic::getGeodesic(t1.getTree(), t2.getTree(), workspace).getDist();
+            if (normalise) return distance / (t1.getDistanceFromOrigin() + t2.getDistanceFromOrigin());
+            return distance;
+        } catch (const std::invalid_argument &e) {
+            std::cout << "ERROR! " << e.what() << std::endl;
+            return std::numeric_limits<double>::infinity();
+        }
+    }
+
+    auto &edges1 = t1.getTree().getEdgesByRef();
+    auto &edges2 = t2.getTree().getEdgesByRef();
+    if (metric == DistanceMetric::RobinsonFoulds) {
+        matching.match(edges1, t1.getSplitTable(), edges2, t2.getSplitTable());
+        double rf_value = matching.numOnlyIn1() + matching.numOnlyIn2();
+        if (normalise)
+            rf_value /= t1.numEdges() + t2.numEdges();
+        return rf_value;
+    }
+
+    double absolutes = 0, squares = 0;
+    matching.match(edges1, t1.getSplitTable(), edges2, t2.getSplitTable(), &t1.getCompatibilityIndex(),
+                   &t2.getCompatibilityIndex());
+    matching.getDifferenceSums(absolutes, squares);
+    auto &leaves1 = t1.getTree().getLeafEdgeLengthsByRef();
+    auto &leaves2 = t2.getTree().getLeafEdgeLengthsByRef();
+    if (metric == DistanceMetric::WeightedRobinsonFoulds) {
+        for (size_t i = 0; i < leaves1.size(); i++) {
+            absolutes += abs(leaves1[i] - leaves2[i]);
+        }
+        if (normalise) return absolutes / (t1.getBranchLengthSum() + t2.getBranchLengthSum());
+        return absolutes;
+    }
+    for (size_t i = 0; i < leaves1.size(); i++) {
+        squares += pow(leaves1[i] - leaves2[i], 2);
+    }
+    if (normalise) return sqrt(squares) / (t1.getDistanceFromOrigin() + t2.getDistanceFromOrigin());
+    return sqrt(squares);
+}
+
+size_t Distance::condensedIndex(size_t n, size_t i, size_t j) {
+    return n * i - i * (i + 1) / 2 + j - i - 1;
+}
+
+/*
+ * The trees are copied and their edges sorted once, after which the distance functions only read them. Each
+ * pair is a job for a WorkStealingScheduler, with one geodesic workspace per thread. Geodesic costs are very
+ * skewed, so for that metric the pairs are first weighted by GeodesicCostModel; the other metrics cost about
+ * the same for every pair and are split into contiguous ranges.
+ */
+vector<double> Distance::getDistanceMatrix(const vector<PhyloTree> &trees, DistanceMetric metric, bool normalise,
+                                           size_t numThreads) {
+    const size_t n = trees.size();
+    vector<double> matrix(n < 2 ? 0 : n * (n - 1) / 2);
+    if (matrix.empty()) return matrix;
+
+    vector<PhyloTree> prepared(trees);
+    for (auto &tree : prepared) {
+        tree.sortEdges();
+    }
+
+    // first condensed index of each row, to find the pair of a job
+    vector<size_t> rowStart(n - 1);
+    for (size_t i = 0; i < n - 1; ++i) {
+        rowStart[i] = condensedIndex(n, i, i + 1);
+    }
+    WorkStealingScheduler scheduler(numThreads);
+    vector<GeodesicWorkspace> workspaces(scheduler.numThreads());
+    auto pairDistance = [&](size_t k, size_t thread) {
+        size_t i = upper_bound(rowStart.begin(), rowStart.end(), k) - rowStart.begin() - 1;
+        size_t j = k - rowStart[i] + i + 1;
+        matrix[k] = getDistance(prepared[i], prepared[j], metric, normalise, workspaces[thread]);
+    };
+
+    if (metric == DistanceMetric::Geodesic) {
+        GeodesicCostModel model(prepared);
+        vector<double> costs(matrix.size());
+        scheduler.run(n - 1, [&](size_t i, size_t) {
+            for (size_t j = i + 1; j < n; ++j) {
+                costs[rowStart[i] + j - i - 1] = model.estimate(i, j);
+            }
+        });
+        scheduler.run(costs, pairDistance);
+    }
+    else {
+        scheduler.run(matrix.size(), pairDistance);
+    }
+    return matrix;
+}
+
+vector<double> Distance::extendDistanceMatrix(const vector<double> &matrix, const vector<PhyloTree> &trees,
+                                              const vector<PhyloTree> &newTrees, DistanceMetric metric,
+                                              bool normalise, size_t numThreads) {
+    const size_t n = trees.size(), total = n + newTrees.size();
+    if (matrix.size() != (n < 2 ? 0 : n * (n - 1) / 2)) {
+        throw runtime_error("The matrix does not belong to " + to_string(n) + " trees");
+    }
+    vector<double> extended(total < 2 ? 0 : total * (total - 1) / 2);
+    extendRows(trees, newTrees, metric, normalise, numThreads,
+               [&](size_t rowBegin, size_t rowEnd) {
+                   for (size_t i = rowBegin; i < rowEnd && i + 1 < n; ++i) {
+                       auto row = matrix.begin() + condensedIndex(n, i, i + 1);
+                       copy(row, row + (n - 1 - i), extended.begin() + condensedIndex(total, i, i + 1));
+                   }
+               },
+               [&](size_t i, size_t j, double distance) { extended[condensedIndex(total, i, j)] = distance; },
+               [](size_t, size_t) {});
+    return extended;
+}
+
+/* Whether both paths name one existing file, however they are spelled or linked */
+static bool isSameFile(const string &path1, const string &path2) {
+    struct stat status1, status2;
+    return stat(path1.c_str(), &status1) == 0 && stat(path2.c_str(), &status2) == 0 &&
+           status1.st_dev == status2.st_dev && status1.st_ino == status2.st_ino;
+}
+
+void Distance::extendDistanceMatrix(const CondensedMatrixFile &matrix, const vector<PhyloTree> &trees,
+                                    const vector<PhyloTree> &newTrees, const string &path, size_t numThreads) {
+    const size_t n = trees.size();
+    const uint64_t taxonHash = trees.empty() ? 0 : TaxonNamespace::hash(trees[0].getLeaf2NumMap());
+    if (matrix.size() != n || (n > 0 && matrix.getTaxonHash() != taxonHash)) {
+        throw runtime_error(matrix.getPath() + " does not belong to the " + to_string(n) + " trees");
+    }
+    // the extended matrix is written next to path and renamed over it when complete, so a run that fails
+    // leaves any file at path as it was; the source, under whatever name, is never written
+    const string temporary = path + ".tmp";
+    if (isSameFile(path, matrix.getPath()) || isSameFile(temporary, matrix.getPath())) {
+        throw runtime_error("Cannot extend " + matrix.getPath() + " in place");
+    }
+    const uint64_t extendedHash = n == 0 && !newTrees.empty() ? TaxonNamespace::hash(newTrees[0].getLeaf2NumMap())
+                                                              : matrix.getTaxonHash();
+    try {
+        writeExtendedMatrix(matrix, trees, newTrees, temporary, extendedHash, numThreads);
+    } catch (...) {
+        remove(temporary.c_str());
+        throw;
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        const string error = strerror(errno);
+        remove(temporary.c_str());
+        throw runtime_error("Cannot rename " + temporary + " to " + path + ": " + error);
+    }
+}
+
+void Distance::writeExtendedMatrix(const CondensedMatrixFile &matrix, const vector<PhyloTree> &trees,
+                                   const vector<PhyloTree> &newTrees, const string &path, uint64_t taxonHash,
+                                   size_t numThreads) {
+    const size_t n = trees.size(), total = n + newTrees.size();
+    CondensedMatrixFile extended(path, total, matrix.getMetric(), matrix.isNormalised(), matrix.getDtype(),
+                                 taxonHash);
+    extendRows(trees, newTrees, matrix.getMetric(), matrix.isNormalised(), numThreads,
+               [&](size_t rowBegin, size_t rowEnd) {
+                   for (size_t i = rowBegin; i < rowEnd && i + 1 < n; ++i) {
+                       const size_t from = condensedIndex(n, i, i + 1), to = condensedIndex(total, i, i + 1);
+                       for (size_t k = 0; k < n - 1 - i; ++k) {
+                           extended.set(to + k, matrix.get(from + k));
+                       }
+                   }
+               },
+               [&](size_t i, size_t j, double distance) { extended.set(i, j, distance); },
+               [&](size_t rowBegin, size_t rowEnd) {
+                   if (rowBegin + 1 < total) {
+                       extended.release(condensedIndex(total, rowBegin, rowBegin + 1),
+                                        condensedIndex(total, min(rowEnd, total - 1) - 1, total - 1) + 1);
+                   }
+               });
+    extended.flush();
+}
+
+/*
+ * The old entries keep their place at the start of each row, so the extended matrix is built a block of rows at
+ * a time: copyRows moves the old entries of the block, the new pairs of the block (column j a new tree) are
+ * computed as in getDistanceMatrix and handed to store, and rowsDone is told the block is complete. Blocks hold
+ * about EXTENSION_BLOCK_ENTRIES entries, each block large enough to keep every thread busy.
+ */
+static const size_t EXTENSION_BLOCK_ENTRIES = 1 << 22;
+
+void Distance::extendRows(const vector<PhyloTree> &trees, const vector<PhyloTree> &newTrees, DistanceMetric metric,
+                          bool normalise, size_t numThreads,
+                          const function<void(size_t rowBegin, size_t rowEnd)> &copyRows,
+                          const function<void(size_t i, size_t j, double distance)> &store,
+                          const function<void(size_t rowBegin, size_t rowEnd)> &rowsDone) {
+    const size_t n = trees.size(), total = n + newTrees.size();
+    for (auto &tree : newTrees) {
+        if (!(trees.empty() ? newTrees[0] : trees[0]).hasSameLeaves(tree)) {
+            throw runtime_error("leaf2NumMaps are not equal");
+        }
+    }
+    vector<PhyloTree> prepared(trees);
+    prepared.insert(prepared.end(), newTrees.begin(), newTrees.end());
+    for (auto &tree : prepared) {
+        tree.sortEdges();
+    }
+    GeodesicCostModel model;
+    if (metric == DistanceMetric::Geodesic) {
+        model = GeodesicCostModel(prepared);
+    }
+    WorkStealingScheduler scheduler(numThreads);
+    vector<GeodesicWorkspace> workspaces(scheduler.numThreads());
+
+    for (size_t rowBegin = 0; rowBegin < total;) {
+        size_t rowEnd = rowBegin, entries = 0;
+        while (rowEnd < total && (rowEnd == rowBegin || entries + (total - rowEnd - 1) <= EXTENSION_BLOCK_ENTRIES)) {
+            entries += total - rowEnd - 1;
+            rowEnd++;
+        }
+        copyRows(rowBegin, rowEnd);
+
+        // row i pairs with the new trees after it, from column max(n, i + 1) on
+        vector<size_t> jobStart(1, 0);
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            jobStart.push_back(jobStart.back() + total - max(n, i + 1));
+        }
+        const size_t numJobs = jobStart.back();
+        jobStart.pop_back();
+        auto pair = [&](size_t k, size_t &i, size_t &j) {
+            size_t row = upper_bound(jobStart.begin(), jobStart.end(), k) - jobStart.begin() - 1;
+            i = rowBegin + row;
+            j = max(n, i + 1) + k - jobStart[row];
+        };
+        auto pairDistance = [&](size_t k, size_t thread) {
+            size_t i, j;
+            pair(k, i, j);
+            store(i, j, getDistance(prepared[i], prepared[j], metric, normalise, workspaces[thread]));
+        };
+        if (metric == DistanceMetric::Geodesic) {
+            vector<double> costs(numJobs);
+            scheduler.run(numJobs, [&](size_t k, size_t) {
+                size_t i, j;
+                pair(k, i, j);
+                costs[k] = model.estimate(i, j);
+            });
+            scheduler.run(costs, pairDistance);
+        }
+        else {
+            scheduler.run(numJobs, pairDistance);
+        }
+        rowsDone(rowBegin, rowEnd);
+        rowBegin = rowEnd;
+    }
+}
+
+/*
+ * Tiles of up to CROSS_TILE queries by CROSS_TILE references are the jobs: a thread takes one tree of each side
+ * into cache and runs it against the tile's trees of the other. Tiles shrink until there are a few per
+ * thread, and for geodesics they are weighted by the summed cost estimates of their pairs.
+ */
+static const size_t CROSS_TILE = 16;
+
+void Distance::getDistanceMatrix(const vector<PhyloTree> &queries, const vector<PhyloTree> &references,
+                                 DistanceMetric metric, bool normalise, double *out, size_t numThreads) {
+    const size_t numQueries = queries.size(), numReferences = references.size();
+    if (numQueries == 0 || numReferences == 0) return;
+    for (auto trees : {&queries, &references}) {
+        for (auto &tree : *trees) {
+            if (!queries[0].hasSameLeaves(tree)) {
+                throw runtime_error("leaf2NumMaps are not equal");
+            }
+        }
+    }
+
+    WorkStealingScheduler scheduler(numThreads);
+    vector<unique_ptr<PreparedTree>> prepared(numQueries + numReferences);
+    scheduler.run(prepared.size(), [&](size_t k, size_t) {
+        prepared[k].reset(new PreparedTree(k < numQueries ? queries[k] : references[k - numQueries], metric));
+    });
+
+    size_t tile = CROSS_TILE;
+    auto numTiles = [&](size_t size) { return (size + tile - 1) / tile; };
+    while (tile > 1 && numTiles(numQueries) * numTiles(numReferences) < 4 * scheduler.numThreads()) {
+        tile /= 2;
+    }
+    const size_t tileColumns = numTiles(numReferences);
+    auto tileBounds = [&](size_t k, size_t &q0, size_t &q1, size_t &r0, size_t &r1) {
+        q0 = k / tileColumns * tile;
+        q1 = min(numQueries, q0 + tile);
+        r0 = k % tileColumns * tile;
+        r1 = min(numReferences, r0 + tile);
+    };
+
+    vector<GeodesicWorkspace> workspaces(scheduler.numThreads());
+    vector<SplitMatching> matchings(scheduler.numThreads());
+    auto tileDistances = [&](size_t k, size_t thread) {
+        size_t q0, q1, r0, r1;
+        tileBounds(k, q0, q1, r0, r1);
+        for (size_t q = q0; q < q1; ++q) {
+            for (size_t r = r0; r < r1; ++r) {
+                out[q * numReferences + r] = getDistance(*prepared[q], *prepared[numQueries + r], normalise,
+                                                         workspaces[thread], matchings[thread]);
+            }
+        }
+    };
+
+    const size_t jobs = numTiles(numQueries) * tileColumns;
+    if (metric == DistanceMetric::Geodesic) {
+        GeodesicCostModel model;
+        for (auto &tree : prepared) {
+            model.add(tree->getTree());
+        }
+        vector<double> costs(jobs);
+        scheduler.run(jobs, [&](size_t k, size_t) {
+            size_t q0, q1, r0, r1;
+            tileBounds(k, q0, q1, r0, r1);
+            for (size_t q = q0; q < q1; ++q) {
+                for (size_t r = r0; r < r1; ++r) {
+                    costs[k] += model.estimate(q, numQueries + r);
+                }
+            }
+        });
+        scheduler.run(costs, tileDistances);
+    }
+    else {
+        scheduler.run(jobs, tileDistances);
+    }
+}
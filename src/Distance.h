@@ -4,10 +4,23 @@
 #define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #endif
 #include "Geodesic.h"
+#include "GeodesicWorkspace.h"
 #include "PhyloTree.h"
+#include "Topology.h"
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
+class CondensedMatrixFile;
+class PreparedTree;
+class SplitMatching;
+
+/* The metrics of Distance's single-pair functions, for the collection-level calls */
+enum class DistanceMetric {
+    RobinsonFoulds, WeightedRobinsonFoulds, Euclidean, Geodesic
+};
+
 class Distance {
 public:
 //    Distance();
@@ -20,6 +33,8 @@ public:
 
     static double getGeodesicDistance(PhyloTree &t1, PhyloTree &t2, bool normalise);
 
+    static double getGeodesicDistance(PhyloTree &t1, PhyloTree &t2, bool normalise, GeodesicWorkspace &workspace);
+
     static double getRobinsonFouldsDistance(const string& t1, const string& t2, bool normalise, bool rooted1, bool rooted2);
 
     static double getWeightedRobinsonFouldsDistance(const string& t1, const string& t2, bool normalise, bool rooted1, bool rooted2);
@@ -27,6 +42,64 @@ public:
     static double getEuclideanDistance(const string& t1, const string& t2, bool normalise, bool rooted1, bool rooted2);
 
     static double getGeodesicDistance(const string &t1, const string &t2, bool normalise, bool rooted1, bool rooted2);
+
+    /* Robinson-Foulds through Day's cluster table: linear time and memory, for trees too large for PhyloTree */
+    static double getRobinsonFouldsDistance(const Topology &t1, const Topology &t2, bool normalise);
+
+    static double getClusterTableRobinsonFouldsDistance(const string &t1, const string &t2, bool normalise, bool rooted1, bool rooted2);
+
+    static double getDistance(PhyloTree &t1, PhyloTree &t2, DistanceMetric metric, bool normalise, GeodesicWorkspace &workspace);
+
+    /* The distance between trees prepared for the same metric, with a workspace and matching per thread */
+    static double getDistance(PreparedTree &t1, PreparedTree &t2, bool normalise, GeodesicWorkspace &workspace,
+                              SplitMatching &matching);
+
+    /*
+     * All pairwise distances between the trees as a condensed upper triangle: the distance between trees i < j
+     * is at index n*i - i*(i+1)/2 + j - i - 1, as in scipy's pdist. Computed on numThreads threads (0 for one
+     * per hardware thread) over private copies of the trees, so the trees themselves are not modified.
+     */
+    static vector<double> getDistanceMatrix(const vector<PhyloTree> &trees, DistanceMetric metric, bool normalise,
+                                            size_t numThreads = 0);
+
+    /*
+     * Extends the condensed matrix of trees by newTrees, the trees appended after them: only the distances
+     * involving a new tree are computed, on numThreads threads, and the result is the matrix
+     * getDistanceMatrix would give for trees followed by newTrees.
+     */
+    static vector<double> extendDistanceMatrix(const vector<double> &matrix, const vector<PhyloTree> &trees,
+                                               const vector<PhyloTree> &newTrees, DistanceMetric metric,
+                                               bool normalise, size_t numThreads = 0);
+
+    /*
+     * As above for a matrix on disk, with its metric, normalisation and dtype; the extended matrix is written
+     * to a new file at path, a row block at a time, so memory use does not grow with the matrix. It is built in
+     * path + ".tmp" and only renamed to path once complete. Throws if path is the matrix's own file.
+     */
+    static void extendDistanceMatrix(const CondensedMatrixFile &matrix, const vector<PhyloTree> &trees,
+                                     const vector<PhyloTree> &newTrees, const string &path, size_t numThreads = 0);
+
+    /*
+     * The distances between every query and every reference tree, as scipy's cdist: the distance between
+     * queries[q] and references[r] is written to out[q * references.size() + r], a buffer of at least
+     * queries.size() * references.size() doubles. Every tree is prepared once (see PreparedTree), and the
+     * pairs are computed in tiles of a few queries by a few references on numThreads threads.
+     */
+    static void getDistanceMatrix(const vector<PhyloTree> &queries, const vector<PhyloTree> &references,
+                                  DistanceMetric metric, bool normalise, double *out, size_t numThreads = 0);
+
+    static size_t condensedIndex(size_t n, size_t i, size_t j);
+
+private:
+    static void writeExtendedMatrix(const CondensedMatrixFile &matrix, const vector<PhyloTree> &trees,
+                                    const vector<PhyloTree> &newTrees, const string &path, uint64_t taxonHash,
+                                    size_t numThreads);
+
+    static void extendRows(const vector<PhyloTree> &trees, const vector<PhyloTree> &newTrees, DistanceMetric metric,
+                           bool normalise, size_t numThreads,
+                           const function<void(size_t rowBegin, size_t rowEnd)> &copyRows,
+                           const function<void(size_t i, size_t j, double distance)> &store,
+                           const function<void(size_t rowBegin, size_t rowEnd)> &rowsDone);
 };
 
 #endif /* __DISTANCE_H__ */
@@ -3,16 +3,14 @@
 #endif
 #include "BipartiteGraph.h"
 #include "Geodesic.h"
+#include "GeodesicCostModel.h"
+#include "GeodesicWorkspace.h"
+#include "WorkStealingScheduler.h"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 
-void deleteEmptyEdges(vector<PhyloTreeEdge> &v) {
-    v.erase(std::remove_if(v.begin(), v.end(), [](PhyloTreeEdge &element) {
-        return element.isEmpty();
-    }), v.end());
-}
-
 Geodesic::Geodesic(RatioSequence rs) {
     this->rs = rs;
 }
@@ -182,7 +180,7 @@ double Geodesic::getDist() {
     for (size_t i = 0; i < commonEdges.size(); ++i) {
         commonEdgeDistSquared += pow(commonEdges[i].getLength(), 2);
     }
-    return sqrt(pow(rs.getNonDesRSWithMinDist().getDistance(), 2) + commonEdgeDistSquared + leafContributionSquared);
+    return sqrt(pow(rs.getMinNonDesRSDistance(), 2) + commonEdgeDistSquared + leafContributionSquared);
 }
 
 //void Geodesic::addCommonEdge(PhyloTreeEdge e) {
@@ -269,10 +267,21 @@ void Geodesic::setLeafContributionSquared(double leafContributionSquared) {
 }
 
 Geodesic Geodesic::getGeodesic(PhyloTree &t1, PhyloTree &t2) {
+    GeodesicWorkspace workspace;
+    return getGeodesic(t1, t2, workspace);
+}
+
+/*
+ * The returned Geodesic lives in the workspace and is overwritten by the next call with the same workspace
+ */
+Geodesic &Geodesic::getGeodesic(PhyloTree &t1, PhyloTree &t2, GeodesicWorkspace &workspace) {
     double leafContributionSquared = 0;
     vector<double>& t1_leaf_lengths = t1.leafEdgeLengths;
     vector<double>& t2_leaf_lengths = t2.leafEdgeLengths;
-    Geodesic geo = Geodesic(RatioSequence());
+    workspace.reset();
+    Geodesic &geo = workspace.geodesic;
+    geo.rs.clear();
+    geo.commonEdges.clear();
 
     // get the leaf contributions
     auto& ref_leaf_num_map = t1.leaf2NumMap;
@@ -280,254 +289,511 @@ Geodesic Geodesic::getGeodesic(PhyloTree &t1, PhyloTree &t2) {
     if (ref_leaf_num_map.size() != chk_leaf_num_map.size()) {
         throw invalid_argument("Error getting geodesic: trees do not have the same number of leaves");
     }
+    // trees parsed against one TaxonNamespace are checked by ID rather than label by label
+    if (!t1.hasSameLeaves(t2)) {
+        throw invalid_argument("Error getting geodesic: trees do not have the same sets of leaves");
+    }
     for (size_t i = 0; i < ref_leaf_num_map.size(); i++) {
-        if (ref_leaf_num_map[i] != chk_leaf_num_map[i]) {
-            throw invalid_argument("Error getting geodesic: trees do not have the same sets of leaves");
-        }
         leafContributionSquared += pow(t1_leaf_lengths[i] - t2_leaf_lengths[i], 2);
     }
     geo.setLeafContributionSquared(leafContributionSquared);
 
-    vector<PhyloTree> aTreesNoCommonEdges;
-    vector<PhyloTree> bTreesNoCommonEdges;
-
-    // get the pairs of trees with no common edges put into aTreesNoCommonEdges and bTreesNoCommonEdges
-    //  aTreesNoCommonEdges[i] goes with bTreesNoCommonEdges[i]
+    // get the pairs of trees with no common edges put into the workspace's subproblems
     auto& t1_edges = t1.edges;
     auto& t2_edges = t2.edges;
-    auto& l2nm = t1.leaf2NumMap;
-    splitOnCommonEdge(t1_edges, t2_edges, l2nm, aTreesNoCommonEdges, bTreesNoCommonEdges);
-//    splitOnCommonEdge(t1, t2, aTreesNoCommonEdges, bTreesNoCommonEdges);
+    splitOnCommonEdge(t1_edges, t2_edges, t1.numLeaves(), workspace);
     //set the common edges
-    vector<PhyloTreeEdge> eic;
-    PhyloTree::getCommonEdges(t1_edges, t2_edges, eic);
-    geo.setCommonEdges(eic);
+    PhyloTree::getCommonEdges(t1_edges, t2_edges, workspace.index1, workspace.index2, geo.commonEdges);
 
     // find the geodesic between each pair of subtrees found by removing the common edges
-    for (size_t i = 0; i < aTreesNoCommonEdges.size(); i++) {
-        Geodesic newGeo = getGeodesicNoCommonEdges(aTreesNoCommonEdges[i], bTreesNoCommonEdges[i]);
-        geo.setRS(RatioSequence::interleave(geo.getRS(), newGeo.getRS()));
-    }
+    solveSubproblems(workspace);
+    interleaveSubproblems(workspace, geo.rs);
     return geo;
 }
 
+/*
+ * Solve each subproblem into its own ratio sequence. With several threads in the workspace, and at least two
+ * subproblems worth more than PARALLEL_SUBPROBLEM_COST (GeodesicCostModel units, roughly a tenth of a
+ * millisecond) to spread, the subproblems are shared out by estimated cost, each thread solving in its own
+ * scratch workspace. The sequences are merged in subproblem order afterwards either way, so the result does
+ * not depend on the threads.
+ */
+void Geodesic::solveSubproblems(GeodesicWorkspace &workspace) {
+    size_t numSubproblems = workspace.numSubproblems();
+    auto solve = [&workspace](size_t i, GeodesicWorkspace &scratch) {
+        auto &subproblem = workspace.getSubproblem(i);
+        subproblem.rs.clear();
+        getGeodesicNoCommonEdges(subproblem.aEdges, subproblem.bEdges, subproblem.numLeaves, scratch,
+                                 subproblem.rs);
+    };
+
+    size_t worthSharing = 0;
+    vector<double> costs;
+    if (workspace.numThreads > 1 && numSubproblems > 1) {
+        costs.resize(numSubproblems);
+        for (size_t i = 0; i < numSubproblems; i++) {
+            auto &subproblem = workspace.getSubproblem(i);
+            costs[i] = GeodesicCostModel::estimate(subproblem.numLeaves, subproblem.aEdges.size(),
+                                                   subproblem.bEdges.size());
+            if (costs[i] > PARALLEL_SUBPROBLEM_COST) worthSharing++;
+        }
+    }
+    if (worthSharing < 2) {
+        for (size_t i = 0; i < numSubproblems; i++) {
+            solve(i, workspace);
+        }
+        return;
+    }
+
+    for (auto &helper : workspace.helpers) {
+        helper->reset();
+        workspace.inheritSettings(*helper);
+    }
+    // threads running subproblems are not spare for ratio forks
+    WorkStealingScheduler scheduler(min(workspace.numThreads, numSubproblems));
+    *workspace.spareThreads -= scheduler.numThreads() - 1;
+    try {
+        scheduler.run(costs, [&](size_t i, size_t thread) {
+            solve(i, thread == 0 ? workspace : *workspace.helpers[thread - 1]);
+        });
+    } catch (...) {
+        // forks still running would give their threads back after the count is restored
+        for (auto &helper : workspace.helpers) {
+            helper->ratioForks.clear();
+        }
+        workspace.ratioForks.clear();
+        *workspace.spareThreads = workspace.numThreads - 1;
+        throw;
+    }
+    *workspace.spareThreads = workspace.numThreads - 1;
+}
+
+/*
+ * Interleave the non-descending forms of all the subproblems' ratio sequences into rs, in one k-way merge
+ * over a heap of the next block of each. Equal ratios are taken in subproblem order, which gives the same
+ * sequence as folding them in one at a time with RatioSequence::interleave.
+ */
+void Geodesic::interleaveSubproblems(GeodesicWorkspace &workspace, RatioSequence &rs) {
+    auto &heap = workspace.mergeHeap;
+    auto &next = workspace.mergeNext;
+    // min-heap on ratio, then subproblem
+    auto later = [](const pair<double, size_t> &a, const pair<double, size_t> &b) {
+        return a.first > b.first || (a.first == b.first && a.second > b.second);
+    };
+    size_t numSubproblems = workspace.numSubproblems();
+    size_t total = 0;
+    heap.clear();
+    next.assign(numSubproblems, 0);
+    for (size_t i = 0; i < numSubproblems; i++) {
+        auto &subproblem = workspace.getSubproblem(i);
+        subproblem.rs.getNonDesBlocks(subproblem.blocks);
+        total += subproblem.blocks.size();
+        if (!subproblem.blocks.empty()) {
+            heap.emplace_back(subproblem.blocks[0].getRatio(), i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    rs.clear();
+    rs.reserve(total);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t i = heap.back().second;
+        heap.pop_back();
+        auto &subproblem = workspace.getSubproblem(i);
+        rs.push_back_value(subproblem.rs.getCombinedRatio(subproblem.blocks[next[i]]));
+        if (++next[i] < subproblem.blocks.size()) {
+            heap.emplace_back(subproblem.blocks[next[i]].getRatio(), i);
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+}
+
 Geodesic Geodesic::getGeodesicNoCommonEdges(PhyloTree &t1, PhyloTree &t2) {
-    auto& t1_edges = t1.edges;
-    auto& t2_edges = t2.edges;
+    GeodesicWorkspace workspace;
+    return getGeodesicNoCommonEdges(t1, t2, workspace);
+}
+
+Geodesic Geodesic::getGeodesicNoCommonEdges(PhyloTree &t1, PhyloTree &t2, GeodesicWorkspace &workspace) {
+    RatioSequence rs;
+    getGeodesicNoCommonEdges(t1.edges, t2.edges, t1.numLeaves(), workspace, rs);
+    return Geodesic(rs);
+}
+
+static string edgesToString(vector<PhyloTreeEdge> &edges) {
+    ostringstream ss;
+    for (auto &edge : edges) {
+        ss << edge.toString() << " ";
+    }
+    return ss.str();
+}
+
+/*
+ * Append the ratio sequence of the geodesic between two sets of edges with no common edges to rs.
+ * Both edge vectors are sorted in place.
+ */
+void Geodesic::getGeodesicNoCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
+        size_t numLeaves, GeodesicWorkspace &workspace, RatioSequence &rs) {
     size_t numEdges1 = t1_edges.size(); // number of edges in tree 1
     size_t numEdges2 = t2_edges.size(); // number of edges in tree 2
 
     if (numEdges1 == 0 && numEdges2 == 0)
-        return Geodesic(RatioSequence());
+        return;
 
     // double-check that both trees have splits.  Otherwise didn't remove a common edge.
     if (numEdges1 == 0 || numEdges2 == 0) {
-        throw ("Error: tried to compute geodesic between subtrees that should not have common/compatible edges, but do!  t1 = " + t1.getNewick(true) + " and t2 = " + t2.getNewick(true));
+        throw ("Error: tried to compute geodesic between subtrees that should not have common/compatible edges, but do!  t1 = " + edgesToString(t1_edges) + " and t2 = " + edgesToString(t2_edges));
     }
 
-    std::sort(t1_edges.begin(), t1_edges.end());
-    std::sort(t2_edges.begin(), t2_edges.end());
+    if (!std::is_sorted(t1_edges.begin(), t1_edges.end())) std::sort(t1_edges.begin(), t1_edges.end());
+    if (!std::is_sorted(t2_edges.begin(), t2_edges.end())) std::sort(t2_edges.begin(), t2_edges.end());
 
-    // double-check no common edges
-//    vector<PhyloTreeEdge> commonEdges;
-//    PhyloTree::getCommonEdges(t1_edges, t2_edges, commonEdges);
-//    if (commonEdges.size() != 0) {
-//        throw invalid_argument("Error: tried to compute geodesic between subtrees that should not have common edges, but do!  t1 = " + t1.getNewick(true) + " and t2 = " + t2.getNewick(true));
-//    }
-
-    auto rs = RatioSequence();
     // if we can't split the ratio because it has too few edges in either the numerator or denominator
     if ((numEdges1 == 1) || (numEdges2 == 1)) {
         rs.push_back_value(Ratio(t1_edges, t2_edges));
-        return Geodesic(rs);
+        return;
     }
 
-    vector<size_t> aVertices, bVertices;
-    deque<Ratio> queue;
-    Ratio ratio;
+    auto &aVertices = workspace.aVertices;
+    auto &bVertices = workspace.bVertices;
+    auto &cover = workspace.cover;
+    Ratio &ratio = workspace.currentRatio;
 
     // initialize BipartiteGraph
-    auto incidenceMatrix = BipartiteGraph::getIncidenceMatrix(t1_edges, t2_edges);
-    BipartiteGraph bg(incidenceMatrix, t1.getIntEdgeAttribNorms(), t2.getIntEdgeAttribNorms());
-    queue.emplace_back(t1_edges, t2_edges);
-    aVertices.reserve(numEdges1);
-    bVertices.reserve(numEdges2);
-
-    while (queue.size() > 0) {
-        ratio = queue.front();
-        queue.pop_front();
-        aVertices.clear();
-        bVertices.clear();
-
-        // convert the ratio to what we pass to vertex cover
-        auto ratio_e_edges = ratio.getEEdges();
-        auto ratio_f_edges = ratio.getFEdges();
-        for (int i = 0; i < ratio_e_edges.size(); i++) {
-            auto index_iter = std::lower_bound(t1_edges.begin(), t1_edges.end(), ratio_e_edges[i]);
-            aVertices.push_back(std::distance(t1_edges.begin(), index_iter));
-        }
-
-        for (int i = 0; i < ratio.getFEdges().size(); i++) {
-            auto index_iter = std::lower_bound(t2_edges.begin(), t2_edges.end(), ratio_f_edges[i]);
-            bVertices.push_back(std::distance(t2_edges.begin(), index_iter));
-        }
-
-        // get the cover
-        auto cover = bg.vertex_cover(aVertices, bVertices);
-        // check if cover is trivial
-        if ((cover[0][0] == 0) || (cover[0][0] == aVertices.size())) {
-            // add ratio to geodesic
-            rs.push_back(ratio);
-
-
-        } else {  // cover not trivial
-            // make two new ratios
-            auto r1 = Ratio();
-            auto r2 = Ratio();
-
-            int j = 0;  // for index in cover array
-
-            // split the ratio based on the cover
-            for (size_t i = 0; i < aVertices.size(); i++) {
-                if ((j < cover[2].size()) && (aVertices[i] == cover[2][j])) {
-                    r1.addEEdge(t1_edges[aVertices[i]]);
-                    j++;
-                } else { // the split is not in the cover, and hence dropped first
-                    r2.addEEdge(t1_edges[aVertices[i]]);
+    workspace.splits1.assign(t1_edges, numLeaves);
+    workspace.splits2.assign(t2_edges, numLeaves);
+    BipartiteGraph bg(workspace.splits1, workspace.splits2, workspace.arena);
+    bg.setMaxFlowAlgorithm(workspace.maxFlowAlgorithm);
+    size_t stackBase = workspace.ratioStackSize;
+    Ratio &initial = workspace.pushRatio();
+    for (size_t i = 0; i < numEdges1; i++)
+        initial.addEEdge((int) i, workspace.splits1.length(i));
+    for (size_t i = 0; i < numEdges2; i++)
+        initial.addFEdge((int) i, workspace.splits2.length(i));
+
+    bool warmStart = false; // every ratio after the first is half of a split one, and may start from its flow
+    auto &forks = workspace.ratioForks;
+    size_t forkBase = forks.size();
+    try {
+        while (true) {
+            // a forked half goes in once the half before it is done
+            while (forks.size() > forkBase && forks.back()->depth == workspace.ratioStackSize) {
+                GeodesicWorkspace::RatioFork &fork = *forks.back();
+                fork.worker.join();
+                if (fork.error) rethrow_exception(fork.error);
+                for (auto &r : fork.rs) {
+                    rs.push_back(r);
                 }
+                forks.pop_back();
             }
+            if (workspace.ratioStackSize == stackBase) break;
+            ratio = workspace.ratioStack[--workspace.ratioStackSize];
+            // ratios on the stack hold indices into the sorted edges, which are the graph's vertices
+            aVertices.assign(ratio.getEEdges().begin(), ratio.getEEdges().end());
+            bVertices.assign(ratio.getFEdges().begin(), ratio.getFEdges().end());
+
+            // get the cover
+            bg.vertex_cover(aVertices, bVertices, cover, warmStart);
+            warmStart = workspace.warmStart;
+            // check if cover is trivial
+            if ((cover.aSize == 0) || (cover.aSize == aVertices.size())) {
+                // add ratio to geodesic, referring to its edges by originalID
+                Ratio &result = workspace.resultRatio;
+                result.clear();
+                for (size_t i : aVertices)
+                    result.addEEdge(t1_edges[i]);
+                for (size_t i : bVertices)
+                    result.addFEdge(t2_edges[i]);
+                rs.push_back(result);
+
+
+            } else {  // cover not trivial
+                // make two new ratios, r1 on top of r2 so that r1 is processed first
+                auto &r2 = workspace.pushRatio();
+                auto &r1 = workspace.pushRatio();
+
+                const size_t *c = cover.aBegin();  // next cover vertex; both lists are in the same order
+
+                // split the ratio based on the cover
+                for (size_t i = 0; i < aVertices.size(); i++) {
+                    if ((c != cover.aEnd()) && (aVertices[i] == *c)) {
+                        r1.addEEdge((int) aVertices[i], workspace.splits1.length(aVertices[i]));
+                        c++;
+                    } else { // the split is not in the cover, and hence dropped first
+                        r2.addEEdge((int) aVertices[i], workspace.splits1.length(aVertices[i]));
+                    }
+                }
 
-            j = 0;   // reset index
-            // split the ratio based on the cover
-            for (size_t i = 0; i < bVertices.size(); i++) {
-                if ((j < cover[3].size()) && (bVertices[i] == cover[3][j])) {
-                    r2.addFEdge(t2_edges[bVertices[i]]);
-                    j++;
-                } else { // the split is not in the cover, and hence dropped first
-                    r1.addFEdge(t2_edges[bVertices[i]]);
+                c = cover.bBegin();
+                // split the ratio based on the cover
+                for (size_t i = 0; i < bVertices.size(); i++) {
+                    if ((c != cover.bEnd()) && (bVertices[i] == *c)) {
+                        r2.addFEdge((int) bVertices[i], workspace.splits2.length(bVertices[i]));
+                        c++;
+                    } else { // the split is not in the cover, and hence dropped first
+                        r1.addFEdge((int) bVertices[i], workspace.splits2.length(bVertices[i]));
+                    }
                 }
+                forkRatio(t1_edges, t2_edges, numLeaves, workspace);
             }
-
-            // add ratios to the queue
-            queue.push_front(r2);
-            queue.push_front(r1);
         }
+    } catch (...) {
+        // join the forks of this call before passing the error on, so none outlives it
+        forks.resize(forkBase);
+        throw;
     }
-    return Geodesic(rs);
 }
 
+/*
+ * If fork-join refinement is on (GeodesicWorkspace::setRatioForkThreshold), both halves of the ratio just split
+ * are large enough and a thread is spare, refine the second half r2 on that thread. r2 leaves the ratio stack
+ * and r1 takes its slot; the fork's ratios are appended when the stack is back down to that slot. Refining r2's
+ * edges on their own gives the same covers as refining them in the whole subproblem's graph, since the
+ * vertices keep their order and a cover only looks at the edges between the ratio's splits.
+ */
+void Geodesic::forkRatio(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges, size_t numLeaves,
+        GeodesicWorkspace &workspace) {
+    size_t threshold = workspace.ratioForkThreshold;
+    if (threshold == 0) return;
+    Ratio &r2 = workspace.ratioStack[workspace.ratioStackSize - 2];
+    Ratio &r1 = workspace.ratioStack[workspace.ratioStackSize - 1];
+    size_t size1 = r1.getEEdges().size() + r1.getFEdges().size();
+    if (size1 < threshold || r2.getEEdges().size() + r2.getFEdges().size() < threshold) return;
+    if (r2.getEEdges().size() < 2 || r2.getFEdges().size() < 2) return;
+    if (!workspace.takeSpareThread()) return;
+
+    unique_ptr<GeodesicWorkspace::RatioFork> fork(new GeodesicWorkspace::RatioFork());
+    for (int i : r2.getEEdges()) {
+        fork->aEdges.push_back(t1_edges[i]);
+    }
+    for (int i : r2.getFEdges()) {
+        fork->bEdges.push_back(t2_edges[i]);
+    }
+    r2 = r1;
+    workspace.ratioStackSize--;
+    fork->depth = workspace.ratioStackSize - 1;
+    fork->scratch.reset(new GeodesicWorkspace());
+    workspace.inheritSettings(*fork->scratch);
+
+    GeodesicWorkspace::RatioFork *f = fork.get();
+    shared_ptr<atomic<size_t>> spare = workspace.spareThreads;
+    f->worker = thread([f, numLeaves, spare]() {
+        try {
+            getGeodesicNoCommonEdges(f->aEdges, f->bEdges, numLeaves, *f->scratch, f->rs);
+        } catch (...) {
+            f->error = current_exception();
+        }
+        ++*spare;
+    });
+    workspace.ratioForks.push_back(std::move(fork));
+}
+
+/*
+ * Split the two edge sets on their compatible edges (common to both trees, or crossing no edge of the other
+ * tree), adding each pair of subtrees with no common edges to the workspace's subproblems. Leaves the
+ * workspace's compatibility indexes built for the two edge sets.
+ *
+ * The subproblems, their order and their leaf numbering are those of recursively splitting on the first
+ * compatible edge in sorted order, but they are found in one pass over the sorted edges:
+ *  - an edge only crosses edges that stay on its side of a split, so compatibility is decided once, on the
+ *    whole trees;
+ *  - an edge sorts after every edge it properly contains, so the recursion splits on the compatible edges in
+ *    ascending order, and splitting on C hands off exactly the edges whose smallest compatible superset is C;
+ *  - as in the merge of PhyloTree::getFirstCommonEdge, C is only found while it sorts no later than the last
+ *    remaining edge of both trees. Once it does not, the remaining edges make the last subproblem.
+ * Leaves of C other than its first are folded into that leaf for the splits that follow.
+ */
 void Geodesic::splitOnCommonEdge(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
-        vector<string> &reference_leaf_num_map, vector<PhyloTree> &destination_a, vector<PhyloTree> &destination_b) {
+        size_t numLeaves, GeodesicWorkspace &workspace) {
+    const size_t npos = SplitBitset::npos;
     size_t numEdges1 = t1_edges.size(); // number of edges in tree 1
     size_t numEdges2 = t2_edges.size(); /// number of edges in tree 2
+    workspace.index1.assign(t1_edges);
+    workspace.index2.assign(t2_edges);
     if (numEdges1 == 0 || numEdges2 == 0) {
         return;
     }
-    string leaf_label;
-    // look for common edges
-    PhyloTreeEdge commonEdge;
-    try {
-        commonEdge = PhyloTree::getFirstCommonEdge(t1_edges, t2_edges);
+    // edges sorted beforehand (PhyloTree::sortEdges) are left untouched
+    if (!std::is_sorted(t1_edges.begin(), t1_edges.end())) std::sort(t1_edges.begin(), t1_edges.end());
+    if (!std::is_sorted(t2_edges.begin(), t2_edges.end())) std::sort(t2_edges.begin(), t2_edges.end());
+
+    // merge the edges of both trees, marking the compatible ones
+    auto &items = workspace.splitItems;
+    items.clear();
+    for (size_t i = 0, j = 0; i < numEdges1 || j < numEdges2;) {
+        if (j == numEdges2 || (i < numEdges1 && t1_edges[i] < t2_edges[j])) {
+            bool compatible = workspace.index2.isCompatibleWith(t1_edges[i].getPartition());
+            items.push_back({&t1_edges[i], nullptr, compatible, true, npos});
+            i++;
+        } else if (i == numEdges1 || t2_edges[j] < t1_edges[i]) {
+            bool compatible = workspace.index1.isCompatibleWith(t2_edges[j].getPartition());
+            items.push_back({nullptr, &t2_edges[j], compatible, true, npos});
+            j++;
+        } else {
+            items.push_back({&t1_edges[i], &t2_edges[j], true, true, npos});
+            i++;
+            j++;
+        }
     }
-    catch (edge_not_found_exception &err) {
-        destination_a.reserve(destination_a.size() + numEdges1);
-        destination_b.reserve(destination_b.size() + numEdges2);
-        destination_a.emplace_back(t1_edges, reference_leaf_num_map);
-        destination_b.emplace_back(t2_edges, reference_leaf_num_map);
-        return;
+    auto splitOf = [&items](size_t i) -> const SplitBitset & {
+        return (items[i].edge1 ? items[i].edge1 : items[i].edge2)->getPartition();
+    };
+    size_t numBits = splitOf(0).size();
+
+    // the compatible edges are nested or disjoint: find each one's smallest proper superset, largest first
+    auto &clusters = workspace.clusterOrder;
+    auto &parent = workspace.clusterParent;
+    auto &deepest = workspace.deepestCluster;
+    clusters.clear();
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i].compatible) {
+            clusters.push_back(i);
+        }
     }
-
-    // A will be the tree with leaves corresponding to 1's in commonEdge
-    vector<string> leaf2NumMapA;
-    vector<string> leaf2NumMapB;
-
-    vector<PhyloTreeEdge> edgesA1;
-    vector<PhyloTreeEdge> edgesA2;
-    vector<PhyloTreeEdge> edgesB1;
-    vector<PhyloTreeEdge> edgesB2;
-
-    edgesA1.reserve(numEdges1);
-    edgesA2.reserve(numEdges2);
-    edgesB1.reserve(numEdges1);
-    edgesB2.reserve(numEdges2);
-
-    for (PhyloTreeEdge e : t1_edges) { // have to copy e <= DO NOT MAKE e A REFERENCE
-        e.clear();
-        edgesA1.push_back(e);
-        edgesB1.push_back(e);
+    std::sort(clusters.begin(), clusters.end(), [&splitOf](size_t a, size_t b) {
+        return splitOf(a).count() > splitOf(b).count();
+    });
+    parent.assign(items.size(), npos);
+    deepest.assign(numBits, npos);
+    for (size_t c : clusters) {
+        const SplitBitset &split = splitOf(c);
+        size_t bit = split.find_first();
+        if (bit == npos) {
+            continue;
+        }
+        parent[c] = deepest[bit];
+        for (; bit != npos; bit = split.find_next(bit)) {
+            deepest[bit] = c;
+        }
     }
 
-    for (PhyloTreeEdge e : t2_edges) { // as above
-        e.clear();
-        edgesA2.push_back(e);
-        edgesB2.push_back(e);
+    // hand each incompatible edge to its smallest compatible superset
+    auto &start = workspace.ownedStart;
+    auto &owned = workspace.owned;
+    start.assign(items.size() + 1, 0);
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i].compatible) {
+            continue;
+        }
+        const SplitBitset &split = splitOf(i);
+        size_t bit = split.find_first();
+        size_t c = bit == npos ? npos : deepest[bit];
+        while (c != npos && !split.is_subset_of(splitOf(c))) {
+            c = parent[c];
+        }
+        items[i].owner = c;
+        if (c != npos) {
+            start[c + 1]++;
+        }
     }
-
-    bool aLeavesAdded = false;  // if we have added a leaf in B representing the A tree
-    size_t indexAleaves = 0;  // the index we are at in  the vectors holding the leaves in the A and B subtrees
-    size_t indexBleaves = 0;
-
-    // step through the leaves represented in commonEdge
-    // (there should be two more leaves than edges)
-    for (size_t i = 0; i < reference_leaf_num_map.size(); i++) {
-        leaf_label = reference_leaf_num_map[i];
-        if (commonEdge.contains(i)) {
-            // commonEdge contains leaf i
-            leaf2NumMapA.push_back(leaf_label);
-
-            // these leaves must be added as a group to the B trees
-            if (!aLeavesAdded) {
-                leaf2NumMapB.push_back(leaf_label + "*");    // add a one of the leaves of the A tree to represent all the A trees leaves
-                for (size_t j = 0; j < numEdges1; j++) {
-                    if (t1_edges[j].properlyContains(commonEdge)) {
-                        edgesB1[j].addOne(indexBleaves);
-                    }
-                }
-                for (size_t j = 0; j < numEdges2; j++) {
-                    if (t2_edges[j].properlyContains(commonEdge)) {
-                        edgesB2[j].addOne(indexBleaves);
-                    }
-                }
-                indexBleaves++;
-                aLeavesAdded = true;
-            }
-            // add the column corresponding to this leaf to the A edges vector (for the corresponding trees)
-            // XXX: problem: might be adding edges which contain leaves in A but also
-            for (size_t j = 0; j < numEdges1; j++) {
-                if (commonEdge.properlyContains(t1_edges[j]) && t1_edges[j].contains(i)) {
-                    edgesA1[j].addOne(indexAleaves);
+    for (size_t i = 0; i < items.size(); i++) {
+        start[i + 1] += start[i];
+    }
+    owned.resize(start[items.size()]);
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!items[i].compatible && items[i].owner != npos) {
+            owned[start[items[i].owner]++] = i;
+        }
+    }
+    for (size_t i = items.size(); i > 0; i--) {
+        start[i] = start[i - 1];
+    }
+    start[0] = 0;
+
+    // a subproblem over the given edges, numbered by the leaves in units (as bit positions)
+    auto &units = workspace.units;
+    auto addSubproblem = [&](const size_t *list, size_t n) {
+        bool has1 = false, has2 = false;
+        for (size_t k = 0; k < n; k++) {
+            has1 |= items[list[k]].edge1 != nullptr;
+            has2 |= items[list[k]].edge2 != nullptr;
+        }
+        if (!has1 || !has2) {
+            return;
+        }
+        auto &subproblem = workspace.addSubproblem();
+        subproblem.aEdges.clear();
+        subproblem.bEdges.clear();
+        subproblem.numLeaves = units.size();
+        auto project = [&units](vector<PhyloTreeEdge> &dest, const PhyloTreeEdge &e) {
+            dest.push_back(e);
+            dest.back().clear();
+            for (size_t u = 0; u < units.size(); u++) {
+                if (e.getPartition().test(units[u])) {
+                    dest.back().addOne(u);
                 }
             }
-            for (size_t j = 0; j < numEdges2; j++) {
-                if (commonEdge.properlyContains(t2_edges[j]) && t2_edges[j].contains(i)) {
-                    edgesA2[j].addOne(indexAleaves);
-                }
+        };
+        for (size_t k = 0; k < n; k++) {
+            if (items[list[k]].edge1) {
+                project(subproblem.aEdges, *items[list[k]].edge1);
             }
-            indexAleaves++;
-        } else {
-            // commonEdge does not contain leaf i
-            leaf2NumMapB.push_back(leaf_label);
-            for (int j = 0; j < numEdges1; j++) {
-                if (t1_edges[j].contains(i)) {
-                    edgesB1[j].addOne(indexBleaves);
-                }
+            if (items[list[k]].edge2) {
+                project(subproblem.bEdges, *items[list[k]].edge2);
             }
-            for (int j = 0; j < numEdges2; j++) {
-                if (t2_edges[j].contains(i)) {
-                    edgesB2[j].addOne(indexBleaves);
-                }
+        }
+    };
+
+    size_t count1 = numEdges1, count2 = numEdges2;
+    size_t last1 = items.size() - 1, last2 = items.size() - 1; // last remaining edge of each tree
+    auto remove = [&](size_t i) {
+        items[i].alive = false;
+        count1 -= items[i].edge1 != nullptr;
+        count2 -= items[i].edge2 != nullptr;
+    };
+    auto &hidden = workspace.hiddenLeaves;
+    hidden = SplitBitset(numBits);
+
+    for (size_t c = 0; c < items.size(); c++) {
+        if (!items[c].compatible) {
+            continue;
+        }
+        while (!(items[last1].alive && items[last1].edge1)) last1--;
+        while (!(items[last2].alive && items[last2].edge2)) last2--;
+        if (c > std::min(last1, last2)) {
+            break;
+        }
+        // the subtree below c, with its leaves in order
+        const SplitBitset &split = splitOf(c);
+        units.clear();
+        for (size_t bit = split.find_first(); bit != npos; bit = split.find_next(bit)) {
+            if (!hidden.test(bit)) {
+                units.push_back(bit);
             }
-            indexBleaves++;
+        }
+        std::reverse(units.begin(), units.end());
+        addSubproblem(owned.data() + start[c], start[c + 1] - start[c]);
+        for (size_t k = start[c]; k < start[c + 1]; k++) {
+            remove(owned[k]);
+        }
+        hidden |= split;
+        if (!units.empty()) {
+            hidden.reset(units[0]);
+        }
+        // what is left of c is a single leaf, removed on the next split
+        if (count1 == 0 || count2 == 0) {
+            return;
+        }
+        remove(c);
+        if (count1 == 0 || count2 == 0) {
+            return;
         }
     }
 
-    deleteEmptyEdges(edgesA1);
-    deleteEmptyEdges(edgesA2);
-    splitOnCommonEdge(edgesA1, edgesA2, leaf2NumMapA, destination_a, destination_b);
-
-    deleteEmptyEdges(edgesB1);
-    deleteEmptyEdges(edgesB2);
-    splitOnCommonEdge(edgesB1, edgesB2, leaf2NumMapB, destination_a, destination_b);
+    // the rest of the tree, with each subtree split off folded into its first leaf
+    units.clear();
+    for (size_t i = 0; i < numLeaves; i++) {
+        if (!hidden.test(numBits - i - 1)) {
+            units.push_back(numBits - i - 1);
+        }
+    }
+    clusters.clear();
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i].alive) {
+            clusters.push_back(i);
+        }
+    }
+    addSubproblem(clusters.data(), clusters.size());
 }
 
 //vector<PhyloTreeEdge> Geodesic::getCommonEdges() {
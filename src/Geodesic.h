@@ -11,6 +11,8 @@
 
 using namespace std;
 
+class GeodesicWorkspace;
+
 class Geodesic {
 public:
     Geodesic(RatioSequence rs);
@@ -53,15 +55,32 @@ public:
 
     static Geodesic getGeodesic(PhyloTree &t1, PhyloTree &t2);
 
+    static Geodesic &getGeodesic(PhyloTree &t1, PhyloTree &t2, GeodesicWorkspace &workspace);
+
     static Geodesic getGeodesicNoCommonEdges(PhyloTree &t1, PhyloTree &t2);
 
+    static Geodesic getGeodesicNoCommonEdges(PhyloTree &t1, PhyloTree &t2, GeodesicWorkspace &workspace);
+
 private:
     RatioSequence rs;
     vector<PhyloTreeEdge> commonEdges;
     double leafContributionSquared = 0;
 public:
     static void splitOnCommonEdge(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
-            vector<string> &reference_leaf_num_map, vector<PhyloTree> &destination_a, vector<PhyloTree> &destination_b);
+            size_t numLeaves, GeodesicWorkspace &workspace);
+
+    static void getGeodesicNoCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
+            size_t numLeaves, GeodesicWorkspace &workspace, RatioSequence &rs);
+
+private:
+    static constexpr double PARALLEL_SUBPROBLEM_COST = 1000;
+
+    static void forkRatio(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges, size_t numLeaves,
+            GeodesicWorkspace &workspace);
+
+    static void solveSubproblems(GeodesicWorkspace &workspace);
+
+    static void interleaveSubproblems(GeodesicWorkspace &workspace, RatioSequence &rs);
 };
 
 #endif /* __GEODESIC_H__ */
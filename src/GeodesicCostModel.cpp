@@ -0,0 +1,62 @@
+#include "GeodesicCostModel.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+GeodesicCostModel::GeodesicCostModel(const vector<PhyloTree> &trees) {
+    fingerprints.reserve(trees.size());
+    leaves.reserve(trees.size());
+    for (auto &tree : trees) {
+        add(tree);
+    }
+}
+
+size_t GeodesicCostModel::add(const PhyloTree &tree) {
+    fingerprints.emplace_back();
+    fingerprint(tree, fingerprints.back());
+    leaves.push_back(tree.getLeafEdgeLengthsByRef().size());
+    return fingerprints.size() - 1;
+}
+
+size_t GeodesicCostModel::size() const {
+    return fingerprints.size();
+}
+
+double GeodesicCostModel::estimate(size_t i, size_t j) const {
+    return estimate(max(leaves[i], leaves[j]), fingerprints[i], fingerprints[j]);
+}
+
+double GeodesicCostModel::estimate(const PhyloTree &t1, const PhyloTree &t2) {
+    vector<size_t> f1, f2;
+    fingerprint(t1, f1);
+    fingerprint(t2, f2);
+    return estimate(max(t1.getLeafEdgeLengthsByRef().size(), t2.getLeafEdgeLengthsByRef().size()), f1, f2);
+}
+
+double GeodesicCostModel::estimate(size_t numLeaves, size_t onlyIn1, size_t onlyIn2) {
+    return numLeaves * log2(numLeaves + 1.0) + 0.7 * onlyIn1 * onlyIn2;
+}
+
+void GeodesicCostModel::fingerprint(const PhyloTree &tree, vector<size_t> &dest) {
+    dest.clear();
+    dest.reserve(tree.getEdgesByRef().size());
+    for (auto &edge : tree.getEdgesByRef()) {
+        dest.push_back(edge.getPartition().hash());
+    }
+    sort(dest.begin(), dest.end());
+}
+
+double GeodesicCostModel::estimate(size_t numLeaves, const vector<size_t> &f1, const vector<size_t> &f2) {
+    size_t common = 0;
+    for (size_t a = 0, b = 0; a < f1.size() && b < f2.size();) {
+        if (f1[a] < f2[b]) a++;
+        else if (f2[b] < f1[a]) b++;
+        else {
+            common++;
+            a++;
+            b++;
+        }
+    }
+    return estimate(numLeaves, f1.size() - common, f2.size() - common);
+}
@@ -0,0 +1,48 @@
+#ifndef __GEODESIC_COST_MODEL_H__
+#define __GEODESIC_COST_MODEL_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+
+#include "PhyloTree.h"
+#include <vector>
+
+using namespace std;
+
+/*
+ * A cheap estimate of the relative time Geodesic::getGeodesic takes on a pair of trees, for ordering and
+ * balancing pairwise work. The decomposition on common edges is roughly n log n in the number of leaves; on
+ * top of that the vertex covers grow with the product of the numbers of splits k1 and k2 found in only one of
+ * the trees. Fitted on random pairs of 30 to 300 leaves, n log2(n + 1) + 0.7 k1 k2 tracks the measured time
+ * to within about a third over three orders of magnitude.
+ *
+ * The model keeps each tree's splits as a sorted list of hashes, so estimating a pair is one merge of two
+ * integer lists rather than a join of the bitsets. Hash collisions only blur the estimate.
+ */
+class GeodesicCostModel {
+public:
+    GeodesicCostModel() = default;
+
+    explicit GeodesicCostModel(const vector<PhyloTree> &trees);
+
+    /* Add a tree, returning its index */
+    size_t add(const PhyloTree &tree);
+
+    size_t size() const;
+
+    double estimate(size_t i, size_t j) const;
+
+    static double estimate(const PhyloTree &t1, const PhyloTree &t2);
+
+    static double estimate(size_t numLeaves, size_t onlyIn1, size_t onlyIn2);
+
+private:
+    vector<vector<size_t>> fingerprints;
+    vector<size_t> leaves;
+
+    static void fingerprint(const PhyloTree &tree, vector<size_t> &dest);
+
+    static double estimate(size_t numLeaves, const vector<size_t> &f1, const vector<size_t> &f2);
+};
+
+#endif /* __GEODESIC_COST_MODEL_H__ */
@@ -0,0 +1,121 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "GeodesicWorkspace.h"
+#include "WorkStealingScheduler.h"
+
+using namespace std;
+
+GeodesicWorkspace::GeodesicWorkspace() : spareThreads(make_shared<atomic<size_t>>(0)), geodesic(RatioSequence()) {
+}
+
+/*
+ * Start a new pair: forget the previous subproblems and ratios (keeping their buffers) and rewind the arena
+ */
+void GeodesicWorkspace::reset() {
+    subproblemCount = 0;
+    ratioStackSize = 0;
+    ratioForks.clear();
+    arena.reset();
+}
+
+MonotonicArena &GeodesicWorkspace::getArena() {
+    return arena;
+}
+
+size_t GeodesicWorkspace::numSubproblems() const {
+    return subproblemCount;
+}
+
+GeodesicSubproblem &GeodesicWorkspace::getSubproblem(size_t i) {
+    return subproblems[i];
+}
+
+MaxFlowAlgorithm GeodesicWorkspace::getMaxFlowAlgorithm() const {
+    return maxFlowAlgorithm;
+}
+
+/*
+ * Max-flow algorithm for the vertex covers of the GTP loop; the geodesic is the same whichever is chosen
+ */
+void GeodesicWorkspace::setMaxFlowAlgorithm(MaxFlowAlgorithm algorithm) {
+    maxFlowAlgorithm = algorithm;
+}
+
+bool GeodesicWorkspace::getWarmStart() const {
+    return warmStart;
+}
+
+/*
+ * Start the vertex cover of each half of a split ratio from the parent's flow (see BipartiteGraph::vertex_cover).
+ * This saves augmentations, but it leaves partly used arcs that make the remaining augmenting paths longer.
+ * So it is off by default: bench_vertex_cover shows it roughly even with PushRelabel and often slower with
+ * the path-based algorithms.
+ */
+void GeodesicWorkspace::setWarmStart(bool warmStart) {
+    this->warmStart = warmStart;
+}
+
+size_t GeodesicWorkspace::getNumThreads() const {
+    return numThreads;
+}
+
+/*
+ * Solve the independent subproblems of one geodesic on up to numThreads threads (0 for one per hardware
+ * thread), for single large pairs. The geodesic is the same whatever the number of threads. Keep it at 1 when
+ * the pairs themselves are spread over threads, as Distance::getDistanceMatrix does.
+ */
+void GeodesicWorkspace::setNumThreads(size_t numThreads) {
+    this->numThreads = WorkStealingScheduler(numThreads).numThreads();
+    helpers.resize(this->numThreads - 1);
+    for (auto &helper : helpers) {
+        if (!helper) helper.reset(new GeodesicWorkspace());
+    }
+    *spareThreads = this->numThreads - 1;
+}
+
+size_t GeodesicWorkspace::getRatioForkThreshold() const {
+    return ratioForkThreshold;
+}
+
+/*
+ * Fork-join refinement inside a subproblem: when a ratio with at least this many edges is split by its vertex
+ * cover into two halves that each still have this many, and one of the workspace's threads is idle, the second
+ * half is refined on that thread while this one carries on with the first. Each half's ratios come out in the
+ * same order as serially, so the geodesic is unchanged. 0 (the default) turns it off; below a few dozen edges
+ * a half is cheaper to refine than to hand to a thread.
+ */
+void GeodesicWorkspace::setRatioForkThreshold(size_t edges) {
+    ratioForkThreshold = edges;
+}
+
+bool GeodesicWorkspace::takeSpareThread() {
+    size_t spare = spareThreads->load();
+    while (spare > 0 && !spareThreads->compare_exchange_weak(spare, spare - 1)) {
+    }
+    return spare > 0;
+}
+
+/* Scratch workspaces of other threads solve with the same settings and draw on the same spare threads */
+void GeodesicWorkspace::inheritSettings(GeodesicWorkspace &scratch) const {
+    scratch.maxFlowAlgorithm = maxFlowAlgorithm;
+    scratch.warmStart = warmStart;
+    scratch.ratioForkThreshold = ratioForkThreshold;
+    scratch.spareThreads = spareThreads;
+}
+
+GeodesicSubproblem &GeodesicWorkspace::addSubproblem() {
+    if (subproblemCount == subproblems.size()) {
+        subproblems.emplace_back();
+    }
+    return subproblems[subproblemCount++];
+}
+
+Ratio &GeodesicWorkspace::pushRatio() {
+    if (ratioStackSize == ratioStack.size()) {
+        ratioStack.emplace_back();
+    }
+    Ratio &ratio = ratioStack[ratioStackSize++];
+    ratio.clear();
+    return ratio;
+}
@@ -0,0 +1,141 @@
+#ifndef __GEODESIC_WORKSPACE_H__
+#define __GEODESIC_WORKSPACE_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "BipartiteGraph.h"
+#include "CompatibilityIndex.h"
+#include "Geodesic.h"
+#include "MonotonicArena.h"
+#include "PhyloTreeEdge.h"
+#include "Ratio.h"
+#include "RatioSequence.h"
+#include "SplitMatrix.h"
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A pair of subtrees with no common edges, produced by Geodesic::splitOnCommonEdge, and the ratio sequence
+ * of its geodesic with that sequence's non-descending blocks
+ */
+struct GeodesicSubproblem {
+    vector<PhyloTreeEdge> aEdges;
+    vector<PhyloTreeEdge> bEdges;
+    size_t numLeaves = 0;
+    RatioSequence rs;
+    vector<RatioBlock> blocks;
+};
+
+/*
+ * Scratch space for Geodesic::getGeodesic, meant to be kept alive across calls (e.g. one per worker thread).
+ *
+ * Containers whose shape carries over between pairs (subproblem edge lists, the split table of
+ * splitOnCommonEdge, the ratio stack, the vertex cover output) are cleared rather than freed, so they keep
+ * their capacity. Per-subproblem flat buffers (incidence matrix, flow matrix, scan lists) come from the
+ * arena, which is reset at the start of each pair. After a few pairs of similar size the decomposition and
+ * the GTP loop run without touching the heap.
+ */
+class GeodesicWorkspace {
+    friend class Geodesic;
+public:
+    GeodesicWorkspace();
+
+    GeodesicWorkspace(const GeodesicWorkspace &) = delete;
+
+    GeodesicWorkspace &operator=(const GeodesicWorkspace &) = delete;
+
+    void reset();
+
+    MonotonicArena &getArena();
+
+    size_t numSubproblems() const;
+
+    GeodesicSubproblem &getSubproblem(size_t i);
+
+    MaxFlowAlgorithm getMaxFlowAlgorithm() const;
+
+    void setMaxFlowAlgorithm(MaxFlowAlgorithm algorithm);
+
+    bool getWarmStart() const;
+
+    void setWarmStart(bool warmStart);
+
+    size_t getNumThreads() const;
+
+    void setNumThreads(size_t numThreads);
+
+    size_t getRatioForkThreshold() const;
+
+    void setRatioForkThreshold(size_t edges);
+
+private:
+    /*
+     * The second half of a split ratio, refined on its own thread with its own scratch workspace. Its ratios
+     * are appended to the sequence once the ratio stack is back down to depth, i.e. once the first half is done.
+     */
+    struct RatioFork {
+        size_t depth;
+        vector<PhyloTreeEdge> aEdges, bEdges;
+        unique_ptr<GeodesicWorkspace> scratch;
+        RatioSequence rs;
+        exception_ptr error;
+        thread worker;
+
+        ~RatioFork() {
+            if (worker.joinable()) worker.join();
+        }
+    };
+
+    /*
+     * A split of either tree in the common-edge decomposition; a split of both trees has both edges set.
+     * Compatible splits (common, or crossing no split of the other tree) are the ones the trees are cut at.
+     */
+    struct SplitItem {
+        const PhyloTreeEdge *edge1;
+        const PhyloTreeEdge *edge2;
+        bool compatible;
+        bool alive;
+        size_t owner; // smallest compatible split properly containing this one, or npos
+    };
+
+    MonotonicArena arena;
+    vector<GeodesicSubproblem> subproblems;
+    size_t subproblemCount = 0;
+    CompatibilityIndex index1, index2; // of the two trees' edges, for splitOnCommonEdge and getCommonEdges
+    vector<SplitItem> splitItems; // splits of both trees in ascending order
+    vector<size_t> clusterOrder, clusterParent, deepestCluster, ownedStart, owned, units;
+    SplitBitset hiddenLeaves; // leaves folded into an earlier leaf by a cut
+    deque<Ratio> ratioStack; // first ratioStackSize entries are live
+    size_t ratioStackSize = 0;
+    Ratio currentRatio;
+    Ratio resultRatio;
+    vector<pair<double, size_t>> mergeHeap; // (ratio, subproblem) of the next block of each subproblem
+    vector<size_t> mergeNext; // per subproblem, index of its next block
+    SplitMatrix splits1, splits2;
+    vector<size_t> aVertices, bVertices;
+    VertexCover cover;
+    MaxFlowAlgorithm maxFlowAlgorithm = MaxFlowAlgorithm::LabelScan;
+    bool warmStart = false;
+    size_t numThreads = 1;
+    vector<unique_ptr<GeodesicWorkspace>> helpers; // scratch for the other threads solving subproblems
+    size_t ratioForkThreshold = 0; // 0: refine every ratio on the calling thread
+    shared_ptr<atomic<size_t>> spareThreads; // of numThreads, those not yet solving or refining anything
+    vector<unique_ptr<RatioFork>> ratioForks; // outstanding, innermost last
+    Geodesic geodesic;
+
+    bool takeSpareThread();
+
+    void inheritSettings(GeodesicWorkspace &scratch) const;
+
+    GeodesicSubproblem &addSubproblem();
+
+    Ratio &pushRatio();
+};
+
+#endif /* __GEODESIC_WORKSPACE_H__ */
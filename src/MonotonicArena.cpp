@@ -0,0 +1,62 @@
+#include "MonotonicArena.h"
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+MonotonicArena::MonotonicArena(size_t initialSize) : initialSize(initialSize) {
+}
+
+void MonotonicArena::addChunk(size_t size) {
+    Chunk chunk;
+    chunk.data.reset(new char[size]);
+    chunk.size = size;
+    chunks.push_back(std::move(chunk));
+    ++chunkAllocations;
+}
+
+void *MonotonicArena::allocate(size_t bytes, size_t alignment) {
+    while (current < chunks.size()) {
+        auto base = reinterpret_cast<uintptr_t>(chunks[current].data.get());
+        size_t start = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+        if (start + bytes <= chunks[current].size) {
+            offset = start + bytes;
+            usedBytes += bytes;
+            return chunks[current].data.get() + start;
+        }
+        ++current;
+        offset = 0;
+    }
+    size_t last = chunks.empty() ? initialSize : chunks.back().size;
+    addChunk(std::max(2 * last, bytes + alignment));
+    current = chunks.size() - 1;
+    offset = 0;
+    return allocate(bytes, alignment);
+}
+
+void MonotonicArena::reset() {
+    if (chunks.size() > 1) {
+        size_t total = capacity();
+        chunks.clear();
+        addChunk(total);
+    }
+    current = 0;
+    offset = 0;
+    usedBytes = 0;
+}
+
+size_t MonotonicArena::capacity() const {
+    size_t total = 0;
+    for (auto &chunk : chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
+
+size_t MonotonicArena::used() const {
+    return usedBytes;
+}
+
+size_t MonotonicArena::numChunkAllocations() const {
+    return chunkAllocations;
+}
@@ -0,0 +1,106 @@
+#ifndef __MONOTONIC_ARENA_H__
+#define __MONOTONIC_ARENA_H__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Bump allocator for short-lived scratch memory.
+ *
+ * Memory is handed out from a list of chunks and never freed individually; reset() releases everything
+ * at once. When a run needed more than one chunk, reset() replaces them with a single chunk of the
+ * combined size, so repeating a run of the same shape allocates nothing after the first pass.
+ */
+class MonotonicArena {
+public:
+    explicit MonotonicArena(size_t initialSize = 4096);
+
+    MonotonicArena(const MonotonicArena &) = delete;
+
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(long double));
+
+    void reset();
+
+    size_t capacity() const;
+
+    size_t used() const;
+
+    size_t numChunkAllocations() const;
+
+private:
+    struct Chunk {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    vector<Chunk> chunks;
+    size_t current = 0; // chunk being bumped
+    size_t offset = 0; // first free byte in chunks[current]
+    size_t usedBytes = 0;
+    size_t chunkAllocations = 0;
+    size_t initialSize;
+
+    void addChunk(size_t size);
+};
+
+/*
+ * STL allocator drawing from a MonotonicArena. deallocate() is a no-op; the arena releases everything on
+ * reset(). A default-constructed allocator has no arena and falls back to operator new/delete, so the same
+ * container types can be used with and without a workspace.
+ */
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    template<class U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator() : arena(nullptr) {
+    }
+
+    ArenaAllocator(MonotonicArena *arena) : arena(arena) {
+    }
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {
+    }
+
+    T *allocate(size_t n) {
+        if (arena) {
+            return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t) {
+        if (!arena) {
+            ::operator delete(p);
+        }
+    }
+
+    MonotonicArena *arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena == b.arena;
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena != b.arena;
+}
+
+template<class T>
+using ArenaVector = vector<T, ArenaAllocator<T>>;
+
+#endif /* __MONOTONIC_ARENA_H__ */
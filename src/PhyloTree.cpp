@@ -1,4 +1,6 @@
 #include "PhyloTree.h"
+#include "CompatibilityIndex.h"
+#include "SplitMatching.h"
 #include "Tools.h"
 #include "bitset_hash.h"
 #include <unordered_map>
@@ -13,28 +15,30 @@ PhyloTree::PhyloTree(vector<PhyloTreeEdge> &edges, vector<string> &leaf2NumMap,
     this->edges = edges;
     this->leaf2NumMap = leaf2NumMap;
     this->leafEdgeLengths = leafEdgeLengths;
+    buildOriginalEdges();
 }
 
-PhyloTree::PhyloTree(vector<PhyloTreeEdge> &edges, vector<string> &leaf2NumMap) : leaf2NumMap(leaf2NumMap) {
-//    this->leaf2NumMap = leaf2NumMap;
-    size_t len = leaf2NumMap.size();
-    this->edges.reserve(edges.size());
-    for (auto &edge : edges) {
-        boost::dynamic_bitset<> new_bitset(len);
-        auto partition = edge.getPartition();
-        auto plen = partition.size();
-        for (size_t i=0; i < len; ++i) {
-            new_bitset[len - i - 1] = partition[plen - i - 1];
-        }
-        edge.setOriginalEdge(make_shared<Bipartition>(new_bitset));
-        this->edges.push_back(edge);
-    }
+/*
+ * Subtree constructor used by the geodesic decomposition: the edges keep the originalIDs of the tree they
+ * were taken from, so no original-edge table is built here.
+ */
+PhyloTree::PhyloTree(vector<PhyloTreeEdge> &edges, vector<string> &leaf2NumMap) : edges(edges), leaf2NumMap(leaf2NumMap) {
+}
+
+PhyloTree::PhyloTree(const PhyloTree &t) : newick(t.newick), edges(t.edges), leaf2NumMap(t.leaf2NumMap),
+                                            leafEdgeLengths(t.leafEdgeLengths), originalEdges(t.originalEdges),
+                                            splitMatrix(t.splitMatrix), compatibilityIndex(t.compatibilityIndex),
+                                            taxa(t.taxa) {
 }
 
-PhyloTree::PhyloTree(const PhyloTree &t) : edges(t.edges), leaf2NumMap(t.leaf2NumMap), leafEdgeLengths(t.leafEdgeLengths), newick(t.newick) {
+PhyloTree::PhyloTree(string t, bool rooted) : PhyloTree(t, rooted, nullptr) {
 }
 
-PhyloTree::PhyloTree(string t, bool rooted) {
+/*
+ * Parse against a shared TaxonNamespace: the leaf2NumMap is taken from the namespace rather than
+ * collected and sorted from the string, and the tree must contain exactly the namespace's taxa.
+ */
+PhyloTree::PhyloTree(string t, bool rooted, shared_ptr<const TaxonNamespace> taxa) : taxa(taxa) {
     // do bracket counting sanity check
     if (count(t.begin(), t.end(), '(') != count(t.begin(), t.end(), ')')) {
         throw invalid_argument("Bracket mismatch error in tree: " + t);
@@ -51,7 +55,14 @@ PhyloTree::PhyloTree(string t, bool rooted) {
 
     // remove whitespace
     Tools::despace(t);
-    setLeaf2NumMapFromNewick(t);
+    vector<bool> seen;
+    if (taxa) {
+        leaf2NumMap = taxa->getLabels();
+        seen.resize(leaf2NumMap.size(), false);
+    }
+    else {
+        setLeaf2NumMapFromNewick(t);
+    }
     //pull off ';' if at end
 //    t = t.erase(t.find_last_of(";"));
 
@@ -67,7 +78,8 @@ PhyloTree::PhyloTree(string t, bool rooted) {
         while (i < t.size()) {
             switch (t.at(i)) {
                 case '(': {
-                    q.emplace_front(string(leaf2NumMap.size(), '0'));
+                    // sized once from the leaf count: small trees keep their split words inline
+                    q.emplace_front(SplitBitset(leaf2NumMap.size()));
                     i++;
                     break;
                 }
@@ -123,8 +135,16 @@ PhyloTree::PhyloTree(string t, bool rooted) {
                         length = Tools::substring(t, end_of_label + 1, end_of_length);
                     }
                     label = Tools::substring(t, i, end_of_label);
-                    leafNum = lower_bound(leaf2NumMap.begin(), leaf2NumMap.end(), label) - leaf2NumMap.begin();
-                    if (leafNum == leaf2NumMap.size()) throw out_of_range("Could not find label (" + label + ") in leaf2NumMap");
+                    if (taxa) {
+                        leafNum = taxa->indexOf(label);
+                        if (leafNum < 0) throw out_of_range("Could not find label (" + label + ") in taxon namespace");
+                        if (seen[leafNum]) throw invalid_argument("Label (" + label + ") appears more than once in tree");
+                        seen[leafNum] = true;
+                    }
+                    else {
+                        leafNum = lower_bound(leaf2NumMap.begin(), leaf2NumMap.end(), label) - leaf2NumMap.begin();
+                        if (leafNum == leaf2NumMap.size()) throw out_of_range("Could not find label (" + label + ") in leaf2NumMap");
+                    }
                     leafEdgeLengths[leafNum] = stod(length);
 
                     for (auto &e: q) {
@@ -148,10 +168,38 @@ PhyloTree::PhyloTree(string t, bool rooted) {
 //        }
 //    }
 
+    if (taxa && std::find(seen.begin(), seen.end(), false) != seen.end()) {
+        throw invalid_argument("Tree does not contain every taxon of its namespace: " + newick);
+    }
+
     for (size_t k = 0; k < edges.size(); ++k) {
-        edges[k].setOriginalEdge(make_shared<Bipartition>(edges[k].asSplit()));
         edges[k].setOriginalID((int) k);
     }
+    buildOriginalEdges();
+}
+
+/*
+ * Fill the original-edge table from the current edges: slot k holds the split of the edge with originalID k.
+ * Edges without an ID (-1) are skipped.
+ */
+void PhyloTree::buildOriginalEdges() {
+    originalEdges.clear();
+    for (auto &edge : edges) {
+        int id = edge.getOriginalID();
+        if (id < 0) continue;
+        if ((size_t) id >= originalEdges.size()) {
+            originalEdges.resize(id + 1);
+        }
+        originalEdges[id] = edge.getPartition();
+    }
+}
+
+const SplitBitset &PhyloTree::getOriginalEdge(int originalID) const {
+    return originalEdges.at(originalID);
+}
+
+const vector<SplitBitset> &PhyloTree::getOriginalEdges() const {
+    return originalEdges;
 }
 
 vector<PhyloTreeEdge> PhyloTree::getEdges() {
@@ -171,6 +219,16 @@ void PhyloTree::getEdges(vector<PhyloTreeEdge>& edges_to_add) {
 
 void PhyloTree::setEdges(vector<PhyloTreeEdge> edges) {
     this->edges = edges;
+    splitMatrix.reset();
+    compatibilityIndex.reset();
+}
+
+/*
+ * Put the edges in split order. Geodesic::getGeodesic sorts the edges of its trees in place unless they are
+ * already in order, so a tree sorted up front is only read and can be shared between threads.
+ */
+void PhyloTree::sortEdges() {
+    std::sort(edges.begin(), edges.end());
 }
 
 PhyloTreeEdge PhyloTree::getEdge(size_t i) {
@@ -187,6 +245,27 @@ vector<string> PhyloTree::getLeaf2NumMap() const {
 
 void PhyloTree::setLeaf2NumMap(vector<string> leaf2NumMap) {
     this->leaf2NumMap = leaf2NumMap;
+    splitMatrix.reset();
+    compatibilityIndex.reset();
+    taxa.reset();
+}
+
+size_t PhyloTree::getNamespaceID() const {
+    return taxa ? taxa->getID() : 0;
+}
+
+shared_ptr<const TaxonNamespace> PhyloTree::getTaxonNamespace() const {
+    return taxa;
+}
+
+/*
+ * Trees parsed against the same TaxonNamespace are compared by ID; otherwise fall back to the label vectors
+ */
+bool PhyloTree::hasSameLeaves(const PhyloTree &other) const {
+    if (taxa && other.taxa && taxa->getID() == other.taxa->getID()) {
+        return true;
+    }
+    return leaf2NumMap == other.leaf2NumMap;
 }
 
 double PhyloTree::getAttribOfSplit(Bipartition& edge) {
@@ -233,6 +312,9 @@ size_t PhyloTree::numLeaves() {
 }
 
 double PhyloTree::getDistanceFromOrigin() {
+    if (splitMatrix) {
+        return splitMatrix->getDistanceFromOrigin();
+    }
     double dist = 0;
     for (auto &edge : edges) {
         dist += std::pow(edge.getLength(), 2);
@@ -254,6 +336,9 @@ double PhyloTree::getDistanceFromOrigin() {
 //}
 
 double PhyloTree::getBranchLengthSum() {
+    if (splitMatrix) {
+        return splitMatrix->getBranchLengthSum();
+    }
     double sum = 0;
     for (auto &edge : edges) {
         sum += edge.getLength();
@@ -267,22 +352,18 @@ double PhyloTree::getBranchLengthSum() {
 }
 
 void PhyloTree::getEdgesNotInCommonWith(PhyloTree &t, vector<PhyloTreeEdge>& dest) {
-    bool not_common;
-    if (leaf2NumMap != t.leaf2NumMap) {
+    if (!hasSameLeaves(t)) {
         throw runtime_error("leaf2NumMaps are not equal");
     }
-    for (auto &this_edge : edges) {
-        not_common = true;
-        //if (this_edge.isZero()) continue;
-
-        for (auto &that_edge : t.edges) {
-            //if (that_edge.isZero()) continue;
-            if (this_edge.sameBipartition(that_edge)) {
-                not_common = false;
-            }
+    if (splitMatrix && t.splitMatrix) {
+        splitMatrix->getEdgesNotInCommonWith(*t.splitMatrix, dest);
+        return;
+    }
+    SplitMatching matching(edges, t.edges);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (matching.partnerOf1(i) == SplitMatching::npos) {
+            dest.push_back(edges[i]);
         }
-        if (not_common)
-            dest.push_back(this_edge);
     }
 }
 
@@ -299,7 +380,7 @@ PhyloTree PhyloTree::clone() {
 }
 
 bool PhyloTree::equals(PhyloTree t) {
-    return (leaf2NumMap == t.leaf2NumMap) && Tools::vector_equal(leafEdgeLengths, t.leafEdgeLengths) && Tools::vector_equal(edges, t.edges);
+    return hasSameLeaves(t) && Tools::vector_equal(leafEdgeLengths, t.leafEdgeLengths) && Tools::vector_equal(edges, t.edges);
 }
 
 //bool PhyloTree::approxEquals(PhyloTree t, double epsilon) {
@@ -316,6 +397,8 @@ const vector<double>& PhyloTree::getLeafEdgeLengthsByRef() const {
 
 void PhyloTree::setLeafEdgeLengths(vector<double>& otherEdgeAttribs) {
     leafEdgeLengths = otherEdgeAttribs;
+    splitMatrix.reset();
+    compatibilityIndex.reset();
 }
 
 //vector<EdgeAttribute> PhyloTree::getCopyLeafEdgeAttribs() {
@@ -474,6 +557,8 @@ void PhyloTree::normalize(double constant) {
     for (int i = 0; i < edges.size(); i++) {
         edges[i].scaleBy(1.0 / constant);
     }
+    splitMatrix.reset();
+    compatibilityIndex.reset();
 }
 
 bool PhyloTree::removeSplit(const Bipartition &e) {
@@ -482,6 +567,8 @@ bool PhyloTree::removeSplit(const Bipartition &e) {
     while (i < edges.size() && !removed) {
         if (edges[i].sameBipartition(e)) {
             Tools::vector_remove_element_at_index(edges, i);
+            splitMatrix.reset();
+            compatibilityIndex.reset();
             removed = true;
         }
         i++;
@@ -540,75 +627,82 @@ string PhyloTree::toString() {
 //    return leafEdgeLengths;
 //}
 
-void PhyloTree::getCommonEdges(PhyloTree &t1, PhyloTree &t2, vector<PhyloTreeEdge> &dest) {
-    vector<PhyloTreeEdge> t1_edges;
-    vector<PhyloTreeEdge> t2_edges;
-    t1.getEdges(t1_edges);
-    t2.getEdges(t2_edges);
-    std::sort(t1_edges.begin(), t1_edges.end());
-    std::sort(t2_edges.begin(), t2_edges.end());
+static const PhyloTreeEdge &edgeOf(const PhyloTreeEdge &edge) {
+    return edge;
+}
 
-    auto first1 = t1_edges.begin();
-    auto first2 = t2_edges.begin();
-    auto last1 = t1_edges.end();
-    auto last2 = t2_edges.end();
-    auto common_bkinstr = std::back_inserter(dest);
+static const PhyloTreeEdge &edgeOf(const PhyloTreeEdge *edge) {
+    return *edge;
+}
 
+/*
+ * Merge two sorted ranges of edges (or of pointers to edges) into the common edges: splits in both (with
+ * the difference in length), plus splits of either that cross no split of the other tree
+ */
+template<class Iterator>
+static void mergeCommonEdges(Iterator first1, Iterator last1, Iterator first2, Iterator last2,
+        const CompatibilityIndex &index1, const CompatibilityIndex &index2, vector<PhyloTreeEdge> &dest) {
     while (first1 != last1 && first2 != last2) {
-        if (*first1 < *first2) {
-            if (first1->isCompatibleWith(t2_edges)) {
-                dest.emplace_back(first1->asSplit(), first1->getAttribute(), first1->getOriginalID());
+        const PhyloTreeEdge &e1 = edgeOf(*first1);
+        const PhyloTreeEdge &e2 = edgeOf(*first2);
+        if (e1 < e2) {
+            if (index2.isCompatibleWith(e1.getPartition())) {
+                dest.emplace_back(e1.getPartition(), e1.getLength(), e1.getOriginalID());
             }
             ++first1; // first1 not in list2
         } else {
-            if (!(*first2 < *first1)) { // first1 == first2
-                *common_bkinstr++ = std::move(PhyloTreeEdge(first1->asSplit(), first1->getLength() - first2->getLength(), first1->getOriginalID()));
+            if (!(e2 < e1)) { // first1 == first2
+                dest.emplace_back(e1.getPartition(), e1.getLength() - e2.getLength(), e1.getOriginalID());
                 ++first1;
             }
-            else { // first2 not in list1
-                if (first2->isCompatibleWith(t1_edges)) {
-                    dest.emplace_back(first2->asSplit(), first2->getAttribute(), first2->getOriginalID());
-                }
+            else if (index1.isCompatibleWith(e2.getPartition())) { // first2 not in list1
+                dest.emplace_back(e2.getPartition(), e2.getLength(), e2.getOriginalID());
             }
             ++first2;
         }
     }
 }
 
-void PhyloTree::getCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges, vector<PhyloTreeEdge> &dest) {
-    std::sort(t1_edges.begin(), t1_edges.end());
-    std::sort(t2_edges.begin(), t2_edges.end());
+void PhyloTree::getCommonEdges(PhyloTree &t1, PhyloTree &t2, vector<PhyloTreeEdge> &dest) {
+    if (t1.splitMatrix && t2.splitMatrix) {
+        SplitMatrix::getCommonEdges(*t1.splitMatrix, *t1.compatibilityIndex, *t2.splitMatrix,
+                                    *t2.compatibilityIndex, dest);
+        return;
+    }
+    // sort pointers rather than copies of the edges
+    vector<const PhyloTreeEdge *> t1_edges;
+    vector<const PhyloTreeEdge *> t2_edges;
+    auto byEdge = [](const PhyloTreeEdge *a, const PhyloTreeEdge *b) { return *a < *b; };
+    for (auto &e : t1.edges) {
+        t1_edges.push_back(&e);
+    }
+    for (auto &e : t2.edges) {
+        t2_edges.push_back(&e);
+    }
+    std::sort(t1_edges.begin(), t1_edges.end(), byEdge);
+    std::sort(t2_edges.begin(), t2_edges.end(), byEdge);
+    mergeCommonEdges(t1_edges.begin(), t1_edges.end(), t2_edges.begin(), t2_edges.end(),
+                     CompatibilityIndex(t1.edges), CompatibilityIndex(t2.edges), dest);
+}
 
-    auto first1 = t1_edges.begin();
-    auto first2 = t2_edges.begin();
-    auto last1 = t1_edges.end();
-    auto last2 = t2_edges.end();
-    auto common_bkinstr = std::back_inserter(dest);
+void PhyloTree::getCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges, vector<PhyloTreeEdge> &dest) {
+    getCommonEdges(t1_edges, t2_edges, CompatibilityIndex(t1_edges), CompatibilityIndex(t2_edges), dest);
+}
 
-    while (first1 != last1 && first2 != last2) {
-        if (*first1 < *first2) {
-            if (first1->isCompatibleWith(t2_edges)) {
-                dest.emplace_back(first1->asSplit(), first1->getAttribute(), first1->getOriginalID());
-            }
-            ++first1; // first1 not in list2
-        } else {
-            if (!(*first2 < *first1)) { // first1 == first2
-                *common_bkinstr++ = std::move(PhyloTreeEdge(first1->asSplit(), first1->getLength() - first2->getLength(), first1->getOriginalID()));
-                ++first1;
-            }
-            else { // first2 not in list1
-                if (first2->isCompatibleWith(t1_edges)) {
-                    dest.emplace_back(first2->asSplit(), first2->getAttribute(), first2->getOriginalID());
-                }
-            }
-            ++first2;
-        }
-    }
+/*
+ * As above, with indexes already built for the two edge sets (e.g. by Geodesic::splitOnCommonEdge)
+ */
+void PhyloTree::getCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
+        const CompatibilityIndex &index1, const CompatibilityIndex &index2, vector<PhyloTreeEdge> &dest) {
+    if (!std::is_sorted(t1_edges.begin(), t1_edges.end())) std::sort(t1_edges.begin(), t1_edges.end());
+    if (!std::is_sorted(t2_edges.begin(), t2_edges.end())) std::sort(t2_edges.begin(), t2_edges.end());
+    mergeCommonEdges(t1_edges.begin(), t1_edges.end(), t2_edges.begin(), t2_edges.end(), index1, index2, dest);
 }
 
 PhyloTreeEdge PhyloTree::getFirstCommonEdge(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges) {
     std::sort(t1_edges.begin(), t1_edges.end());
     std::sort(t2_edges.begin(), t2_edges.end());
+    CompatibilityIndex index1(t1_edges), index2(t2_edges);
 
     auto first1 = t1_edges.begin();
     auto first2 = t2_edges.begin();
@@ -617,7 +711,7 @@ PhyloTreeEdge PhyloTree::getFirstCommonEdge(vector<PhyloTreeEdge> &t1_edges, vec
 
     while (first1 != last1 && first2 != last2) {
         if (*first1 < *first2) {
-            if (first1->isCompatibleWith(t2_edges)) {
+            if (index2.isCompatibleWith(first1->getPartition())) {
                 return PhyloTreeEdge(first1->asSplit(), first1->getAttribute(), first1->getOriginalID());
             }
             ++first1; // first1 not in list2
@@ -626,7 +720,7 @@ PhyloTreeEdge PhyloTree::getFirstCommonEdge(vector<PhyloTreeEdge> &t1_edges, vec
                 return PhyloTreeEdge(first1->asSplit(), first1->getLength() - first2->getLength(), first1->getOriginalID());
             }
             else { // first2 not in list1
-                if (first2->isCompatibleWith(t1_edges)) {
+                if (index1.isCompatibleWith(first2->getPartition())) {
                     return PhyloTreeEdge(first2->asSplit(), first2->getAttribute(), first2->getOriginalID());
                 }
             }
@@ -766,11 +860,12 @@ PhyloTree::PhyloTree(const PhyloTree& other, const vector<int>& missing)
 #endif
         }
     }
+    buildOriginalEdges();
 }
 
 std::pair<std::vector<int>, std::vector<int>> PhyloTree::leaf_difference(const PhyloTree& other) {
     std::pair<std::vector<int>, std::vector<int>> out;
-    if (this->leaf2NumMap == other.leaf2NumMap) {
+    if (hasSameLeaves(other)) {
         return std::move(out);
     }
 
@@ -804,4 +899,25 @@ std::pair<std::vector<int>, std::vector<int>> PhyloTree::leaf_difference(const P
         (*o2++) = std::distance(front2, beg2++);
     }
     return std::move(out);
-}
\ No newline at end of file
+}
+
+/*
+ * Build the flat (structure-of-arrays) copy of this tree's splits. Once both trees of a pair have one,
+ * getCommonEdges, getEdgesNotInCommonWith and the length sums stream over it instead of the edge objects.
+ * Any later change to the edges or leaf lengths drops it again.
+ */
+void PhyloTree::buildSplitMatrix() {
+    splitMatrix = make_shared<const SplitMatrix>(edges, leaf2NumMap.size(), leafEdgeLengths);
+    compatibilityIndex = make_shared<const CompatibilityIndex>(*splitMatrix);
+}
+
+bool PhyloTree::hasSplitMatrix() const {
+    return (bool) splitMatrix;
+}
+
+const SplitMatrix &PhyloTree::getSplitMatrix() const {
+    if (!splitMatrix) {
+        throw runtime_error("PhyloTree has no split matrix; call buildSplitMatrix() first");
+    }
+    return *splitMatrix;
+}
@@ -2,7 +2,11 @@
 #define __PHYLOTREE_H__
 
 #include "Bipartition.h"
+#include "CompatibilityIndex.h"
 #include "PhyloTreeEdge.h"
+#include "SplitMatrix.h"
+#include "TaxonNamespace.h"
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,12 +40,17 @@ public:
 
     PhyloTree(string t, bool rooted);
 
+    PhyloTree(string t, bool rooted, shared_ptr<const TaxonNamespace> taxa);
+
     static void getCommonEdges(PhyloTree &t1, PhyloTree &t2, vector<PhyloTreeEdge> &dest);
 
     static PhyloTreeEdge getFirstCommonEdge(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges);
 
     static void getCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges, vector<PhyloTreeEdge> &dest);
 
+    static void getCommonEdges(vector<PhyloTreeEdge> &t1_edges, vector<PhyloTreeEdge> &t2_edges,
+            const CompatibilityIndex &index1, const CompatibilityIndex &index2, vector<PhyloTreeEdge> &dest);
+
     vector<PhyloTreeEdge> getEdges();
 
     const vector<PhyloTreeEdge> &getEdgesByRef() const;
@@ -50,14 +59,26 @@ public:
 
     void setEdges(vector<PhyloTreeEdge> edges);
 
+    void sortEdges();
+
     PhyloTreeEdge getEdge(size_t i);
 
+    const SplitBitset &getOriginalEdge(int originalID) const;
+
+    const vector<SplitBitset> &getOriginalEdges() const;
+
     vector<string> getLeaf2NumMap();
 
     vector<string> getLeaf2NumMap() const;
 
     void setLeaf2NumMap(vector<string> leaf2NumMap);
 
+    size_t getNamespaceID() const;
+
+    shared_ptr<const TaxonNamespace> getTaxonNamespace() const;
+
+    bool hasSameLeaves(const PhyloTree &other) const;
+
     double getAttribOfSplit(Bipartition &edge);
 
     vector<Bipartition> getSplits();
@@ -112,13 +133,25 @@ public:
 
     std::pair<std::vector<int>, std::vector<int>> leaf_difference(const PhyloTree& other);
 
+    void buildSplitMatrix();
+
+    bool hasSplitMatrix() const;
+
+    const SplitMatrix &getSplitMatrix() const;
+
 private:
     vector<PhyloTreeEdge> edges;
     vector<string> leaf2NumMap;
     vector<double> leafEdgeLengths;
+    vector<SplitBitset> originalEdges; // split of each edge as parsed, indexed by PhyloTreeEdge::getOriginalID()
+    shared_ptr<const SplitMatrix> splitMatrix; // optional flat copy of edges, shared between copies of the tree
+    shared_ptr<const CompatibilityIndex> compatibilityIndex; // built with splitMatrix
+    shared_ptr<const TaxonNamespace> taxa; // set when parsed against a shared namespace
 
     void setLeaf2NumMapFromNewick(string &s);
 
+    void buildOriginalEdges();
+
     void normalize(double constant);
 };
 
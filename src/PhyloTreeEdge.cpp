@@ -24,10 +24,13 @@ PhyloTreeEdge::PhyloTreeEdge() : super() {
 PhyloTreeEdge::PhyloTreeEdge(string s) : super(s) {
 }
 
-PhyloTreeEdge::PhyloTreeEdge(boost::dynamic_bitset<> edge) : super(edge) {
+PhyloTreeEdge::PhyloTreeEdge(const SplitBitset &edge) : super(edge) {
 }
 
-PhyloTreeEdge::PhyloTreeEdge(boost::dynamic_bitset<> edge, double length, int id) : super(edge), length(length), originalID(id) {
+PhyloTreeEdge::PhyloTreeEdge(SplitBitset &&edge) : super(std::move(edge)) {
+}
+
+PhyloTreeEdge::PhyloTreeEdge(const SplitBitset &edge, double length, int id) : super(edge), length(length), originalID(id) {
 }
 
 PhyloTreeEdge::PhyloTreeEdge(double attrib) : super(), length(attrib) {
@@ -37,25 +40,24 @@ PhyloTreeEdge::PhyloTreeEdge(double attrib, int originalID) : super(), length(at
     length = attrib;
 }
 
-PhyloTreeEdge::PhyloTreeEdge(double attrib, shared_ptr<Bipartition> originalEdge, int originalID) : originalEdge(originalEdge), originalID(originalID), length(attrib) {
-    this->partition = boost::dynamic_bitset<>(originalEdge->size());
+PhyloTreeEdge::PhyloTreeEdge(double attrib, size_t numLeaves, int originalID) :
+        super(SplitBitset(numLeaves)), length(attrib), originalID(originalID) {
 }
 
-PhyloTreeEdge::PhyloTreeEdge(Bipartition edge, double attrib, int originalID) : super(edge), originalEdge(make_shared<Bipartition>(edge)), length(attrib) {
+PhyloTreeEdge::PhyloTreeEdge(Bipartition edge, double attrib, int originalID) : super(std::move(edge)), length(attrib) {
     this->originalID = originalID;
 }
 
-PhyloTreeEdge::PhyloTreeEdge(boost::dynamic_bitset<> edge, double attrib,
-        boost::dynamic_bitset<> originalEdge, int originalID)
-        : super(edge), originalEdge(make_shared<Bipartition>(originalEdge)), length(attrib), originalID(originalID) {
-}
-
 PhyloTreeEdge::PhyloTreeEdge(const PhyloTreeEdge &other) : super(other.partition),
                                                            length(other.length),
-                                                           originalEdge(other.originalEdge),
                                                            originalID(other.originalID) {
 }
 
+PhyloTreeEdge::PhyloTreeEdge(PhyloTreeEdge &&other) : super(std::move(other.partition)),
+                                                      length(other.length),
+                                                      originalID(other.originalID) {
+}
+
 double PhyloTreeEdge::getLength() {
     return length;
 }
@@ -65,10 +67,8 @@ bool PhyloTreeEdge::isZero() {
 }
 
 string PhyloTreeEdge::toString() {
-    string s;
-    boost::to_string(partition, s);
     ostringstream ss;
-    ss << "[" << length << "] " << s;
+    ss << "[" << length << "] " << partition;
     return ss.str();
 }
 
@@ -92,15 +92,7 @@ Bipartition PhyloTreeEdge::asSplit() {
     return Bipartition(partition);
 }
 
-const shared_ptr<Bipartition> PhyloTreeEdge::getOriginalEdge() {
-    return originalEdge;
-}
-
-void PhyloTreeEdge::setOriginalEdge(shared_ptr<Bipartition> originalEdge) {
-    this->originalEdge = originalEdge;
-}
-
-int PhyloTreeEdge::getOriginalID() {
+int PhyloTreeEdge::getOriginalID() const {
     return originalID;
 }
 
@@ -10,7 +10,7 @@
 #include <tuple>
 #include <vector>
 #include "Bipartition.h"
-#include "boost/dynamic_bitset.hpp"
+#include "SplitBitset.h"
 
 using namespace std;
 
@@ -24,22 +24,29 @@ public:
 
     PhyloTreeEdge(string s);
 
-    PhyloTreeEdge(boost::dynamic_bitset<> edge);
+    PhyloTreeEdge(const SplitBitset &edge);
 
-    PhyloTreeEdge(boost::dynamic_bitset<> edge, double length, int id);
+    PhyloTreeEdge(SplitBitset &&edge);
+
+    PhyloTreeEdge(const SplitBitset &edge, double length, int id);
 
     PhyloTreeEdge(double attrib);
 
     PhyloTreeEdge(double attrib, int originalID);
 
-    PhyloTreeEdge(double attrib, shared_ptr<Bipartition> originalEdge, int originalID);
+    /* An empty split on numLeaves leaves */
+    PhyloTreeEdge(double attrib, size_t numLeaves, int originalID);
 
     PhyloTreeEdge(Bipartition edge, double attrib, int originalID);
 
-    PhyloTreeEdge(boost::dynamic_bitset<> edge, double attrib, boost::dynamic_bitset<> originalEdge, int originalID);
-
     PhyloTreeEdge(const PhyloTreeEdge &other); // copy-constructor
 
+    PhyloTreeEdge(PhyloTreeEdge &&other);
+
+    PhyloTreeEdge &operator=(const PhyloTreeEdge &other) = default;
+
+    PhyloTreeEdge &operator=(PhyloTreeEdge &&other) = default;
+
 //    inline bool operator< (const EdgeAttribute& other) const {
 //        return Tools::vector_equal(this->vect, other.vect);
 //    }
@@ -72,11 +79,7 @@ public:
 
     Bipartition asSplit();
 
-    const shared_ptr<Bipartition> getOriginalEdge();
-
-    void setOriginalEdge(const shared_ptr<Bipartition> originalEdge);
-
-    int getOriginalID();
+    int getOriginalID() const;
 
     void setOriginalID(int originalID);
 
@@ -96,7 +99,7 @@ public:
 
 private:
     double length = 0;
-    shared_ptr<Bipartition> originalEdge;
+    // Index of this edge's split in the original tree's table (PhyloTree::getOriginalEdge)
     int originalID = -1;
 };
 
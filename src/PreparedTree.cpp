@@ -0,0 +1,56 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "PreparedTree.h"
+
+using namespace std;
+
+PreparedTree::PreparedTree(const PhyloTree &tree, DistanceMetric metric) : metric(metric), tree(tree) {
+    distanceFromOrigin = this->tree.getDistanceFromOrigin();
+    branchLengthSum = this->tree.getBranchLengthSum();
+    leafHash = TaxonNamespace::hash(this->tree.getLeaf2NumMap());
+    if (metric == DistanceMetric::Geodesic) {
+        this->tree.sortEdges();
+        return;
+    }
+    splits.assign(this->tree.getEdgesByRef());
+    if (metric != DistanceMetric::RobinsonFoulds) {
+        compatibility.assign(this->tree.getEdgesByRef());
+    }
+}
+
+DistanceMetric PreparedTree::getMetric() const {
+    return metric;
+}
+
+PhyloTree &PreparedTree::getTree() {
+    return tree;
+}
+
+const PhyloTree &PreparedTree::getTree() const {
+    return tree;
+}
+
+const SplitTable &PreparedTree::getSplitTable() const {
+    return splits;
+}
+
+const CompatibilityIndex &PreparedTree::getCompatibilityIndex() const {
+    return compatibility;
+}
+
+size_t PreparedTree::numEdges() const {
+    return tree.getEdgesByRef().size();
+}
+
+double PreparedTree::getDistanceFromOrigin() const {
+    return distanceFromOrigin;
+}
+
+double PreparedTree::getBranchLengthSum() const {
+    return branchLengthSum;
+}
+
+uint64_t PreparedTree::getLeafHash() const {
+    return leafHash;
+}
@@ -0,0 +1,62 @@
+#ifndef __PREPARED_TREE_H__
+#define __PREPARED_TREE_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+
+#include "CompatibilityIndex.h"
+#include "Distance.h"
+#include "PhyloTree.h"
+#include "SplitMatching.h"
+#include <cstdint>
+
+using namespace std;
+
+/*
+ * A copy of a tree made ready to be compared with many others under one metric, so that the work that depends
+ * on the tree alone is done once instead of for every pair:
+ *
+ *      Geodesic                        the edges sorted (PhyloTree::sortEdges)
+ *      (weighted) Robinson-Foulds,     the split table, with the hash of every split
+ *      Euclidean
+ *      weighted RF, Euclidean          the compatibility index of the splits
+ *      all                             the distance from the origin and the branch length sum, for
+ *                                      normalising, and a hash of the leaf labels
+ *
+ * The norms are taken before sorting, so normalised distances match the single-pair functions on the
+ * original tree exactly. Distance::getDistance only reads prepared trees, so one tree may be compared on
+ * several threads at once.
+ */
+class PreparedTree {
+public:
+    PreparedTree(const PhyloTree &tree, DistanceMetric metric);
+
+    DistanceMetric getMetric() const;
+
+    PhyloTree &getTree();
+
+    const PhyloTree &getTree() const;
+
+    const SplitTable &getSplitTable() const;
+
+    const CompatibilityIndex &getCompatibilityIndex() const;
+
+    size_t numEdges() const;
+
+    double getDistanceFromOrigin() const;
+
+    double getBranchLengthSum() const;
+
+    uint64_t getLeafHash() const;
+
+private:
+    DistanceMetric metric;
+    PhyloTree tree;
+    SplitTable splits;
+    CompatibilityIndex compatibility;
+    double distanceFromOrigin;
+    double branchLengthSum;
+    uint64_t leafHash;
+};
+
+#endif /* __PREPARED_TREE_H__ */
@@ -8,37 +8,39 @@
 
 using namespace std;
 
-Ratio::Ratio() : eLength(0), fLength(0) {
+Ratio::Ratio() : eLength(0), fLength(0), eLengthSq(0), fLengthSq(0) {
 }
 
-Ratio::Ratio(vector<PhyloTreeEdge>& e, vector<PhyloTreeEdge>& f) :
-        eEdges(e), fEdges(f), eLength(geoAvg(e)), fLength(geoAvg(f)) {
+Ratio::Ratio(vector<PhyloTreeEdge>& e, vector<PhyloTreeEdge>& f) : Ratio() {
+    setAllEEdges(e);
+    setAllFEdges(f);
 }
 
-Ratio::Ratio(double e, double f) : eLength(e), fLength(f) {
+Ratio::Ratio(double e, double f) : eLength(e), fLength(f), eLengthSq(e * e), fLengthSq(f * f) {
 }
 
 Ratio::Ratio(const Ratio &other) : eLength(other.eLength), fLength(other.fLength),
+                                   eLengthSq(other.eLengthSq), fLengthSq(other.fLengthSq),
                                    eEdges(other.eEdges), fEdges(other.fEdges) {
 }
 
+/*
+ * The combined ratio holds the edges of both; with no edges on a side the lengths are combined as a
+ * geometric sum, which is what adding the squared-length sums gives
+ */
 Ratio Ratio::combine(Ratio& r1, Ratio& r2) {
     Ratio r{};
-    if ((r1.eEdges.size() == 0) && (r2.eEdges.size() == 0)) {
-        r.setELength(geoAvg(r1.eLength, r2.eLength));
-    }
-    else {
-        r.setAllEEdges(r1.eEdges);
-        r.addAllEEdges(r2.eEdges);
-    }
-
-    if ((r1.fEdges.size() == 0) && (r2.fEdges.size() == 0)) {
-        r.setFLength(geoAvg(r1.fLength, r2.fLength));
-    }
-    else {
-        r.setAllFEdges(r1.fEdges);
-        r.addAllFEdges(r2.fEdges);
-    }
+    r.eEdges.reserve(r1.eEdges.size() + r2.eEdges.size());
+    r.eEdges.insert(r.eEdges.end(), r1.eEdges.begin(), r1.eEdges.end());
+    r.eEdges.insert(r.eEdges.end(), r2.eEdges.begin(), r2.eEdges.end());
+    r.eLengthSq = r1.eLengthSq + r2.eLengthSq;
+    r.eLength = sqrt(r.eLengthSq);
+
+    r.fEdges.reserve(r1.fEdges.size() + r2.fEdges.size());
+    r.fEdges.insert(r.fEdges.end(), r1.fEdges.begin(), r1.fEdges.end());
+    r.fEdges.insert(r.fEdges.end(), r2.fEdges.begin(), r2.fEdges.end());
+    r.fLengthSq = r1.fLengthSq + r2.fLengthSq;
+    r.fLength = sqrt(r.fLengthSq);
     return r;
 }
 
@@ -56,70 +58,92 @@ double Ratio::geoAvg(vector<PhyloTreeEdge>& edges) {
     return sqrt(gAvg);
 }
 
-const vector<PhyloTreeEdge>& Ratio::getEEdges() {
+const vector<int>& Ratio::getEEdges() const {
     return eEdges;
 }
 
 void Ratio::addEEdge(PhyloTreeEdge& edge) {
-    eEdges.push_back(edge);
-    eLength = geoAvg(eLength, edge.getLength());
+    addEEdge(edge.getOriginalID(), edge.getLength());
+}
+
+void Ratio::addEEdge(int id, double length) {
+    eEdges.push_back(id);
+    eLengthSq += length * length;
+    eLength = sqrt(eLengthSq);
 }
 
 void Ratio::addAllEEdges(vector<PhyloTreeEdge>& edges) {
     eEdges.reserve(eEdges.size() + edges.size());
     for (auto &e : edges) {
-        eEdges.push_back(e);
+        eEdges.push_back(e.getOriginalID());
+        eLengthSq += e.getLength() * e.getLength();
     }
-    eLength = geoAvg(eEdges);
+    eLength = sqrt(eLengthSq);
 }
 
 void Ratio::setAllEEdges(vector<PhyloTreeEdge>& edges) {
-    eEdges = edges;
-    eLength = geoAvg(eEdges);
+    eEdges.clear();
+    eLengthSq = 0;
+    addAllEEdges(edges);
 }
 
 void Ratio::setAllFEdges(vector<PhyloTreeEdge>& edges) {
-    fEdges = edges;
-    fLength = geoAvg(fEdges);
+    fEdges.clear();
+    fLengthSq = 0;
+    addAllFEdges(edges);
+}
+
+double Ratio::getELength() const {
+    return eLength;
 }
 
-double Ratio::getELength() {
-    if (eEdges.size() == 0)
-        return eLength;
-    return geoAvg(eEdges);
+double Ratio::getELengthSquared() const {
+    return eLengthSq;
 }
 
 void Ratio::setELength(double eLen) {
-    if (eEdges.size() == 0)
+    if (eEdges.size() == 0) {
         eLength = eLen;
+        eLengthSq = eLen * eLen;
+    }
 }
 
-const vector<PhyloTreeEdge>& Ratio::getFEdges() {
+const vector<int>& Ratio::getFEdges() const {
     return fEdges;
 }
 
 void Ratio::addFEdge(PhyloTreeEdge& edge) {
-    fEdges.push_back(edge);
-    fLength = geoAvg(fLength, edge.getLength());
+    addFEdge(edge.getOriginalID(), edge.getLength());
+}
+
+void Ratio::addFEdge(int id, double length) {
+    fEdges.push_back(id);
+    fLengthSq += length * length;
+    fLength = sqrt(fLengthSq);
 }
 
 void Ratio::addAllFEdges(vector<PhyloTreeEdge>& edges) {
     fEdges.reserve(fEdges.size() + edges.size());
     for (auto &f : edges) {
-        fEdges.push_back(f);
+        fEdges.push_back(f.getOriginalID());
+        fLengthSq += f.getLength() * f.getLength();
     }
-    fLength = geoAvg(fEdges);
+    fLength = sqrt(fLengthSq);
+}
+
+double Ratio::getFLength() const {
+    return fLength;
 }
 
-double Ratio::getFLength() {
-    if (fEdges.size() == 0)
-        return fLength;
-    return geoAvg(fEdges);
+double Ratio::getFLengthSquared() const {
+    return fLengthSq;
 }
 
 void Ratio::setFLength(double fLen) {
-    if (fEdges.size() == 0)
+    if (fEdges.size() == 0) {
         fLength = fLen;
+        fLengthSq = fLen * fLen;
+    }
 }
 
 double Ratio::getRatio() const {
@@ -131,28 +155,31 @@ double Ratio::getTime() {
 }
 
 Ratio Ratio::reverse() {
-    vector<PhyloTreeEdge> evec, fvec;
-    evec.reserve(eEdges.size());
-    fvec.reserve(fEdges.size());
-    for (auto &e : eEdges) {
-        evec.push_back(PhyloTreeEdge(e));
-    }
-    for (auto &f : fEdges) {
-        fvec.push_back(PhyloTreeEdge(f));
-    }
-    return Ratio(fvec, evec);
+    Ratio r(*this);
+    std::swap(r.eEdges, r.fEdges);
+    std::swap(r.eLength, r.fLength);
+    std::swap(r.eLengthSq, r.fLengthSq);
+    return r;
 }
 
-bool Ratio::containsOriginalEEdge(const Bipartition &edge) {
-
-    for (PhyloTreeEdge &ratio_edge : eEdges) {
-        if (ratio_edge.getOriginalEdge()->equals(edge)) {
+/*
+ * Original edges are looked up by originalID in the tables of the trees the e and f edges came from
+ * (PhyloTree::getOriginalEdges()).
+ */
+bool Ratio::containsOriginalEEdge(const Bipartition &edge, const vector<SplitBitset> &eOriginals,
+                                  const vector<SplitBitset> &fOriginals) {
+    auto matches = [&edge](int id, const vector<SplitBitset> &originals) {
+        return id >= 0 && (size_t) id < originals.size() && originals[id] == edge.getPartition();
+    };
+
+    for (int id : eEdges) {
+        if (matches(id, eOriginals)) {
             return true;
         }
     }
 
-    for (PhyloTreeEdge &ratio_edge : fEdges) {
-        if (ratio_edge.getOriginalEdge()->equals(edge)) {
+    for (int id : fEdges) {
+        if (matches(id, fOriginals)) {
             return true;
         }
     }
@@ -161,12 +188,12 @@ bool Ratio::containsOriginalEEdge(const Bipartition &edge) {
 
 string Ratio::toString() {
     std::ostringstream ss;
-    for (auto &e : eEdges) {
-        ss << e.toString() << " ";
+    for (int id : eEdges) {
+        ss << id << " ";
     }
     ss << getELength() << " / " << getFLength() << " ";
-    for (auto &f : fEdges) {
-        ss << f.toString() << " ";
+    for (int id : fEdges) {
+        ss << id << " ";
     }
 
     return ss.str();
@@ -181,7 +208,7 @@ string Ratio::toStringCombType() {
     ss << "{";
 
     for (size_t i = 0; i < eEdges.size(); i++) {
-        ss << eEdges[i].getOriginalID();
+        ss << eEdges[i];
         if (i < eEdges.size() - 1) {
             ss << ",";
         }
@@ -189,7 +216,7 @@ string Ratio::toStringCombType() {
     ss << "}/{";
 
     for (size_t i = 0; i < fEdges.size(); i++) {
-        ss << fEdges[i].getOriginalID();
+        ss << fEdges[i];
         if (i < fEdges.size() - 1) {
             ss << ",";
         }
@@ -198,7 +225,8 @@ string Ratio::toStringCombType() {
     return ss.str();
 }
 
-string Ratio::toStringVerbose(vector<string> leaf2NumMap) {
+string Ratio::toStringVerbose(vector<string> leaf2NumMap, const vector<SplitBitset> &eOriginals,
+                              const vector<SplitBitset> &fOriginals) {
     std::ostringstream ss;
     ss << std::fixed << std::setprecision(8);
 
@@ -211,9 +239,9 @@ string Ratio::toStringVerbose(vector<string> leaf2NumMap) {
     // list the edges dropped
     for (int i = 0; i < eEdges.size(); i++) {
         if (i == 0) {   // nice formatting
-            ss << Bipartition::toStringVerbose(eEdges[i].getPartition(), leaf2NumMap) << endl;
+            ss << Bipartition::toStringVerbose(eOriginals.at(eEdges[i]), leaf2NumMap) << endl;
         } else {
-            ss << "\t\t" << Bipartition::toStringVerbose(eEdges[i].getPartition(), leaf2NumMap) << endl;
+            ss << "\t\t" << Bipartition::toStringVerbose(eOriginals.at(eEdges[i]), leaf2NumMap) << endl;
         }
     }
 
@@ -224,12 +252,24 @@ string Ratio::toStringVerbose(vector<string> leaf2NumMap) {
     // list the edges added
     for (int i = 0; i < fEdges.size(); i++) {
         if (i == 0) {   // nice formatting
-            ss << Bipartition::toStringVerbose(fEdges[i].getPartition(), leaf2NumMap) << endl;
+            ss << Bipartition::toStringVerbose(fOriginals.at(fEdges[i]), leaf2NumMap) << endl;
         } else {
-            ss << "\t\t" << Bipartition::toStringVerbose(fEdges[i].getPartition(), leaf2NumMap) << endl;
+            ss << "\t\t" << Bipartition::toStringVerbose(fOriginals.at(fEdges[i]), leaf2NumMap) << endl;
         }
     }
 
     return ss.str();
 
 }
+
+/*
+ * Empty the ratio but keep its edge buffers, so a reused Ratio does not reallocate
+ */
+void Ratio::clear() {
+    eEdges.clear();
+    fEdges.clear();
+    eLength = 0;
+    fLength = 0;
+    eLengthSq = 0;
+    fLengthSq = 0;
+}
@@ -10,7 +10,16 @@
 
 using namespace std;
 
+/*
+ * A ratio of the geodesic: the e edges dropped from tree 1 and the f edges added from tree 2.
+ *
+ * Edges are referenced by index rather than copied: in a RatioSequence these are the edges' originalIDs
+ * (look them up with PhyloTree::getOriginalEdge()), while inside the GTP loop they are indices into the
+ * sorted edges of the current subproblem. The squared-length sums of both sides are cached, so combining
+ * and splitting ratios is integer and floating-point work only.
+ */
 class Ratio {
+    friend class RatioSequence;
 public:
     Ratio();
 
@@ -22,6 +31,8 @@ public:
 
     Ratio(const Ratio &other); // copy-constructor
 
+    Ratio &operator=(const Ratio &other) = default;
+
     inline bool operator<(const Ratio &other) const {
         return this->getRatio() < other.getRatio();
     }
@@ -42,27 +53,35 @@ public:
 
     static double geoAvg(vector<PhyloTreeEdge>& edges);
 
-    const vector<PhyloTreeEdge>& getEEdges();
+    const vector<int>& getEEdges() const;
 
     void addEEdge(PhyloTreeEdge& edge);
 
+    void addEEdge(int id, double length);
+
     void addAllEEdges(vector<PhyloTreeEdge>& edges);
 
     void setAllEEdges(vector<PhyloTreeEdge>& edges);
 
     void setAllFEdges(vector<PhyloTreeEdge>& edges);
 
-    double getELength();
+    double getELength() const;
+
+    double getELengthSquared() const;
 
     void setELength(double eLen);
 
-    const vector<PhyloTreeEdge>& getFEdges();
+    const vector<int>& getFEdges() const;
 
     void addFEdge(PhyloTreeEdge& edge);
 
+    void addFEdge(int id, double length);
+
     void addAllFEdges(vector<PhyloTreeEdge>& edges);
 
-    double getFLength();
+    double getFLength() const;
+
+    double getFLengthSquared() const;
 
     void setFLength(double fLen);
 
@@ -72,21 +91,27 @@ public:
 
     Ratio reverse();
 
-    bool containsOriginalEEdge(const Bipartition &edge);
+    bool containsOriginalEEdge(const Bipartition &edge, const vector<SplitBitset> &eOriginals,
+                               const vector<SplitBitset> &fOriginals);
 
     string toString();
 
     string toStringCombType();
 
-    string toStringVerbose(vector<string> leaf2NumMap);
+    string toStringVerbose(vector<string> leaf2NumMap, const vector<SplitBitset> &eOriginals,
+                           const vector<SplitBitset> &fOriginals);
 
     Ratio clone();
 
+    void clear();
+
 private:
     double eLength;
     double fLength;
-    vector<PhyloTreeEdge> eEdges;
-    vector<PhyloTreeEdge> fEdges;
+    double eLengthSq; // sum of squared e edge lengths
+    double fLengthSq;
+    vector<int> eEdges;
+    vector<int> fEdges;
 };
 
 #endif /* __RATIO_H__ */
@@ -26,9 +26,14 @@ RatioSequence::RatioSequence(string ptA, string ptB) {
     }
 }
 
+/*
+ * Merge the non-descending forms of the two sequences by ratio. Each merged block is built once, as it is
+ * added to the result.
+ */
 RatioSequence RatioSequence::interleave(RatioSequence& rs1, RatioSequence& rs2) {
-    RatioSequence combined1 = rs1.getNonDesRSWithMinDist();
-    RatioSequence combined2 = rs2.getNonDesRSWithMinDist();
+    vector<RatioBlock> combined1, combined2;
+    rs1.getNonDesBlocks(combined1);
+    rs2.getNonDesBlocks(combined2);
 
     RatioSequence interleavedRS = RatioSequence();
     interleavedRS._RatioSequence.reserve(combined1.size() + combined2.size());
@@ -36,21 +41,21 @@ RatioSequence RatioSequence::interleave(RatioSequence& rs1, RatioSequence& rs2)
     size_t index2 = 0;  // index for stepping through combined2
     while (index1 < combined1.size() && index2 < combined2.size()) {
         if (combined1[index1].getRatio() <= combined2[index2].getRatio()) {
-            interleavedRS.push_back(combined1[index1]);
+            interleavedRS.push_back_value(rs1.getCombinedRatio(combined1[index1]));
             index1++;
         } else {
-            interleavedRS.push_back(combined2[index2]);
+            interleavedRS.push_back_value(rs2.getCombinedRatio(combined2[index2]));
             index2++;
         }
     }
     // if we have finished adding rs2 but not rs1
     while (index1 < combined1.size()) {
-        interleavedRS.push_back(combined1[index1]);
+        interleavedRS.push_back_value(rs1.getCombinedRatio(combined1[index1]));
         index1++;
     }
     // if we have finished adding rs1 but not rs2
     while (index2 < combined2.size()) {
-        interleavedRS.push_back(combined2[index2]);
+        interleavedRS.push_back_value(rs2.getCombinedRatio(combined2[index2]));
         index2++;
     }
     return interleavedRS;
@@ -96,9 +101,18 @@ double RatioSequence::getDistance() {
     return sqrt(dist_sqd);
 }
 
-//double RatioSequence::getMinNonDesRSDistance() {
-//    return getNonDesRSWithMinDist().getDistance();
-//}
+/*
+ * Same as getNonDesRSWithMinDist().getDistance(), without building the merged ratios
+ */
+double RatioSequence::getMinNonDesRSDistance() {
+    vector<RatioBlock> blocks;
+    getNonDesBlocks(blocks);
+    double dist_sqd = 0.0;
+    for (auto &block : blocks) {
+        dist_sqd += pow(block.eLength + block.fLength, 2);
+    }
+    return sqrt(dist_sqd);
+}
 
 RatioSequence RatioSequence::clone() {
     return RatioSequence(*this);
@@ -132,51 +146,74 @@ RatioSequence RatioSequence::getNonDesRSWithMinDist() {
     if (this->size() < 2) {
         return *this;
     }
-    RatioSequence combinedRS(*this);
-    size_t i = 0;   // index for stepping through rs
+    vector<RatioBlock> blocks;
+    getNonDesBlocks(blocks);
+
+    RatioSequence combinedRS;
+    combinedRS._RatioSequence.reserve(blocks.size());
     long combineCode = 0;
-    vector<int> ccArray(this->size(), 0);
-
-    int a = 0; // array index
-
-    while (i < combinedRS.size() - 1) {
-        if (combinedRS[i].getRatio() > combinedRS[i + 1].getRatio()) {
-            Ratio combinedRatio = Ratio::combine(combinedRS[i], combinedRS[i + 1]);
-            combinedRS.erase(i);
-            combinedRS.erase(i);
-            combinedRS._RatioSequence.insert(combinedRS._RatioSequence.begin() + i, combinedRatio);
-            ccArray[a] = 1;
-            if (i > 0) {
-                i--;
-                // go back in the array to the last non-combined ratio
-                while (ccArray[a] == 1) {
-                    a--;
-                }
-            } else {
-                // we must advance a
-                while ((a < this->size() - 1) && (ccArray[a] != 2)) {
-                    a++;
-                }
-            }
-        } else {
-            ccArray[a] = 0;
-            // the ratios are not-descending, so go on to the next pair
-            i++;
-            // we must jump ahead to the next ratio not considered for combination
-            while ((a < this->size() - 1) && (ccArray[a] != 2)) {
-                a++;
-            }
+    for (auto &block : blocks) {
+        combinedRS.push_back_value(getCombinedRatio(block));
+        // bit k is set if ratios k and k + 1 were combined
+        for (size_t k = block.begin; k + 1 < block.end && k + 1 < 8 * sizeof(long); k++) {
+            combineCode |= 1L << k;
         }
     }
+    combinedRS.setCombineCode(combineCode);
+
+    return combinedRS;
+}
 
-    for (size_t k = 0; k < this->size() - 1; k++) {
-        if (ccArray[k] == 1) {
-            combineCode += pow(2, k);
+/*
+ * Pool adjacent violators: combine neighbouring ratios while one is greater than the next, in a single
+ * pass with the blocks so far kept as a stack. Only the running squared-length sums are combined, so this
+ * is linear in the number of ratios; combining left to right gives the same sums (and so the same blocks)
+ * as combining the ratios themselves with Ratio::combine.
+ */
+void RatioSequence::getNonDesBlocks(vector<RatioBlock>& blocks) const {
+    blocks.clear();
+    blocks.reserve(_RatioSequence.size());
+    for (size_t i = 0; i < _RatioSequence.size(); i++) {
+        const Ratio &ratio = _RatioSequence[i];
+        blocks.push_back(RatioBlock{i, i + 1, ratio.eLength, ratio.fLength, ratio.eLengthSq, ratio.fLengthSq});
+        while (blocks.size() > 1 && blocks[blocks.size() - 2].getRatio() > blocks.back().getRatio()) {
+            RatioBlock &left = blocks[blocks.size() - 2];
+            const RatioBlock &right = blocks.back();
+            left.end = right.end;
+            left.eLengthSq = left.eLengthSq + right.eLengthSq;
+            left.eLength = sqrt(left.eLengthSq);
+            left.fLengthSq = left.fLengthSq + right.fLengthSq;
+            left.fLength = sqrt(left.fLengthSq);
+            blocks.pop_back();
         }
     }
-    combinedRS.setCombineCode(combineCode);
+}
 
-    return combinedRS;
+/*
+ * The ratio a block stands for: its ratios' edges concatenated in order, with the block's lengths
+ */
+Ratio RatioSequence::getCombinedRatio(const RatioBlock& block) const {
+    if (block.end - block.begin == 1) {
+        return _RatioSequence[block.begin];
+    }
+    size_t numE = 0, numF = 0;
+    for (size_t i = block.begin; i < block.end; i++) {
+        numE += _RatioSequence[i].eEdges.size();
+        numF += _RatioSequence[i].fEdges.size();
+    }
+    Ratio combined;
+    combined.eEdges.reserve(numE);
+    combined.fEdges.reserve(numF);
+    for (size_t i = block.begin; i < block.end; i++) {
+        const Ratio &ratio = _RatioSequence[i];
+        combined.eEdges.insert(combined.eEdges.end(), ratio.eEdges.begin(), ratio.eEdges.end());
+        combined.fEdges.insert(combined.fEdges.end(), ratio.fEdges.begin(), ratio.fEdges.end());
+    }
+    combined.eLength = block.eLength;
+    combined.fLength = block.fLength;
+    combined.eLengthSq = block.eLengthSq;
+    combined.fLengthSq = block.fLengthSq;
+    return combined;
 }
 
 //RatioSequence RatioSequence::getAscRSWithMinDist() {
@@ -273,6 +310,15 @@ void RatioSequence::erase(size_t index) {
     Tools::vector_remove_element_at_index(_RatioSequence, index);
 }
 
+void RatioSequence::clear() {
+    _RatioSequence.clear();
+    combineCode = 0;
+}
+
+void RatioSequence::reserve(size_t n) {
+    _RatioSequence.reserve(n);
+}
+
 //void RatioSequence::insert(vector<Ratio>::iterator index, Ratio item) {
 //    _RatioSequence.insert(index, item);
 //}
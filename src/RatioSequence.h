@@ -9,6 +9,18 @@
 
 using namespace std;
 
+/*
+ * A run of consecutive ratios [begin, end) of a RatioSequence that getNonDesRSWithMinDist merges into one,
+ * with the lengths the merged ratio would have. The merged edge lists are only built on request
+ * (RatioSequence::getCombinedRatio).
+ */
+struct RatioBlock {
+    size_t begin, end;
+    double eLength, fLength, eLengthSq, fLengthSq;
+
+    double getRatio() const { return eLength / fLength; }
+};
+
 class RatioSequence {
 
 public:
@@ -36,7 +48,7 @@ public:
 
     double getDistance();
 
-//    double getMinNonDesRSDistance();
+    double getMinNonDesRSDistance();
 
     RatioSequence clone();
 
@@ -44,6 +56,10 @@ public:
 
     RatioSequence getNonDesRSWithMinDist();
 
+    void getNonDesBlocks(vector<RatioBlock>& blocks) const;
+
+    Ratio getCombinedRatio(const RatioBlock& block) const;
+
 //    RatioSequence getAscRSWithMinDist();
 
 //    RatioSequence reverse();
@@ -54,6 +70,10 @@ public:
 
     void erase(size_t index);
 
+    void clear();
+
+    void reserve(size_t n);
+
 //    void insert(vector<Ratio>::iterator index, Ratio item);
 
     vector<Ratio>::iterator begin();
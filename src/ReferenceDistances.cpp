@@ -0,0 +1,184 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "ReferenceDistances.h"
+#include "Geodesic.h"
+#include "WorkStealingScheduler.h"
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+ReferenceDistances::ReferenceDistances(const PhyloTree &reference, DistanceMetric metric, bool normalise,
+                                       size_t numThreads)
+        : reference(reference, metric), taxa(reference.getTaxonNamespace()), normalise(normalise),
+          numThreads(WorkStealingScheduler(numThreads).numThreads()) {
+    if (!taxa) {
+        taxa = make_shared<const TaxonNamespace>(reference.getLeaf2NumMap());
+    }
+}
+
+const PreparedTree &ReferenceDistances::getReference() const {
+    return reference;
+}
+
+shared_ptr<const TaxonNamespace> ReferenceDistances::getTaxonNamespace() const {
+    return taxa;
+}
+
+double ReferenceDistances::getDistance(PhyloTree &tree) {
+    GeodesicWorkspace workspace;
+    SplitMatching matching;
+    return getDistance(tree, workspace, matching);
+}
+
+void ReferenceDistances::getDistances(vector<PhyloTree> &trees, double *out) {
+    WorkStealingScheduler scheduler(numThreads);
+    vector<GeodesicWorkspace> workspaces(scheduler.numThreads());
+    vector<SplitMatching> matchings(scheduler.numThreads());
+    scheduler.run(trees.size(), [&](size_t k, size_t thread) {
+        out[k] = getDistance(trees[k], workspaces[thread], matchings[thread]);
+    });
+}
+
+vector<double> ReferenceDistances::getDistances(const vector<string> &newicks, bool rooted) {
+    vector<double> distances(newicks.size());
+    size_t next = 0;
+    stream([&](string &newick) {
+               if (next == newicks.size()) return false;
+               newick = newicks[next++];
+               return true;
+           }, rooted,
+           [&](size_t index, double distance) { distances[index] = distance; });
+    return distances;
+}
+
+vector<double> ReferenceDistances::getDistances(istream &newicks, bool rooted) {
+    vector<double> distances;
+    stream([&](string &newick) {
+               while (getline(newicks, newick)) {
+                   if (newick.find_first_not_of(" \t\r") != string::npos) return true;
+               }
+               return false;
+           }, rooted,
+           [&](size_t index, double distance) {
+               if (index >= distances.size()) distances.resize(index + 1);
+               distances[index] = distance;
+           });
+    return distances;
+}
+
+size_t ReferenceDistances::stream(const function<bool(string &newick)> &next, bool rooted,
+                                  const function<void(size_t index, double distance)> &emit, size_t batchSize) {
+    mutex source, sink;
+    bool exhausted = false;
+    size_t count = 0;
+    atomic<bool> failed(false);
+    exception_ptr error;
+
+    auto worker = [&]() {
+        GeodesicWorkspace workspace;
+        SplitMatching matching;
+        vector<string> batch;
+        vector<double> distances;
+        try {
+            while (!failed) {
+                size_t first;
+                batch.clear();
+                {
+                    lock_guard<mutex> lock(source);
+                    first = count;
+                    string newick;
+                    while (!exhausted && batch.size() < max<size_t>(1, batchSize)) {
+                        if (next(newick)) batch.push_back(newick);
+                        else exhausted = true;
+                    }
+                    count += batch.size();
+                }
+                if (batch.empty()) break;
+
+                distances.resize(batch.size());
+                for (size_t k = 0; k < batch.size() && !failed; ++k) {
+                    PhyloTree tree(batch[k], rooted, taxa);
+                    distances[k] = getDistance(tree, workspace, matching);
+                }
+                lock_guard<mutex> lock(sink);
+                for (size_t k = 0; k < batch.size() && !failed; ++k) {
+                    emit(first + k, distances[k]);
+                }
+            }
+        }
+        catch (...) {
+            lock_guard<mutex> lock(sink);
+            if (!error) error = current_exception();
+            failed = true;
+        }
+    };
+
+    vector<thread> helpers;
+    for (size_t t = 1; t < numThreads; ++t) {
+        helpers.emplace_back(worker);
+    }
+    worker();
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return count;
+}
+
+/*
+ * Distance::getDistance with the reference as the first tree, except that the splits are joined the other way
+ * round, the tree's against the reference's table
+ */
+double ReferenceDistances::getDistance(PhyloTree &tree, GeodesicWorkspace &workspace, SplitMatching &matching) {
+    if (tree.getTaxonNamespace() != taxa && !reference.getTree().hasSameLeaves(tree)) {
+        throw runtime_error("leaf2NumMaps are not equal");
+    }
+    const DistanceMetric metric = reference.getMetric();
+    if (metric == DistanceMetric::Geodesic) {
+        try {
+            double distance = Geodesic::getGeodesic(reference.getTree(), tree, workspace).getDist();
+            if (normalise) return distance / (reference.getDistanceFromOrigin() + tree.getDistanceFromOrigin());
+            return distance;
+        } catch (const std::invalid_argument &e) {
+            std::cout << "ERROR! " << e.what() << std::endl;
+            return std::numeric_limits<double>::infinity();
+        }
+    }
+
+    auto &edges = tree.getEdgesByRef();
+    auto &referenceEdges = reference.getTree().getEdgesByRef();
+    if (metric == DistanceMetric::RobinsonFoulds) {
+        matching.match(edges, referenceEdges, reference.getSplitTable());
+        double rf_value = matching.numOnlyIn1() + matching.numOnlyIn2();
+        if (normalise)
+            rf_value /= reference.numEdges() + tree.numEdges();
+        return rf_value;
+    }
+
+    double absolutes = 0, squares = 0;
+    matching.match(edges, referenceEdges, reference.getSplitTable(), &reference.getCompatibilityIndex());
+    matching.getDifferenceSums(absolutes, squares);
+    auto &leaves1 = reference.getTree().getLeafEdgeLengthsByRef();
+    auto &leaves2 = tree.getLeafEdgeLengthsByRef();
+    if (metric == DistanceMetric::WeightedRobinsonFoulds) {
+        for (size_t i = 0; i < leaves1.size(); i++) {
+            absolutes += abs(leaves1[i] - leaves2[i]);
+        }
+        if (normalise) return absolutes / (reference.getBranchLengthSum() + tree.getBranchLengthSum());
+        return absolutes;
+    }
+    for (size_t i = 0; i < leaves1.size(); i++) {
+        squares += pow(leaves1[i] - leaves2[i], 2);
+    }
+    if (normalise) return sqrt(squares) / (reference.getDistanceFromOrigin() + tree.getDistanceFromOrigin());
+    return sqrt(squares);
+}
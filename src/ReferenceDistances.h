@@ -0,0 +1,71 @@
+#ifndef __REFERENCE_DISTANCES_H__
+#define __REFERENCE_DISTANCES_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+
+#include "Distance.h"
+#include "GeodesicWorkspace.h"
+#include "PhyloTree.h"
+#include "PreparedTree.h"
+#include "SplitMatching.h"
+#include "TaxonNamespace.h"
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Distances from one reference tree to many others, e.g. a consensus tree against the samples of a
+ * posterior. The reference is prepared once (see PreparedTree): its split table, compatibility index, sorted
+ * edges, norm and branch length sum are not recomputed per tree, and the other trees only hash their splits
+ * into the reference's table.
+ *
+ * Trees given as newick strings are parsed on the worker threads, against a TaxonNamespace of the reference's
+ * leaves, so that checking their leaf sets costs nothing and only a batch of trees per thread is held in
+ * memory at a time. The distances are those of Distance::getDistance(reference, tree), up to rounding in the
+ * weighted RF and Euclidean sums, which are taken from the other side.
+ */
+class ReferenceDistances {
+public:
+    /* numThreads 0 for one per hardware thread */
+    ReferenceDistances(const PhyloTree &reference, DistanceMetric metric, bool normalise, size_t numThreads = 0);
+
+    const PreparedTree &getReference() const;
+
+    /* The reference's leaves, to parse other trees against */
+    shared_ptr<const TaxonNamespace> getTaxonNamespace() const;
+
+    double getDistance(PhyloTree &tree);
+
+    /* out[k] is the distance to trees[k]; for geodesics the edges of the trees are sorted, as getGeodesic does */
+    void getDistances(vector<PhyloTree> &trees, double *out);
+
+    vector<double> getDistances(const vector<string> &newicks, bool rooted);
+
+    /* One newick string per line; blank lines are skipped */
+    vector<double> getDistances(istream &newicks, bool rooted);
+
+    /*
+     * Streams trees through the worker threads: next(newick) sets the next newick string and returns false
+     * once there are none left; emit(index, distance) receives the distance to the index-th tree. Both are
+     * called under a lock, next for batchSize trees at a time and emit in no particular order of the indices.
+     * The first exception, from next, emit or a tree, stops the workers and is rethrown. Returns the number of
+     * trees.
+     */
+    size_t stream(const function<bool(string &newick)> &next, bool rooted,
+                  const function<void(size_t index, double distance)> &emit, size_t batchSize = 256);
+
+private:
+    PreparedTree reference;
+    shared_ptr<const TaxonNamespace> taxa;
+    bool normalise;
+    size_t numThreads;
+
+    double getDistance(PhyloTree &tree, GeodesicWorkspace &workspace, SplitMatching &matching);
+};
+
+#endif /* __REFERENCE_DISTANCES_H__ */
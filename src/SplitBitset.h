@@ -0,0 +1,309 @@
+#ifndef __SPLIT_BITSET_H__
+#define __SPLIT_BITSET_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <boost/functional/hash.hpp>
+
+/*
+ * Number of 64-bit words a SplitBitset keeps inline before spilling to the heap.
+ * The default of 8 covers trees of up to 512 taxa without any allocation.
+ */
+#ifndef CGTP_SPLIT_INLINE_BLOCKS
+#define CGTP_SPLIT_INLINE_BLOCKS 8
+#endif
+
+/*
+ * Fixed-size bitset used to store a split of the leaf set.
+ *
+ * Drop-in replacement for the subset of boost::dynamic_bitset<> used by Bipartition:
+ * bit i is stored at position i % 64 of word i / 64 (so to_string() prints bit size()-1 first,
+ * and leaf i of a Bipartition lives at bit size() - i - 1). Up to CGTP_SPLIT_INLINE_BLOCKS words
+ * are held in the object itself; larger splits allocate their words on the heap.
+ * Bits above size() in the last word are always kept zero.
+ */
+class SplitBitset {
+public:
+    typedef uint64_t block_type;
+    enum : size_t {
+        bits_per_block = 64,
+        inline_blocks = CGTP_SPLIT_INLINE_BLOCKS,
+        npos = static_cast<size_t>(-1)
+    };
+
+    class reference {
+    public:
+        reference(SplitBitset &bitset, size_t pos) : bitset(bitset), pos(pos) {}
+
+        operator bool() const { return bitset.test(pos); }
+
+        reference &operator=(bool value) {
+            bitset.set(pos, value);
+            return *this;
+        }
+
+        reference &operator=(const reference &other) {
+            bitset.set(pos, (bool) other);
+            return *this;
+        }
+
+        reference &flip() {
+            bitset.flip(pos);
+            return *this;
+        }
+
+    private:
+        SplitBitset &bitset;
+        size_t pos;
+    };
+
+    SplitBitset() : nbits(0), nblocks(0), heap(nullptr) {
+    }
+
+    explicit SplitBitset(size_t numBits) : nbits(numBits), nblocks(blocksFor(numBits)), heap(nullptr) {
+        allocate();
+        std::fill(data(), data() + nblocks, block_type(0));
+    }
+
+    // Leftmost character is the most significant bit, as for boost::dynamic_bitset<>(string)
+    explicit SplitBitset(const std::string &s) : SplitBitset(s.size()) {
+        for (size_t i = 0; i < nbits; ++i) {
+            if (s[nbits - i - 1] == '1') set(i);
+        }
+    }
+
+    // Copies numBits bits from an external array of words laid out as in data()
+    SplitBitset(size_t numBits, const block_type *blocks) : nbits(numBits), nblocks(blocksFor(numBits)), heap(nullptr) {
+        allocate();
+        std::memcpy(data(), blocks, nblocks * sizeof(block_type));
+    }
+
+    SplitBitset(const SplitBitset &other) : nbits(other.nbits), nblocks(other.nblocks), heap(nullptr) {
+        allocate();
+        std::memcpy(data(), other.data(), nblocks * sizeof(block_type));
+    }
+
+    SplitBitset(SplitBitset &&other) : nbits(other.nbits), nblocks(other.nblocks), heap(other.heap) {
+        if (!heap) std::memcpy(local, other.local, nblocks * sizeof(block_type));
+        other.heap = nullptr;
+        other.nbits = other.nblocks = 0;
+    }
+
+    ~SplitBitset() {
+        delete[] heap;
+    }
+
+    SplitBitset &operator=(const SplitBitset &other) {
+        if (this == &other) return *this;
+        if (nblocks != other.nblocks) {
+            delete[] heap;
+            heap = nullptr;
+            nblocks = other.nblocks;
+            allocate();
+        }
+        nbits = other.nbits;
+        std::memcpy(data(), other.data(), nblocks * sizeof(block_type));
+        return *this;
+    }
+
+    SplitBitset &operator=(SplitBitset &&other) {
+        if (this == &other) return *this;
+        delete[] heap;
+        nbits = other.nbits;
+        nblocks = other.nblocks;
+        heap = other.heap;
+        if (!heap) std::memcpy(local, other.local, nblocks * sizeof(block_type));
+        other.heap = nullptr;
+        other.nbits = other.nblocks = 0;
+        return *this;
+    }
+
+    static size_t blocksFor(size_t numBits) {
+        return (numBits + bits_per_block - 1) / bits_per_block;
+    }
+
+    size_t size() const { return nbits; }
+
+    bool empty() const { return nbits == 0; }
+
+    size_t num_blocks() const { return nblocks; }
+
+    bool is_inline() const { return heap == nullptr; }
+
+    block_type *data() { return heap ? heap : local; }
+
+    const block_type *data() const { return heap ? heap : local; }
+
+    bool test(size_t pos) const {
+        return (data()[pos / bits_per_block] >> (pos % bits_per_block)) & 1;
+    }
+
+    bool operator[](size_t pos) const { return test(pos); }
+
+    reference operator[](size_t pos) { return reference(*this, pos); }
+
+    SplitBitset &set(size_t pos, bool value = true) {
+        block_type mask = block_type(1) << (pos % bits_per_block);
+        if (value) data()[pos / bits_per_block] |= mask;
+        else data()[pos / bits_per_block] &= ~mask;
+        return *this;
+    }
+
+    SplitBitset &reset(size_t pos) { return set(pos, false); }
+
+    SplitBitset &flip(size_t pos) {
+        data()[pos / bits_per_block] ^= block_type(1) << (pos % bits_per_block);
+        return *this;
+    }
+
+    SplitBitset &reset() {
+        std::fill(data(), data() + nblocks, block_type(0));
+        return *this;
+    }
+
+    SplitBitset &flip() {
+        block_type *d = data();
+        for (size_t i = 0; i < nblocks; ++i) d[i] = ~d[i];
+        zeroUnusedBits();
+        return *this;
+    }
+
+    size_t count() const {
+        const block_type *d = data();
+        size_t n = 0;
+        for (size_t i = 0; i < nblocks; ++i) n += __builtin_popcountll(d[i]);
+        return n;
+    }
+
+    bool any() const {
+        const block_type *d = data();
+        for (size_t i = 0; i < nblocks; ++i) {
+            if (d[i]) return true;
+        }
+        return false;
+    }
+
+    bool none() const { return !any(); }
+
+    bool all() const { return count() == nbits; }
+
+    size_t find_first() const { return findFrom(0); }
+
+    size_t find_next(size_t pos) const {
+        ++pos;
+        if (pos >= nbits) return npos;
+        size_t block = pos / bits_per_block;
+        block_type w = data()[block] >> (pos % bits_per_block);
+        if (w) return pos + __builtin_ctzll(w);
+        return findFrom(block + 1);
+    }
+
+    bool intersects(const SplitBitset &other) const {
+        const block_type *a = data(), *b = other.data();
+        size_t n = std::min(nblocks, other.nblocks);
+        for (size_t i = 0; i < n; ++i) {
+            if (a[i] & b[i]) return true;
+        }
+        return false;
+    }
+
+    bool is_subset_of(const SplitBitset &other) const {
+        const block_type *a = data(), *b = other.data();
+        for (size_t i = 0; i < nblocks; ++i) {
+            if (a[i] & ~(i < other.nblocks ? b[i] : 0)) return false;
+        }
+        return true;
+    }
+
+    SplitBitset &operator&=(const SplitBitset &other) {
+        block_type *a = data();
+        const block_type *b = other.data();
+        for (size_t i = 0; i < nblocks; ++i) a[i] &= (i < other.nblocks ? b[i] : 0);
+        return *this;
+    }
+
+    SplitBitset &operator|=(const SplitBitset &other) {
+        block_type *a = data();
+        const block_type *b = other.data();
+        size_t n = std::min(nblocks, other.nblocks);
+        for (size_t i = 0; i < n; ++i) a[i] |= b[i];
+        zeroUnusedBits();
+        return *this;
+    }
+
+    // this &= ~other, without building the temporary complement
+    SplitBitset &andNot(const SplitBitset &other) {
+        block_type *a = data();
+        const block_type *b = other.data();
+        size_t n = std::min(nblocks, other.nblocks);
+        for (size_t i = 0; i < n; ++i) a[i] &= ~b[i];
+        return *this;
+    }
+
+    SplitBitset operator~() const {
+        SplitBitset result(*this);
+        result.flip();
+        return result;
+    }
+
+    bool operator==(const SplitBitset &other) const {
+        return nbits == other.nbits && std::memcmp(data(), other.data(), nblocks * sizeof(block_type)) == 0;
+    }
+
+    bool operator!=(const SplitBitset &other) const { return !(*this == other); }
+
+    // Compares from the most significant word down, matching boost::dynamic_bitset<>
+    bool operator<(const SplitBitset &other) const {
+        const block_type *a = data(), *b = other.data();
+        for (size_t i = std::max(nblocks, other.nblocks); i > 0; --i) {
+            block_type x = i <= nblocks ? a[i - 1] : 0;
+            block_type y = i <= other.nblocks ? b[i - 1] : 0;
+            if (x != y) return x < y;
+        }
+        return false;
+    }
+
+    size_t hash() const {
+        return boost::hash_range(data(), data() + nblocks);
+    }
+
+    std::string to_string() const {
+        std::string s(nbits, '0');
+        for (size_t i = 0; i < nbits; ++i) {
+            if (test(i)) s[nbits - i - 1] = '1';
+        }
+        return s;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const SplitBitset &bitset) {
+        return os << bitset.to_string();
+    }
+
+private:
+    size_t nbits;
+    size_t nblocks;
+    block_type *heap;
+    block_type local[inline_blocks];
+
+    void allocate() {
+        if (nblocks > inline_blocks) heap = new block_type[nblocks];
+    }
+
+    void zeroUnusedBits() {
+        size_t extra = nbits % bits_per_block;
+        if (extra) data()[nblocks - 1] &= (block_type(1) << extra) - 1;
+    }
+
+    size_t findFrom(size_t block) const {
+        const block_type *d = data();
+        for (; block < nblocks; ++block) {
+            if (d[block]) return block * bits_per_block + __builtin_ctzll(d[block]);
+        }
+        return npos;
+    }
+};
+
+#endif /* __SPLIT_BITSET_H__ */
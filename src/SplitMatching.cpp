@@ -0,0 +1,176 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "SplitMatching.h"
+#include "bitset_hash.h"
+#include <cmath>
+
+using namespace std;
+
+const size_t SplitTable::npos;
+const size_t SplitMatching::npos;
+
+SplitTable::SplitTable() {
+}
+
+SplitTable::SplitTable(const vector<PhyloTreeEdge> &edges) {
+    assign(edges);
+}
+
+void SplitTable::assign(const vector<PhyloTreeEdge> &edges) {
+    size_t capacity = 2;
+    while (capacity < 2 * edges.size()) {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    BitsetHash hasher;
+    table.assign(capacity, npos);
+    slots.resize(edges.size());
+    hashes.resize(edges.size());
+    for (size_t j = 0; j < edges.size(); ++j) {
+        auto &split = edges[j].getPartition();
+        hashes[j] = hasher(split);
+        size_t s = find(edges, split, hashes[j]);
+        if (table[s] == npos) {
+            table[s] = j;
+        }
+        slots[j] = s;
+    }
+}
+
+size_t SplitTable::find(const vector<PhyloTreeEdge> &edges, const SplitBitset &split, size_t hash) const {
+    size_t s = hash & mask;
+    while (table[s] != npos && !(edges[table[s]].getPartition() == split)) {
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+SplitMatching::SplitMatching() {
+}
+
+SplitMatching::SplitMatching(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2) {
+    match(edges1, edges2);
+}
+
+void SplitMatching::match(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2) {
+    ownTable2.assign(edges2);
+    match(edges1, edges2, ownTable2);
+}
+
+void SplitMatching::match(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2,
+                          const SplitTable &table2, const CompatibilityIndex *compatibility2) {
+    this->edges1 = &edges1;
+    this->edges2 = &edges2;
+    this->table2 = &table2;
+    given1 = nullptr;
+    given2 = compatibility2;
+    BitsetHash hasher;
+    hashes1.resize(edges1.size());
+    for (size_t i = 0; i < edges1.size(); ++i) {
+        hashes1[i] = hasher(edges1[i].getPartition());
+    }
+    join(hashes1.data());
+}
+
+void SplitMatching::match(const vector<PhyloTreeEdge> &edges1, const SplitTable &table1,
+                          const vector<PhyloTreeEdge> &edges2, const SplitTable &table2,
+                          const CompatibilityIndex *compatibility1, const CompatibilityIndex *compatibility2) {
+    this->edges1 = &edges1;
+    this->edges2 = &edges2;
+    this->table2 = &table2;
+    given1 = compatibility1;
+    given2 = compatibility2;
+    hashes1.resize(edges1.size());
+    for (size_t i = 0; i < edges1.size(); ++i) {
+        hashes1[i] = table1.hashOf(i);
+    }
+    join(hashes1.data());
+}
+
+void SplitMatching::join(const size_t *hashes) {
+    hit.assign(table2->capacity(), 0);
+    common = 0;
+    partner1.resize(edges1->size());
+    for (size_t i = 0; i < edges1->size(); ++i) {
+        size_t s = table2->find(*edges2, (*edges1)[i].getPartition(), hashes[i]);
+        partner1[i] = table2->at(s);
+        if (partner1[i] != npos) {
+            hit[s] = 1;
+            common++;
+        }
+    }
+}
+
+size_t SplitMatching::numOnlyIn2() const {
+    size_t count = 0;
+    for (size_t j = 0; j < edges2->size(); ++j) {
+        count += !hit[table2->slotOf(j)];
+    }
+    return count;
+}
+
+size_t SplitMatching::largest(const vector<PhyloTreeEdge> &edges) {
+    size_t best = 0;
+    for (size_t i = 1; i < edges.size(); ++i) {
+        if (edges[best] < edges[i]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Sums of |d| and d^2 over the length differences d that the weighted RF and Euclidean distances add up:
+ * l1 - l2 for each common split and l for each split in only one tree. A split in one tree that is also
+ * compatible with the other is counted a second time, as it is returned by PhyloTree::getCommonEdges as
+ * well; like that merge, this only reaches splits no larger than the largest split of either tree.
+ */
+void SplitMatching::getDifferenceSums(double &absSum, double &squareSum) {
+    absSum = 0;
+    squareSum = 0;
+    auto add = [&](double d, int times) {
+        absSum += times * std::abs(d);
+        squareSum += times * d * d;
+    };
+    bool indexed = false;
+    const CompatibilityIndex *compatibility1 = given1, *compatibility2 = given2;
+    const PhyloTreeEdge *bound = nullptr;
+    if (!edges1->empty() && !edges2->empty()) {
+        const PhyloTreeEdge &max1 = (*edges1)[largest(*edges1)];
+        const PhyloTreeEdge &max2 = (*edges2)[largest(*edges2)];
+        bound = max1 < max2 ? &max1 : &max2;
+    }
+    // other by reference, as the pointers are only filled in on first use
+    auto timesCounted = [&](const PhyloTreeEdge &edge, const CompatibilityIndex *const &other) {
+        if (!bound || *bound < edge) {
+            return 1;
+        }
+        if (!indexed) {
+            if (!compatibility1) {
+                index1.assign(*edges1);
+                compatibility1 = &index1;
+            }
+            if (!compatibility2) {
+                index2.assign(*edges2);
+                compatibility2 = &index2;
+            }
+            indexed = true;
+        }
+        return other->isCompatibleWith(edge.getPartition()) ? 2 : 1;
+    };
+    for (size_t i = 0; i < edges1->size(); ++i) {
+        const PhyloTreeEdge &edge = (*edges1)[i];
+        if (partner1[i] != npos) {
+            add(edge.getLength() - (*edges2)[partner1[i]].getLength(), 1);
+        } else {
+            add(edge.getLength(), timesCounted(edge, compatibility2));
+        }
+    }
+    for (size_t j = 0; j < edges2->size(); ++j) {
+        if (!isMatched2(j)) {
+            const PhyloTreeEdge &edge = (*edges2)[j];
+            add(edge.getLength(), timesCounted(edge, compatibility1));
+        }
+    }
+}
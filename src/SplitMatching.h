@@ -0,0 +1,110 @@
+#ifndef __SPLIT_MATCHING_H__
+#define __SPLIT_MATCHING_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "CompatibilityIndex.h"
+#include "PhyloTreeEdge.h"
+#include "SplitBitset.h"
+#include <vector>
+
+using namespace std;
+
+/*
+ * An open-addressing table of the splits of one tree, keyed by SplitBitset::hash (as BitsetHash), with the
+ * hash of every split kept alongside. The table only refers to the edges by index, so it stays valid while
+ * they are moved around, and once built it is only read: any number of SplitMatchings, on any threads, may
+ * join against it.
+ */
+class SplitTable {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    SplitTable();
+
+    explicit SplitTable(const vector<PhyloTreeEdge> &edges);
+
+    void assign(const vector<PhyloTreeEdge> &edges);
+
+    size_t size() const { return hashes.size(); }
+
+    size_t capacity() const { return table.size(); }
+
+    size_t hashOf(size_t j) const { return hashes[j]; }
+
+    size_t slotOf(size_t j) const { return slots[j]; }
+
+    /* The index in edges of the split in a slot, npos if the slot is empty */
+    size_t at(size_t slot) const { return table[slot]; }
+
+    /* The slot holding the split, or the empty slot where it would go; edges are those the table was built on */
+    size_t find(const vector<PhyloTreeEdge> &edges, const SplitBitset &split, size_t hash) const;
+
+private:
+    size_t mask = 0;
+    vector<size_t> table; // slot -> index in edges, npos if empty
+    vector<size_t> slots; // per split, the slot holding its split
+    vector<size_t> hashes;
+};
+
+/*
+ * Hash join of the splits of two trees.
+ *
+ * The splits of the second tree go into a SplitTable; each split of the first tree then finds its partner
+ * with one probe sequence. Tables built beforehand, e.g. by PreparedTree, can be joined directly, which saves
+ * rebuilding the second tree's table and rehashing the first tree's splits for every pair. The edge vectors
+ * and tables must outlive the matching. Buffers are kept between calls to match.
+ */
+class SplitMatching {
+public:
+    static const size_t npos = SplitTable::npos;
+
+    SplitMatching();
+
+    SplitMatching(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2);
+
+    void match(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2);
+
+    /* Joins edges1 against a table of edges2 built beforehand, with edges2's compatibility index if given */
+    void match(const vector<PhyloTreeEdge> &edges1, const vector<PhyloTreeEdge> &edges2, const SplitTable &table2,
+               const CompatibilityIndex *compatibility2 = nullptr);
+
+    /*
+     * Joins edges1 and edges2 through their tables. Compatibility indexes of either tree, if given, are used
+     * by getDifferenceSums instead of building them.
+     */
+    void match(const vector<PhyloTreeEdge> &edges1, const SplitTable &table1, const vector<PhyloTreeEdge> &edges2,
+               const SplitTable &table2, const CompatibilityIndex *compatibility1 = nullptr,
+               const CompatibilityIndex *compatibility2 = nullptr);
+
+    size_t numCommon() const { return common; }
+
+    size_t numOnlyIn1() const { return edges1->size() - common; }
+
+    size_t numOnlyIn2() const;
+
+    size_t partnerOf1(size_t i) const { return partner1[i]; }
+
+    bool isMatched2(size_t j) const { return hit[table2->slotOf(j)]; }
+
+    void getDifferenceSums(double &absSum, double &squareSum);
+
+private:
+    const vector<PhyloTreeEdge> *edges1 = nullptr;
+    const vector<PhyloTreeEdge> *edges2 = nullptr;
+    const SplitTable *table2 = nullptr;
+    const CompatibilityIndex *given1 = nullptr;
+    const CompatibilityIndex *given2 = nullptr;
+    size_t common = 0;
+    SplitTable ownTable2;
+    vector<size_t> hashes1;
+    vector<char> hit; // per slot of table2, whether a split of edges1 matched it
+    vector<size_t> partner1; // per split of edges1, index of the equal split in edges2 or npos
+    CompatibilityIndex index1, index2;
+
+    void join(const size_t *hashes);
+
+    static size_t largest(const vector<PhyloTreeEdge> &edges);
+};
+
+#endif /* __SPLIT_MATCHING_H__ */
@@ -0,0 +1,158 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "SplitMatrix.h"
+#include "CompatibilityIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+SplitMatrix::SplitMatrix() {
+}
+
+SplitMatrix::SplitMatrix(const vector<PhyloTreeEdge> &edges, size_t numLeaves) {
+    assign(edges, numLeaves);
+}
+
+/*
+ * (Re)fill the matrix from a set of edges, reusing the existing buffers. Edges that are already sorted
+ * (as in Geodesic::getGeodesicNoCommonEdges) are copied straight through without building an order.
+ *
+ * Edges of the subtrees built by Geodesic::splitOnCommonEdge keep the bitset width of the tree they came
+ * from, so rows are sized from the edges themselves rather than from numLeaves.
+ */
+void SplitMatrix::assign(const vector<PhyloTreeEdge> &edges, size_t numLeaves) {
+    nLeaves = numLeaves;
+    nBits = edges.empty() ? numLeaves : edges.front().getPartition().size();
+    stride = SplitBitset::blocksFor(nBits);
+    words.resize(edges.size() * stride);
+    lengths.clear();
+    originalIDs.clear();
+    leafEdgeLengths.clear();
+    lengths.reserve(edges.size());
+    originalIDs.reserve(edges.size());
+
+    auto addRow = [this](const PhyloTreeEdge &edge) {
+        auto &partition = edge.getPartition();
+        std::copy(partition.data(), partition.data() + stride, words.begin() + lengths.size() * stride);
+        lengths.push_back(edge.getLength());
+        originalIDs.push_back(edge.getOriginalID());
+    };
+    if (std::is_sorted(edges.begin(), edges.end())) {
+        for (auto &edge : edges) {
+            addRow(edge);
+        }
+        return;
+    }
+    vector<size_t> order(edges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&edges](size_t i, size_t j) { return edges[i] < edges[j]; });
+    for (size_t i : order) {
+        addRow(edges[i]);
+    }
+}
+
+SplitMatrix::SplitMatrix(const vector<PhyloTreeEdge> &edges, size_t numLeaves, const vector<double> &leafEdgeLengths) :
+        SplitMatrix(edges, numLeaves) {
+    this->leafEdgeLengths = leafEdgeLengths;
+}
+
+SplitBitset SplitMatrix::getSplit(size_t i) const {
+    return SplitBitset(nBits, split(i));
+}
+
+PhyloTreeEdge SplitMatrix::getEdge(size_t i) const {
+    return PhyloTreeEdge(getSplit(i), lengths[i], originalIDs[i]);
+}
+
+double SplitMatrix::getDistanceFromOrigin() const {
+    double dist = 0;
+    for (double length : lengths) {
+        dist += length * length;
+    }
+    for (double length : leafEdgeLengths) {
+        dist += length * length;
+    }
+    return std::sqrt(dist);
+}
+
+double SplitMatrix::getBranchLengthSum() const {
+    return std::accumulate(lengths.begin(), lengths.end(), 0.0) +
+           std::accumulate(leafEdgeLengths.begin(), leafEdgeLengths.end(), 0.0);
+}
+
+// Ordering of two rows, most significant word first (as SplitBitset::operator<)
+int SplitMatrix::compare(const block_type *a, const block_type *b, size_t nwords) {
+    for (size_t i = nwords; i > 0; --i) {
+        if (a[i - 1] != b[i - 1]) return a[i - 1] < b[i - 1] ? -1 : 1;
+    }
+    return 0;
+}
+
+bool SplitMatrix::crosses(const block_type *a, const block_type *b, size_t nwords) {
+    block_type both = 0, onlyA = 0, onlyB = 0;
+    for (size_t i = 0; i < nwords; ++i) {
+        both |= a[i] & b[i];
+        onlyA |= a[i] & ~b[i];
+        onlyB |= b[i] & ~a[i];
+    }
+    return both && onlyA && onlyB;
+}
+
+bool SplitMatrix::isCompatibleWith(const block_type *s) const {
+    const block_type *row = words.data();
+    for (size_t i = 0; i < numSplits(); ++i, row += stride) {
+        if (crosses(s, row, stride)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SplitMatrix::getEdgesNotInCommonWith(const SplitMatrix &other, vector<PhyloTreeEdge> &dest) const {
+    size_t i = 0, j = 0;
+    while (i < numSplits()) {
+        int cmp = j < other.numSplits() ? compare(split(i), other.split(j), stride) : -1;
+        if (cmp < 0) {
+            dest.push_back(getEdge(i++));
+        } else if (cmp > 0) {
+            ++j;
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+}
+
+/*
+ * Same output as PhyloTree::getCommonEdges: splits present in both trees (with the difference in length),
+ * plus splits of either tree that are compatible with every split of the other tree.
+ */
+void SplitMatrix::getCommonEdges(const SplitMatrix &m1, const SplitMatrix &m2, vector<PhyloTreeEdge> &dest) {
+    getCommonEdges(m1, CompatibilityIndex(m1), m2, CompatibilityIndex(m2), dest);
+}
+
+void SplitMatrix::getCommonEdges(const SplitMatrix &m1, const CompatibilityIndex &index1, const SplitMatrix &m2,
+                                 const CompatibilityIndex &index2, vector<PhyloTreeEdge> &dest) {
+    size_t i = 0, j = 0, stride = m1.stride;
+    while (i < m1.numSplits() && j < m2.numSplits()) {
+        int cmp = compare(m1.split(i), m2.split(j), stride);
+        if (cmp < 0) {
+            if (index2.isCompatibleWith(m1.split(i))) {
+                dest.push_back(m1.getEdge(i));
+            }
+            ++i;
+        } else {
+            if (cmp == 0) {
+                dest.emplace_back(m1.getSplit(i), m1.lengths[i] - m2.lengths[j], m1.originalIDs[i]);
+                ++i;
+            }
+            else if (index1.isCompatibleWith(m2.split(j))) {
+                dest.push_back(m2.getEdge(j));
+            }
+            ++j;
+        }
+    }
+}
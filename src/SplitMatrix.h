@@ -0,0 +1,83 @@
+#ifndef __SPLIT_MATRIX_H__
+#define __SPLIT_MATRIX_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "PhyloTreeEdge.h"
+#include "SplitBitset.h"
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class CompatibilityIndex;
+
+/*
+ * Structure-of-arrays view of a set of splits.
+ *
+ * Split words are stored row-major in one contiguous array (wordsPerSplit() words per row), with
+ * parallel arrays of lengths and original IDs. Rows are kept in ascending split order (the order
+ * std::sort gives a vector<PhyloTreeEdge>), so two matrices can be joined with a single linear merge.
+ */
+class SplitMatrix {
+public:
+    typedef SplitBitset::block_type block_type;
+
+    SplitMatrix();
+
+    SplitMatrix(const vector<PhyloTreeEdge> &edges, size_t numLeaves);
+
+    SplitMatrix(const vector<PhyloTreeEdge> &edges, size_t numLeaves, const vector<double> &leafEdgeLengths);
+
+    void assign(const vector<PhyloTreeEdge> &edges, size_t numLeaves);
+
+    size_t numSplits() const { return lengths.size(); }
+
+    size_t numLeaves() const { return nLeaves; }
+
+    size_t wordsPerSplit() const { return stride; }
+
+    const block_type *split(size_t i) const { return words.data() + i * stride; }
+
+    double length(size_t i) const { return lengths[i]; }
+
+    int originalID(size_t i) const { return originalIDs[i]; }
+
+    const vector<double> &getLengths() const { return lengths; }
+
+    const vector<int> &getOriginalIDs() const { return originalIDs; }
+
+    const vector<double> &getLeafEdgeLengths() const { return leafEdgeLengths; }
+
+    SplitBitset getSplit(size_t i) const;
+
+    PhyloTreeEdge getEdge(size_t i) const;
+
+    double getDistanceFromOrigin() const;
+
+    double getBranchLengthSum() const;
+
+    void getEdgesNotInCommonWith(const SplitMatrix &other, vector<PhyloTreeEdge> &dest) const;
+
+    bool isCompatibleWith(const block_type *split) const;
+
+    static void getCommonEdges(const SplitMatrix &m1, const SplitMatrix &m2, vector<PhyloTreeEdge> &dest);
+
+    static void getCommonEdges(const SplitMatrix &m1, const CompatibilityIndex &index1, const SplitMatrix &m2,
+                               const CompatibilityIndex &index2, vector<PhyloTreeEdge> &dest);
+
+    static int compare(const block_type *a, const block_type *b, size_t nwords);
+
+    static bool crosses(const block_type *a, const block_type *b, size_t nwords);
+
+private:
+    size_t nLeaves = 0;
+    size_t nBits = 0;
+    size_t stride = 0;
+    vector<block_type> words;
+    vector<double> lengths;
+    vector<int> originalIDs;
+    vector<double> leafEdgeLengths;
+};
+
+#endif /* __SPLIT_MATRIX_H__ */
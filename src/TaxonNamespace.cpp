@@ -0,0 +1,62 @@
+#include "TaxonNamespace.h"
+#include "PhyloTree.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+atomic<size_t> TaxonNamespace::nextID(1);
+
+TaxonNamespace::TaxonNamespace(vector<string> labels) : id(nextID++), labels(std::move(labels)) {
+    std::sort(this->labels.begin(), this->labels.end());
+    if (std::adjacent_find(this->labels.begin(), this->labels.end()) != this->labels.end()) {
+        throw invalid_argument("Duplicate label in taxon namespace");
+    }
+    index.reserve(this->labels.size());
+    for (size_t i = 0; i < this->labels.size(); ++i) {
+        index[this->labels[i]] = (int) i;
+    }
+}
+
+/*
+ * Build a namespace from the leaf labels of a newick string (e.g. the first tree of a collection)
+ */
+shared_ptr<const TaxonNamespace> TaxonNamespace::fromNewick(const string &newick) {
+    PhyloTree tree(newick, false);
+    return make_shared<const TaxonNamespace>(tree.getLeaf2NumMap());
+}
+
+size_t TaxonNamespace::getID() const {
+    return id;
+}
+
+size_t TaxonNamespace::size() const {
+    return labels.size();
+}
+
+const vector<string> &TaxonNamespace::getLabels() const {
+    return labels;
+}
+
+int TaxonNamespace::indexOf(const string &label) const {
+    auto it = index.find(label);
+    return it == index.end() ? -1 : it->second;
+}
+
+uint64_t TaxonNamespace::hash() const {
+    return hash(labels);
+}
+
+/*
+ * FNV-1a over the labels and their terminating nulls; the labels are hashed in the order given, which for
+ * leaf2NumMaps and namespaces is sorted
+ */
+uint64_t TaxonNamespace::hash(const vector<string> &labels) {
+    uint64_t h = 14695981039346656037ULL;
+    for (auto &label : labels) {
+        for (size_t k = 0; k <= label.size(); ++k) {
+            h = (h ^ (unsigned char) label.c_str()[k]) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
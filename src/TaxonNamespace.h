@@ -0,0 +1,47 @@
+#ifndef __TAXON_NAMESPACE_H__
+#define __TAXON_NAMESPACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A fixed, sorted set of taxon labels shared by a collection of trees.
+ *
+ * Each namespace gets a process-unique non-zero ID. Trees parsed against the same namespace have
+ * identical leaf2NumMaps by construction, so their leaf sets can be checked for compatibility by
+ * comparing namespace IDs instead of comparing label vectors string by string.
+ */
+class TaxonNamespace {
+public:
+    TaxonNamespace(vector<string> labels);
+
+    static shared_ptr<const TaxonNamespace> fromNewick(const string &newick);
+
+    size_t getID() const;
+
+    size_t size() const;
+
+    const vector<string> &getLabels() const;
+
+    int indexOf(const string &label) const;
+
+    /* A hash of the labels that, unlike getID, is the same in every process, for files shared between runs */
+    uint64_t hash() const;
+
+    static uint64_t hash(const vector<string> &labels);
+
+private:
+    size_t id;
+    vector<string> labels;
+    unordered_map<string, int> index;
+
+    static atomic<size_t> nextID;
+};
+
+#endif /* __TAXON_NAMESPACE_H__ */
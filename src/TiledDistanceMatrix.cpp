@@ -0,0 +1,360 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "TiledDistanceMatrix.h"
+#include "CondensedMatrixFile.h"
+#include "GeodesicCostModel.h"
+#include "WorkStealingScheduler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MANIFEST_MAGIC[] = "cgtp-tiled-distance-matrix 1";
+
+static runtime_error systemError(const string &what, const string &path) {
+    return runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+/* FNV-1a, so the fingerprint does not depend on the standard library's hashes */
+static void mix(uint64_t &h, const void *data, size_t length) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t k = 0; k < length; ++k) {
+        h = (h ^ bytes[k]) * 1099511628211ULL;
+    }
+}
+
+TiledDistanceMatrix::TiledDistanceMatrix(const string &directory, const vector<PhyloTree> &trees,
+                                         DistanceMetric metric, bool normalise, size_t memoryBudget,
+                                         MatrixDtype dtype)
+        : directory(directory), trees(trees), metric(metric), normalise(normalise), block(0), matrix(),
+          preparedBlock(0), preparedRow() {
+    for (size_t i = 1; i < trees.size(); ++i) {
+        if (!trees[0].hasSameLeaves(trees[i])) {
+            throw runtime_error("leaf2NumMaps are not equal");
+        }
+    }
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw systemError("Cannot create", directory);
+    }
+    openRun(memoryBudget, dtype);
+    preparedBlock = numBlocks();
+}
+
+TiledDistanceMatrix::~TiledDistanceMatrix() = default;
+
+size_t TiledDistanceMatrix::size() const {
+    return trees.size();
+}
+
+size_t TiledDistanceMatrix::blockSize() const {
+    return block;
+}
+
+size_t TiledDistanceMatrix::numBlocks() const {
+    return (trees.size() + block - 1) / block;
+}
+
+const CondensedMatrixFile &TiledDistanceMatrix::getMatrix() const {
+    return *matrix;
+}
+
+size_t TiledDistanceMatrix::numTiles() const {
+    return numBlocks() * (numBlocks() + 1) / 2;
+}
+
+size_t TiledDistanceMatrix::numFinishedTiles() const {
+    size_t finished = 0;
+    for (size_t I = 0; I < numBlocks(); ++I) {
+        for (size_t J = I; J < numBlocks(); ++J) {
+            if (isFinished(I, J)) finished++;
+        }
+    }
+    return finished;
+}
+
+bool TiledDistanceMatrix::isComplete() const {
+    return numFinishedTiles() == numTiles();
+}
+
+size_t TiledDistanceMatrix::run(size_t numThreads, size_t maxTiles) {
+    size_t computed = 0;
+    for (size_t I = 0; I < numBlocks(); ++I) {
+        for (size_t J = I; J < numBlocks(); ++J) {
+            if (maxTiles > 0 && computed == maxTiles) return computed;
+            if (isFinished(I, J)) continue;
+            int lock = claim(I, J);
+            if (lock < 0) continue;
+            try {
+                computeTile(I, J, numThreads);
+                // an empty marker: the tile's entries are already written through to the matrix
+                int marker = open(tilePath(I, J).c_str(), O_CREAT | O_WRONLY, 0666);
+                if (marker < 0) {
+                    throw systemError("Cannot create", tilePath(I, J));
+                }
+                close(marker);
+            }
+            catch (...) {
+                close(lock);
+                throw;
+            }
+            // the tile is marked before the lock goes, so whoever opens the lock file next sees it finished
+            unlink((tilePath(I, J) + ".lock").c_str());
+            close(lock);
+            computed++;
+        }
+    }
+    return computed;
+}
+
+vector<double> TiledDistanceMatrix::assemble() const {
+    for (size_t I = 0; I < numBlocks(); ++I) {
+        for (size_t J = I; J < numBlocks(); ++J) {
+            if (!isFinished(I, J)) {
+                throw runtime_error("Tile " + to_string(I) + "," + to_string(J) + " of " + directory +
+                                    " is not finished");
+            }
+        }
+    }
+    vector<double> condensed(matrix->numEntries());
+    for (size_t k = 0; k < condensed.size(); ++k) {
+        condensed[k] = matrix->get(k);
+    }
+    return condensed;
+}
+
+bool TiledDistanceMatrix::readTile(size_t I, size_t J, vector<double> &condensed) const {
+    if (!isFinished(I, J)) return false;
+    const size_t n = trees.size();
+    for (size_t i = blockBegin(I); i < blockEnd(I); ++i) {
+        for (size_t j = (I == J ? i + 1 : blockBegin(J)); j < blockEnd(J); ++j) {
+            size_t k = Distance::condensedIndex(n, i, j);
+            condensed[k] = matrix->get(k);
+        }
+    }
+    return true;
+}
+
+size_t TiledDistanceMatrix::blockSizeFor(const vector<PhyloTree> &trees, size_t memoryBudget) {
+    if (trees.empty()) return 1;
+    // the largest prepared tree: its edges, their splits past the inline words, and its leaves
+    double treeBytes = 0;
+    for (auto &tree : trees) {
+        size_t leaves = tree.getLeafEdgeLengthsByRef().size();
+        size_t words = (leaves + 63) / 64;
+        size_t heapWords = words > CGTP_SPLIT_INLINE_BLOCKS ? words : 0;
+        double bytes = sizeof(PhyloTree) + tree.getEdgesByRef().size() * (sizeof(PhyloTreeEdge) + 8 * heapWords) +
+                       leaves * (sizeof(double) + sizeof(string) + 16);
+        treeBytes = max(treeBytes, bytes);
+    }
+    // a tile of b x b distances and the 2b prepared trees of its blocks: 8 b^2 + 2 b treeBytes <= budget
+    double b = (-2 * treeBytes + sqrt(4 * treeBytes * treeBytes + 32.0 * memoryBudget)) / 16;
+    return max<size_t>(1, min<size_t>(trees.size(), (size_t) b));
+}
+
+uint64_t TiledDistanceMatrix::fingerprint(const vector<PhyloTree> &trees) {
+    uint64_t h = 14695981039346656037ULL;
+    uint64_t count = trees.size();
+    mix(h, &count, sizeof(count));
+    if (!trees.empty()) {
+        for (auto &label : trees[0].getLeaf2NumMap()) {
+            mix(h, label.data(), label.size() + 1);
+        }
+    }
+    for (auto &tree : trees) {
+        auto &leafLengths = tree.getLeafEdgeLengthsByRef();
+        mix(h, leafLengths.data(), leafLengths.size() * sizeof(double));
+        // the splits in a canonical order, so that sorting a tree's edges does not change its fingerprint
+        vector<pair<size_t, double>> edges;
+        edges.reserve(tree.getEdgesByRef().size());
+        for (auto &edge : tree.getEdgesByRef()) {
+            edges.emplace_back(edge.getPartition().hash(), edge.getLength());
+        }
+        sort(edges.begin(), edges.end());
+        for (auto &edge : edges) {
+            uint64_t split = edge.first;
+            mix(h, &split, sizeof(split));
+            mix(h, &edge.second, sizeof(edge.second));
+        }
+    }
+    return h;
+}
+
+void TiledDistanceMatrix::openRun(size_t memoryBudget, MatrixDtype dtype) {
+    const string path = directory + "/manifest";
+    const uint64_t print = fingerprint(trees);
+    const uint64_t taxonHash = trees.empty() ? 0 : TaxonNamespace::hash(trees[0].getLeaf2NumMap());
+
+    // the first process creates the matrix and then the manifest; the lock makes the others wait for both
+    const string lockPath = path + ".lock";
+    int lock = open(lockPath.c_str(), O_CREAT | O_RDWR, 0666);
+    if (lock < 0 || flock(lock, LOCK_EX) != 0) {
+        if (lock >= 0) close(lock);
+        throw systemError("Cannot lock", lockPath);
+    }
+    try {
+        if (access(path.c_str(), F_OK) != 0) {
+            CondensedMatrixFile(matrixPath(), trees.size(), metric, normalise, dtype, taxonHash);
+            const string tmp = path + ".tmp";
+            {
+                ofstream out(tmp, ios::trunc);
+                out << MANIFEST_MAGIC << "\n"
+                    << "trees " << trees.size() << "\n"
+                    << "metric " << static_cast<int>(metric) << "\n"
+                    << "normalise " << normalise << "\n"
+                    << "block " << blockSizeFor(trees, memoryBudget) << "\n"
+                    << "fingerprint " << print << "\n";
+                if (!out.flush()) {
+                    throw systemError("Cannot write", tmp);
+                }
+            }
+            if (rename(tmp.c_str(), path.c_str()) != 0) {
+                throw systemError("Cannot create", path);
+            }
+        }
+    }
+    catch (...) {
+        close(lock);
+        throw;
+    }
+    close(lock);
+
+    ifstream in(path);
+    string magic, key;
+    size_t numTrees = 0, blockSize = 0;
+    int storedMetric = -1;
+    bool storedNormalise = false;
+    uint64_t storedPrint = 0;
+    getline(in, magic);
+    in >> key >> numTrees >> key >> storedMetric >> key >> storedNormalise >> key >> blockSize >> key >> storedPrint;
+    if (!in || magic != MANIFEST_MAGIC || blockSize == 0) {
+        throw runtime_error("Cannot read " + path);
+    }
+    if (numTrees != trees.size() || storedMetric != static_cast<int>(metric) || storedNormalise != normalise ||
+        storedPrint != print) {
+        throw runtime_error("The run in " + directory + " was started with other trees or settings");
+    }
+    block = blockSize;
+
+    matrix.reset(new CondensedMatrixFile(matrixPath(), true));
+    if (matrix->size() != trees.size() || matrix->getMetric() != metric || matrix->isNormalised() != normalise ||
+        matrix->getTaxonHash() != taxonHash) {
+        throw runtime_error(matrixPath() + " does not belong to the run in " + directory);
+    }
+}
+
+string TiledDistanceMatrix::matrixPath() const {
+    return directory + "/matrix";
+}
+
+size_t TiledDistanceMatrix::blockBegin(size_t I) const {
+    return I * block;
+}
+
+size_t TiledDistanceMatrix::blockEnd(size_t I) const {
+    return min(trees.size(), (I + 1) * block);
+}
+
+string TiledDistanceMatrix::tilePath(size_t I, size_t J) const {
+    return directory + "/tile_" + to_string(I) + "_" + to_string(J);
+}
+
+bool TiledDistanceMatrix::isFinished(size_t I, size_t J) const {
+    return access(tilePath(I, J).c_str(), F_OK) == 0;
+}
+
+/*
+ * An flock on the tile's lock file: the kernel drops it when the holder exits, however it exits, so the lock
+ * of a crashed worker needs no cleaning up. Returns the locked descriptor, or -1 if the tile is taken or done.
+ */
+int TiledDistanceMatrix::claim(size_t I, size_t J) const {
+    const string path = tilePath(I, J) + ".lock";
+    int fd = open(path.c_str(), O_CREAT | O_RDWR, 0666);
+    if (fd < 0) {
+        throw systemError("Cannot open", path);
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        int error = errno;
+        close(fd);
+        if (error == EWOULDBLOCK) return -1;
+        errno = error;
+        throw systemError("Cannot lock", path);
+    }
+    // the previous holder may have finished between our check and our lock
+    if (isFinished(I, J)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void TiledDistanceMatrix::prepare(size_t I, vector<PhyloTree> &dest) const {
+    dest.assign(trees.begin() + blockBegin(I), trees.begin() + blockEnd(I));
+    for (auto &tree : dest) {
+        tree.sortEdges();
+    }
+}
+
+void TiledDistanceMatrix::computeTile(size_t I, size_t J, size_t numThreads) {
+    if (preparedBlock != I) {
+        prepare(I, preparedRow);
+        preparedBlock = I;
+    }
+    vector<PhyloTree> preparedColumn;
+    if (J != I) {
+        prepare(J, preparedColumn);
+    }
+    vector<PhyloTree> &rows = preparedRow;
+    vector<PhyloTree> &columns = J == I ? preparedRow : preparedColumn;
+
+    // the pairs of the tile in row order, as readTile expects them
+    vector<pair<uint32_t, uint32_t>> pairs;
+    for (size_t a = 0; a < rows.size(); ++a) {
+        for (size_t b = (J == I ? a + 1 : 0); b < columns.size(); ++b) {
+            pairs.emplace_back(a, b);
+        }
+    }
+    if (pairs.empty()) return;
+
+    // the pairs write straight into the matrix; distinct entries never share bytes, so threads need no lock
+    const size_t n = trees.size();
+    const size_t rowBegin = blockBegin(I), columnBegin = blockBegin(J);
+    auto index = [&](size_t k) {
+        return Distance::condensedIndex(n, rowBegin + pairs[k].first, columnBegin + pairs[k].second);
+    };
+    WorkStealingScheduler scheduler(numThreads);
+    vector<GeodesicWorkspace> workspaces(scheduler.numThreads());
+    auto pairDistance = [&](size_t k, size_t thread) {
+        matrix->set(index(k), Distance::getDistance(rows[pairs[k].first], columns[pairs[k].second], metric,
+                                                    normalise, workspaces[thread]));
+    };
+    if (metric == DistanceMetric::Geodesic) {
+        GeodesicCostModel model(rows);
+        if (J != I) {
+            for (auto &tree : columns) {
+                model.add(tree);
+            }
+        }
+        const size_t offset = J == I ? 0 : rows.size();
+        vector<double> costs(pairs.size());
+        scheduler.run(pairs.size(), [&](size_t k, size_t) {
+            costs[k] = model.estimate(pairs[k].first, offset + pairs[k].second);
+        });
+        scheduler.run(costs, pairDistance);
+    }
+    else {
+        scheduler.run(pairs.size(), pairDistance);
+    }
+
+    // the pairs are in condensed order, so the tile lies between its first and last entry
+    matrix->release(index(0), index(pairs.size() - 1) + 1);
+}
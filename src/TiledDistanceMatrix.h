@@ -0,0 +1,116 @@
+#ifndef __TILED_DISTANCE_MATRIX_H__
+#define __TILED_DISTANCE_MATRIX_H__
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+
+#include "CondensedMatrixFile.h"
+#include "Distance.h"
+#include "PhyloTree.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * A condensed distance matrix computed tile by tile in a run directory, for collections too large to finish
+ * in one go. The trees are cut into blocks of blockSize() consecutive trees; tile (I, J), I <= J, holds the
+ * distances between the trees of blocks I and J (only the pairs i < j when I == J).
+ *
+ * Any number of processes on the same machine may work on one directory with the same trees and settings.
+ * They all write into the directory's CondensedMatrixFile, "matrix". A process claims a tile by locking its
+ * lock file, computes it straight into the matrix, writes those entries through to disk and only then marks
+ * the tile finished. A lock is dropped with the process that held it, however that process ends, and
+ * finished tiles are never computed again: a run that is interrupted resumes where it stopped. The
+ * directory's manifest records the settings and a fingerprint of the trees, and a process whose trees or
+ * settings differ is refused.
+ *
+ * Tiles are claimed in row order, so consecutive tiles of a process share the trees of block I; those stay
+ * prepared (see PhyloTree::sortEdges) between tiles, and only block J's trees are prepared again.
+ */
+class TiledDistanceMatrix {
+public:
+    /*
+     * Opens or starts the run in directory, which is created if needed. The block size is the largest for
+     * which a tile's distances and the prepared trees of its two blocks fit in memoryBudget bytes; a run that
+     * is already started keeps the block size and dtype it was started with.
+     *
+     * The trees are not copied and must outlive this object; run, assemble and the accessors read them.
+     */
+    TiledDistanceMatrix(const string &directory, const vector<PhyloTree> &trees, DistanceMetric metric,
+                        bool normalise, size_t memoryBudget, MatrixDtype dtype = MatrixDtype::Float64);
+
+    /* A temporary collection would be gone before run */
+    TiledDistanceMatrix(const string &directory, vector<PhyloTree> &&trees, DistanceMetric metric, bool normalise,
+                        size_t memoryBudget, MatrixDtype dtype = MatrixDtype::Float64) = delete;
+
+    ~TiledDistanceMatrix();
+
+    /* The matrix file of the run; an entry is final once its tile is finished */
+    const CondensedMatrixFile &getMatrix() const;
+
+    size_t size() const;
+
+    size_t blockSize() const;
+
+    size_t numBlocks() const;
+
+    size_t numTiles() const;
+
+    /* Tiles marked finished */
+    size_t numFinishedTiles() const;
+
+    bool isComplete() const;
+
+    /*
+     * Claims and computes tiles, each on numThreads threads (0 for one per hardware thread), until no tile is
+     * left unclaimed or maxTiles tiles are done (0 for no limit). Returns the number of tiles computed. Tiles
+     * still locked by other live processes are left to them, so the run may not be complete on return.
+     */
+    size_t run(size_t numThreads = 0, size_t maxTiles = 0);
+
+    /* The whole condensed matrix in memory, in the order of Distance::getDistanceMatrix; throws if a tile is missing */
+    vector<double> assemble() const;
+
+    /* Copies tile (I, J) into a condensed matrix in memory; returns false if the tile is not finished */
+    bool readTile(size_t I, size_t J, vector<double> &condensed) const;
+
+    static size_t blockSizeFor(const vector<PhyloTree> &trees, size_t memoryBudget);
+
+    /* A hash of the labels, splits and lengths of the trees, stable across processes */
+    static uint64_t fingerprint(const vector<PhyloTree> &trees);
+
+private:
+    string directory;
+    const vector<PhyloTree> &trees;
+    DistanceMetric metric;
+    bool normalise;
+    size_t block;
+    unique_ptr<CondensedMatrixFile> matrix;
+
+    // the prepared trees of the block I a process is working through
+    size_t preparedBlock;
+    vector<PhyloTree> preparedRow;
+
+    void openRun(size_t memoryBudget, MatrixDtype dtype);
+
+    string matrixPath() const;
+
+    size_t blockBegin(size_t I) const;
+
+    size_t blockEnd(size_t I) const;
+
+    string tilePath(size_t I, size_t J) const;
+
+    bool isFinished(size_t I, size_t J) const;
+
+    int claim(size_t I, size_t J) const;
+
+    void computeTile(size_t I, size_t J, size_t numThreads);
+
+    void prepare(size_t I, vector<PhyloTree> &dest) const;
+};
+
+#endif /* __TILED_DISTANCE_MATRIX_H__ */
@@ -7,11 +7,11 @@
 //#include <utility>
 #define PRECISION 5
 
-bool Tools::is_leaf(const bitset_t split) {
+bool Tools::is_leaf(const bitset_t &split) {
     return (split.count() == 1 || split.count() == split.size() - 1);
 }
 
-size_t Tools::leaf_index(const bitset_t split) {
+size_t Tools::leaf_index(const bitset_t &split) {
     if (split.count() == 1) {
         return split.size() - split.find_first() - 1;
     }
@@ -23,7 +23,7 @@ size_t Tools::leaf_index(const bitset_t split) {
     }
 }
 
-size_t Tools::leaf_index_nothrow(const bitset_t split) {
+size_t Tools::leaf_index_nothrow(const bitset_t &split) {
     if (split.count() == split.size() - 1) {
         return split.size() - (~split).find_first() - 1;
     } else {
@@ -79,7 +79,7 @@ std::string Tools::double_to_string(double d) {
 //    return pos == std::string::npos ? t.size() : pos;
 //}
 
-string Tools::substring(string s, size_t begin, size_t end) {
+string Tools::substring(const string &s, size_t begin, size_t end) {
     if (begin > end) throw std::invalid_argument("'begin' can't be larger than 'end'");
     try {
         return s.substr(begin, end - begin);
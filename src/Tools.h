@@ -6,15 +6,15 @@
 
 #include <algorithm>
 #include "boost/algorithm/string.hpp"
-#include "boost/dynamic_bitset.hpp"
 #include <deque>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include "SplitBitset.h"
 
 using namespace std;
-using bitset_t = boost::dynamic_bitset<>;
+using bitset_t = SplitBitset;
 
 const string EMPTY("");
 
@@ -84,7 +84,7 @@ public:
 
     static size_t nextIndex(const string &t, size_t i, const char *s);
 
-    static string substring(string s, size_t begin, size_t end);
+    static string substring(const string &s, size_t begin, size_t end);
 
     static void despace(string &s);
 
@@ -129,22 +129,22 @@ public:
         bitset_t result(result_size);
         size_t original_index = 0, result_index = 0, missing_index = 0;
         for (; original_index < original.size(); original_index++) {
-            if (original_index == missing[missing_index]) { // skip this one
+            if (missing_index < missing.size() && original_index == missing[missing_index]) { // skip this one
                 missing_index++;
                 continue;
             }
             else {
-                result[result_size - result_index++ - 1] = original[original_size - original_index - 1];
+                result.set(result_size - result_index++ - 1, original.test(original_size - original_index - 1));
             }
         }
         return std::move(result);
     }
 
-    static bool is_leaf(const bitset_t split);
+    static bool is_leaf(const bitset_t &split);
 
-    static size_t leaf_index(const bitset_t split);
+    static size_t leaf_index(const bitset_t &split);
 
-    static size_t leaf_index_nothrow(const bitset_t split);
+    static size_t leaf_index_nothrow(const bitset_t &split);
 };
 
 #endif /* __TOOLS_H__ */
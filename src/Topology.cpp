@@ -0,0 +1,104 @@
+#include "Topology.h"
+#include "Tools.h"
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+const size_t Topology::npos;
+
+Topology::Topology(string t, bool rooted) : rooted(rooted) {
+    // do bracket counting sanity check
+    if (count(t.begin(), t.end(), '(') != count(t.begin(), t.end(), ')')) {
+        throw invalid_argument("Bracket mismatch error in tree: " + t);
+    }
+
+    // same trimming as PhyloTree: drop anything before the first (, whitespace and the outer brackets
+    t = t.substr(t.find_first_of("("));
+    Tools::despace(t);
+    t = t.substr(t.find_first_of("(") + 1);
+    t = t.erase(t.find_last_of(")"));
+
+    parent.push_back(npos);
+    leafOf.push_back(npos);
+    vector<size_t> open(1, 0);
+    unordered_set<string> seen;
+    size_t i = 0, end_of_label, end_of_length, alt_end_of_label;
+    while (i < t.size()) {
+        switch (t.at(i)) {
+            case '(': {
+                parent.push_back(open.back());
+                leafOf.push_back(npos);
+                open.push_back(parent.size() - 1);
+                i++;
+                break;
+            }
+
+            case ')': {
+                if (open.size() == 1) throw invalid_argument("Bracket mismatch error in tree: " + t);
+                open.pop_back();
+                i = Tools::nextIndex(t, i + 2, ",)");
+                break;
+            }
+
+            case ',': {
+                i++;
+                break;
+            }
+
+                // this char is the beginning of a leaf name
+            default: {
+                end_of_label = Tools::nextIndex(t, i, ":");
+                alt_end_of_label = Tools::nextIndex(t, i, " ,()");
+                if (alt_end_of_label < end_of_label) {
+                    end_of_label = end_of_length = alt_end_of_label;
+                }
+                else {
+                    end_of_length = Tools::nextIndex(t, end_of_label, " ,)");
+                }
+                string label = Tools::substring(t, i, end_of_label);
+                if (!seen.insert(label).second) {
+                    throw invalid_argument("Label (" + label + ") appears more than once in tree");
+                }
+                parent.push_back(open.back());
+                leafOf.push_back(labels.size());
+                leafNodes.push_back(parent.size() - 1);
+                labels.push_back(label);
+                i = end_of_length;
+                break;
+            }
+        }
+    }
+}
+
+bool Topology::isRooted() const {
+    return rooted;
+}
+
+size_t Topology::numNodes() const {
+    return parent.size();
+}
+
+size_t Topology::numLeaves() const {
+    return labels.size();
+}
+
+size_t Topology::numInternalEdges() const {
+    return parent.size() - labels.size() - 1;
+}
+
+size_t Topology::getParent(size_t node) const {
+    return parent[node];
+}
+
+size_t Topology::getLeaf(size_t node) const {
+    return leafOf[node];
+}
+
+size_t Topology::getLeafNode(size_t leaf) const {
+    return leafNodes[leaf];
+}
+
+const vector<string> &Topology::getLabels() const {
+    return labels;
+}
@@ -0,0 +1,48 @@
+#ifndef __TOPOLOGY_H__
+#define __TOPOLOGY_H__
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * The shape of a newick tree without any split bitsets: a parent array over the nodes plus the leaf
+ * labels. Memory is linear in the number of nodes, so trees far too large for the n x n bits of
+ * PhyloTree's edges can still be compared (see ClusterTable). The string is tokenised exactly as
+ * PhyloTree does; branch lengths and internal labels are skipped.
+ */
+class Topology {
+public:
+    static const size_t npos = (size_t) -1;
+
+    Topology(string t, bool rooted);
+
+    bool isRooted() const;
+
+    size_t numNodes() const;
+
+    size_t numLeaves() const;
+
+    /* Number of edges PhyloTree would store before duplicate splits are merged: one per internal node but the root */
+    size_t numInternalEdges() const;
+
+    /* Node 0 is the root; the root's parent is npos */
+    size_t getParent(size_t node) const;
+
+    /* Leaf number of a node (in order of appearance in the string), or npos for an internal node */
+    size_t getLeaf(size_t node) const;
+
+    size_t getLeafNode(size_t leaf) const;
+
+    const vector<string> &getLabels() const;
+
+private:
+    bool rooted;
+    vector<size_t> parent;
+    vector<size_t> leafOf;
+    vector<size_t> leafNodes;
+    vector<string> labels;
+};
+
+#endif /* __TOPOLOGY_H__ */
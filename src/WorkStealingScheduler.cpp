@@ -0,0 +1,136 @@
+#include "WorkStealingScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <thread>
+
+using namespace std;
+
+namespace {
+    /* The jobs [next, end) of one thread; the owner takes from the front, thieves from the back */
+    struct JobQueue {
+        mutex lock;
+        vector<size_t> jobs;
+        size_t next = 0, end = 0;
+
+        bool pop(size_t &job) {
+            lock_guard<mutex> guard(lock);
+            if (next == end) return false;
+            job = jobs[next++];
+            return true;
+        }
+
+        size_t remaining() {
+            lock_guard<mutex> guard(lock);
+            return end - next;
+        }
+    };
+}
+
+WorkStealingScheduler::WorkStealingScheduler(size_t numThreads) : threads(numThreads) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+}
+
+size_t WorkStealingScheduler::numThreads() const {
+    return threads;
+}
+
+void WorkStealingScheduler::run(size_t numJobs, const Job &job) const {
+    size_t n = min(threads, numJobs);
+    vector<vector<size_t>> queues(n);
+    for (size_t t = 0; t < n; ++t) {
+        queues[t].resize(numJobs * (t + 1) / n - numJobs * t / n);
+        iota(queues[t].begin(), queues[t].end(), numJobs * t / n);
+    }
+    run(queues, job);
+}
+
+void WorkStealingScheduler::run(const vector<double> &costs, const Job &job) const {
+    size_t n = min(threads, costs.size());
+    vector<size_t> order(costs.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    // longest processing time first: each job to the queue with the least estimated work so far
+    vector<vector<size_t>> queues(n);
+    typedef pair<double, size_t> Load;
+    priority_queue<Load, vector<Load>, greater<Load>> loads;
+    for (size_t t = 0; t < n; ++t) {
+        loads.push(Load(0, t));
+    }
+    for (size_t i : order) {
+        Load least = loads.top();
+        loads.pop();
+        queues[least.second].push_back(i);
+        least.first += costs[i];
+        loads.push(least);
+    }
+    run(queues, job);
+}
+
+void WorkStealingScheduler::run(vector<vector<size_t>> &jobs, const Job &job) const {
+    const size_t n = jobs.size();
+    if (n == 0) return;
+    vector<JobQueue> queues(n);
+    for (size_t t = 0; t < n; ++t) {
+        queues[t].jobs.swap(jobs[t]);
+        queues[t].end = queues[t].jobs.size();
+    }
+
+    // move the later half of the longest other queue into thread t's (empty) queue
+    auto steal = [&queues, n](size_t t) {
+        while (true) {
+            size_t victim = t, most = 0;
+            for (size_t v = 0; v < n; ++v) {
+                size_t remaining = v == t ? 0 : queues[v].remaining();
+                if (remaining > most) {
+                    victim = v;
+                    most = remaining;
+                }
+            }
+            if (victim == t) return false;
+
+            vector<size_t> stolen;
+            {
+                lock_guard<mutex> guard(queues[victim].lock);
+                JobQueue &q = queues[victim];
+                if (q.next == q.end) continue; // emptied in the meantime; look again
+                size_t mid = q.end - (q.end - q.next + 1) / 2;
+                stolen.assign(q.jobs.begin() + mid, q.jobs.begin() + q.end);
+                q.end = mid;
+            }
+            lock_guard<mutex> guard(queues[t].lock);
+            queues[t].jobs.swap(stolen);
+            queues[t].next = 0;
+            queues[t].end = queues[t].jobs.size();
+            return true;
+        }
+    };
+
+    atomic<bool> failed(false);
+    exception_ptr error;
+    auto work = [&](size_t t) {
+        try {
+            size_t i;
+            while (!failed) {
+                if (queues[t].pop(i)) job(i, t);
+                else if (!steal(t)) break;
+            }
+        } catch (...) {
+            if (!failed.exchange(true)) error = current_exception();
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < n; ++t) {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+    for (auto &w : workers) {
+        w.join();
+    }
+    if (error) rethrow_exception(error);
+}
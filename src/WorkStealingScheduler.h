@@ -0,0 +1,39 @@
+#ifndef __WORK_STEALING_SCHEDULER_H__
+#define __WORK_STEALING_SCHEDULER_H__
+
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Runs a batch of independent jobs on a fixed number of threads, the calling thread included. Each thread
+ * works through its own queue and, once that is empty, steals the later half of the longest remaining queue.
+ *
+ * Given costs (e.g. from GeodesicCostModel), the jobs are dealt largest first to the least loaded queue: every
+ * thread starts with about the same estimated work and the expensive jobs run early, so the few slow ones do
+ * not end up alone at the tail. Without costs each thread starts on a contiguous range of job indices.
+ *
+ * job(index, thread) is called with thread < numThreads(), for per-thread state such as a GeodesicWorkspace.
+ * The first exception thrown by a job stops the other threads and is rethrown from run.
+ */
+class WorkStealingScheduler {
+public:
+    typedef function<void(size_t job, size_t thread)> Job;
+
+    /* 0 for one thread per hardware thread */
+    explicit WorkStealingScheduler(size_t numThreads = 0);
+
+    size_t numThreads() const;
+
+    void run(size_t numJobs, const Job &job) const;
+
+    void run(const vector<double> &costs, const Job &job) const;
+
+private:
+    size_t threads;
+
+    void run(vector<vector<size_t>> &queues, const Job &job) const;
+};
+
+#endif /* __WORK_STEALING_SCHEDULER_H__ */
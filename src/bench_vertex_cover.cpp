@@ -0,0 +1,153 @@
+#ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
+#endif
+#include "BipartiteGraph.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+/*
+ * Times BipartiteGraph::vertex_cover with each max-flow algorithm on random incompatibility graphs of
+ * growing size and density, to show where Dinic and PushRelabel overtake the original label scan, and
+ * then runs whole GTP refinements to compare cold starts with warm starts from the parent ratio's flow.
+ *
+ * usage: bench_vertex_cover [maxSize]
+ */
+
+static const char *algorithmName(MaxFlowAlgorithm algorithm) {
+    switch (algorithm) {
+        case MaxFlowAlgorithm::LabelScan: return "LabelScan";
+        case MaxFlowAlgorithm::Dinic: return "Dinic";
+        case MaxFlowAlgorithm::PushRelabel: return "PushRelabel";
+    }
+    return "";
+}
+
+/*
+ * The GTP refinement: split the vertex sets on their cover until every cover is trivial, as
+ * Geodesic::getGeodesicNoCommonEdges does, optionally warm-starting each half from its parent's flow.
+ * Returns the number of vertex_cover calls.
+ */
+static size_t refine(BipartiteGraph &graph, size_t n, bool warmStart) {
+    vector<pair<vector<size_t>, vector<size_t>>> stack(1);
+    for (size_t i = 0; i < n; ++i) {
+        stack[0].first.push_back(i);
+        stack[0].second.push_back(i);
+    }
+    VertexCover cover;
+    size_t calls = 0;
+    while (!stack.empty()) {
+        auto ratio = std::move(stack.back());
+        stack.pop_back();
+        graph.vertex_cover(ratio.first, ratio.second, cover, warmStart && calls > 0);
+        calls++;
+        if (cover.aSize == 0 || cover.aSize == ratio.first.size())
+            continue;
+        pair<vector<size_t>, vector<size_t>> r1, r2;
+        const size_t *c = cover.aBegin();
+        for (size_t a : ratio.first) {
+            if (c != cover.aEnd() && a == *c) {
+                r1.first.push_back(a);
+                c++;
+            } else {
+                r2.first.push_back(a);
+            }
+        }
+        c = cover.bBegin();
+        for (size_t b : ratio.second) {
+            if (c != cover.bEnd() && b == *c) {
+                r2.second.push_back(b);
+                c++;
+            } else {
+                r1.second.push_back(b);
+            }
+        }
+        stack.push_back(std::move(r2));
+        stack.push_back(std::move(r1));
+    }
+    return calls;
+}
+
+int main(int argc, char const *argv[]) {
+    size_t maxSize = argc > 1 ? (size_t) atoi(argv[1]) : 512;
+    const MaxFlowAlgorithm algorithms[] = {MaxFlowAlgorithm::LabelScan, MaxFlowAlgorithm::Dinic,
+                                           MaxFlowAlgorithm::PushRelabel};
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    printf("%6s %8s %14s %14s %14s  %s\n", "size", "density", "LabelScan us", "Dinic us", "PushRelabel us", "fastest");
+    for (size_t n = 8; n <= maxSize; n *= 2) {
+        for (double density : {0.1, 0.5, 0.9}) {
+            vector<deque<bool>> incidence(n, deque<bool>(n, false));
+            vector<double> aWeights(n), bWeights(n);
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = 0; j < n; ++j)
+                    incidence[i][j] = uniform(rng) < density;
+                aWeights[i] = 0.1 + uniform(rng);
+                bWeights[i] = 0.1 + uniform(rng);
+            }
+            BipartiteGraph graph(incidence, aWeights, bWeights);
+            vector<size_t> aVertices, bVertices;
+            for (size_t i = 0; i < n; ++i) {
+                aVertices.push_back(i);
+                bVertices.push_back(i);
+            }
+            // enough repetitions for roughly the same amount of work at every size
+            size_t repeats = std::max<size_t>(1, (1 << 22) / (n * n));
+            VertexCover cover;
+            double micros[3];
+            size_t coverSize[3];
+            for (size_t k = 0; k < 3; ++k) {
+                graph.setMaxFlowAlgorithm(algorithms[k]);
+                auto start = std::chrono::steady_clock::now();
+                for (size_t r = 0; r < repeats; ++r)
+                    graph.vertex_cover(aVertices, bVertices, cover);
+                std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                micros[k] = elapsed.count() / repeats;
+                coverSize[k] = cover.aSize + cover.bSize;
+            }
+            size_t fastest = 0;
+            for (size_t k = 1; k < 3; ++k)
+                if (micros[k] < micros[fastest])
+                    fastest = k;
+            printf("%6zu %8.1f %14.2f %14.2f %14.2f  %s%s\n", n, density, micros[0], micros[1], micros[2],
+                   algorithmName(algorithms[fastest]),
+                   coverSize[0] == coverSize[1] && coverSize[0] == coverSize[2] ? "" : "  (tied covers differ)");
+        }
+    }
+
+    printf("\nGTP refinement, cold start against warm start from the parent ratio's flow\n");
+    printf("%6s %8s %6s %14s %14s %14s %14s %14s %14s\n", "size", "density", "calls", "LabelScan us", "warm",
+           "Dinic us", "warm", "PushRelabel us", "warm");
+    for (size_t n = 8; n <= maxSize; n *= 2) {
+        for (double density : {0.1, 0.5, 0.9}) {
+            // crossings only above the diagonal (a thinned staircase) give long refinement chains
+            vector<deque<bool>> incidence(n, deque<bool>(n, false));
+            vector<double> aWeights(n), bWeights(n);
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = 0; j < n; ++j)
+                    incidence[i][j] = j >= i && uniform(rng) < density;
+                aWeights[i] = 0.1 + uniform(rng);
+                bWeights[i] = 0.1 + uniform(rng);
+            }
+            BipartiteGraph graph(incidence, aWeights, bWeights);
+            size_t repeats = std::max<size_t>(1, (1 << 20) / (n * n));
+            size_t calls = 0;
+            printf("%6zu %8.1f", n, density);
+            for (size_t k = 0; k < 3; ++k) {
+                graph.setMaxFlowAlgorithm(algorithms[k]);
+                for (bool warmStart : {false, true}) {
+                    auto start = std::chrono::steady_clock::now();
+                    for (size_t r = 0; r < repeats; ++r)
+                        calls = refine(graph, n, warmStart);
+                    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                    if (k == 0 && !warmStart)
+                        printf(" %6zu", calls);
+                    printf(" %14.2f", elapsed.count() / repeats);
+                }
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -4,17 +4,16 @@
 #ifndef BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #define BOOST_DYNAMIC_BITSET_DONT_USE_FRIENDS
 #endif
-#include <boost/dynamic_bitset.hpp>
-#include <boost/functional/hash.hpp>
+#include "SplitBitset.h"
 
 #ifndef CGTP_BITSET_HASH_H
 #define CGTP_BITSET_HASH_H
 
-using bitset_t = boost::dynamic_bitset<>;
+using bitset_t = SplitBitset;
 
 struct BitsetHash {
     size_t operator()(const bitset_t &bitset) const {
-        return boost::hash_value(bitset.m_bits);
+        return bitset.hash();
     }
 };
 
@@ -13,7 +13,7 @@ using std::string;
 using std::vector;
 using std::cout;
 using std::endl;
-using bitset_t = boost::dynamic_bitset<>;
+using bitset_t = SplitBitset;
 
 template <typename InputIt, typename OutputIt>
 void leaf_intersection(InputIt beg1, InputIt end1, InputIt beg2, InputIt end2, OutputIt o1, OutputIt o2) {
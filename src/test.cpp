@@ -1,11 +1,80 @@
 #include "BipartiteGraph.h"
+#include "CompatibilityIndex.h"
+#include "CondensedMatrixFile.h"
 #include "Distance.h"
+#include "GeodesicCostModel.h"
+#include "PreparedTree.h"
+#include "ReferenceDistances.h"
+#include "SplitMatching.h"
 #include "test_catch_helper.h"
+#include "TiledDistanceMatrix.h"
 #include "Tools.h"
+#include "WorkStealingScheduler.h"
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <sys/file.h>
+#include <unistd.h>
 
 
 #define TOLERANCE 0.0000001
 
+/* Leaves prefix0 ... prefix(n-1) with random lengths */
+static vector<string> randomLeaves(std::mt19937 &rng, size_t n, const string &prefix = "t") {
+    std::uniform_real_distribution<double> length(0.1, 1.0);
+    vector<string> nodes;
+    for (size_t i = 0; i < n; ++i) {
+        nodes.push_back(prefix + std::to_string(i) + ":" + std::to_string(length(rng)));
+    }
+    return nodes;
+}
+
+/*
+ * Joins random pairs of the subtrees in nodes, each under an edge of random length, until at most roots are left.
+ * If multifurcating, groups of one to three subtrees are joined instead, which also makes unary nodes.
+ */
+static void joinRandomly(std::mt19937 &rng, vector<string> &nodes, size_t roots, bool multifurcating = false) {
+    std::uniform_real_distribution<double> length(0.1, 1.0);
+    while (nodes.size() > roots) {
+        std::shuffle(nodes.begin(), nodes.end(), rng);
+        size_t k = multifurcating ? 1 + rng() % 3 : 2;
+        string children = nodes.back();
+        nodes.pop_back();
+        for (size_t j = 1; j < k; ++j) {
+            children = nodes.back() + "," + children;
+            nodes.pop_back();
+        }
+        nodes.push_back("(" + children + "):" + std::to_string(length(rng)));
+    }
+}
+
+/*
+ * The newick string of a random tree on the given leaves, with a root of degree two if rooted and three if not
+ * (at most three if multifurcating)
+ */
+static string randomNewick(std::mt19937 &rng, vector<string> leaves, bool rooted = false,
+                           bool multifurcating = false) {
+    joinRandomly(rng, leaves, rooted ? 2 : 3, multifurcating);
+    string root = leaves[0];
+    for (size_t i = 1; i < leaves.size(); ++i) {
+        root += "," + leaves[i];
+    }
+    return "(" + root + ");";
+}
+
+/* The newick string of a random tree on the leaves t0 ... t(n-1) */
+static string randomNewick(std::mt19937 &rng, size_t n, bool rooted = false, bool multifurcating = false) {
+    return randomNewick(rng, randomLeaves(rng, n), rooted, multifurcating);
+}
+
+static PhyloTree randomTree(std::mt19937 &rng, size_t n, bool rooted = false) {
+    return PhyloTree(randomNewick(rng, n, rooted), rooted);
+}
+
 TEST_CASE("Bipartition") {
     SECTION("Construction") {
         // test default constructor
@@ -124,6 +193,93 @@ TEST_CASE("Bipartition") {
     }
 }
 
+TEST_CASE("SplitBitset") {
+    SECTION("Inline and heap storage") {
+        auto a = SplitBitset(10);
+        REQUIRE(a.is_inline());
+        REQUIRE(a.none());
+        auto b = SplitBitset(64 * SplitBitset::inline_blocks + 1);
+        REQUIRE_FALSE(b.is_inline());
+        REQUIRE(b.none());
+        b.set(b.size() - 1);
+        auto c = b;
+        REQUIRE_FALSE(c.is_inline());
+        REQUIRE(c == b);
+        REQUIRE(c.count() == 1);
+        REQUIRE(c.find_first() == c.size() - 1);
+    }
+
+    SECTION("Strings and bits") {
+        auto a = SplitBitset(string("0100101"));
+        REQUIRE(a.to_string() == "0100101");
+        REQUIRE(a.test(0));
+        REQUIRE(a.test(2));
+        REQUIRE(a.test(5));
+        REQUIRE(a.count() == 3);
+        REQUIRE(a.find_first() == 0);
+        REQUIRE(a.find_next(0) == 2);
+        REQUIRE(a.find_next(5) == SplitBitset::npos);
+        REQUIRE((~a).to_string() == "1011010");
+        a[6].flip();
+        REQUIRE(a.to_string() == "1100101");
+    }
+
+    SECTION("Ordering matches string order") {
+        string s1(130, '0'), s2(130, '0');
+        s1[3] = '1';
+        s2[100] = '1';
+        auto a = SplitBitset(s1);
+        auto b = SplitBitset(s2);
+        REQUIRE(b < a);
+        REQUIRE_FALSE(a < b);
+        REQUIRE(a.hash() != b.hash());
+        REQUIRE_FALSE(a.intersects(b));
+        auto c = a;
+        c |= b;
+        REQUIRE(c.count() == 2);
+    }
+}
+
+TEST_CASE("CompatibilityIndex") {
+    SECTION("Agrees with a scan of the tree's splits") {
+        std::mt19937 rng(11);
+        for (size_t n : {4, 9, 70, 150}) {
+            for (int trial = 0; trial < 5; ++trial) {
+                auto t1 = randomTree(rng, n, true);
+                auto t2 = randomTree(rng, n, true);
+                auto edges1 = t1.getEdges();
+                CompatibilityIndex index(edges1);
+                REQUIRE(index.isNested());
+                vector<SplitBitset> queries;
+                for (auto &e : t2.getEdges()) {
+                    queries.push_back(e.getPartition());
+                }
+                for (auto &e : edges1) {
+                    queries.push_back(e.getPartition());
+                }
+                for (int q = 0; q < 50; ++q) {
+                    SplitBitset random(edges1[0].getPartition().size());
+                    for (size_t i = 0; i < random.size(); ++i) {
+                        random.set(i, rng() % 4 == 0);
+                    }
+                    queries.push_back(random);
+                }
+                for (auto &split : queries) {
+                    CHECK(index.isCompatibleWith(split) == PhyloTreeEdge(split).isCompatibleWith(edges1));
+                }
+            }
+        }
+    }
+
+    SECTION("Splits that are not nested fall back to a scan") {
+        vector<PhyloTreeEdge> edges = {PhyloTreeEdge(string("00111")), PhyloTreeEdge(string("01110"))};
+        CompatibilityIndex index(edges);
+        CHECK_FALSE(index.isNested());
+        CHECK(index.isCompatibleWith(SplitBitset(string("01111"))));
+        CHECK_FALSE(index.isCompatibleWith(SplitBitset(string("00011"))));
+    }
+}
+
 TEST_CASE("PhyloTreeEdge") {
     SECTION("Construction") {
         auto a = PhyloTreeEdge();
@@ -144,7 +300,7 @@ TEST_CASE("PhyloTreeEdge") {
         REQUIRE(d.toString() == "[0.5] ");
         REQUIRE(d.getOriginalID() == 10);
 
-        auto e = PhyloTreeEdge(attrib, bip, 11);
+        auto e = PhyloTreeEdge(attrib, bip->getPartition().size(), 11);
         REQUIRE(e.toString() == "[0.5] 00000000");
         REQUIRE(e.getOriginalID() == 11);
         REQUIRE(e.isEmpty());
@@ -154,7 +310,7 @@ TEST_CASE("PhyloTreeEdge") {
         REQUIRE(f.getOriginalID() == 12);
 
         auto edge = Bipartition("11011011");
-        auto g = PhyloTreeEdge(edge.getPartition(), attrib, bip->getPartition(), 13);
+        auto g = PhyloTreeEdge(edge.getPartition(), attrib, 13);
         REQUIRE(g.toString() == "[0.5] " + edge.toString());
         REQUIRE(g.getOriginalID() == 13);
 
@@ -388,6 +544,100 @@ TEST_CASE("PhyloTree") {
         CHECK(enic.size() == 2);
     }
 
+    SECTION("Split matching") {
+        string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
+        string n2("((a:3,b:4):.5,(c:5,d:6,(e:7,f:8):.6):.8);"); // {d,e,f} is compatible but not common
+        auto a = PhyloTree(n1, true);
+        auto b = PhyloTree(n2, true);
+        vector<PhyloTreeEdge> eic, enic;
+        PhyloTree::getCommonEdges(a, b, eic);
+        a.getEdgesNotInCommonWith(b, enic);
+        b.getEdgesNotInCommonWith(a, enic);
+        SplitMatching matching(a.getEdgesByRef(), b.getEdgesByRef());
+        CHECK((matching.numOnlyIn1() + matching.numOnlyIn2()) == enic.size());
+        CHECK(matching.numCommon() == (a.numEdges() - matching.numOnlyIn1()));
+        for (size_t i = 0; i < a.numEdges(); ++i) {
+            size_t j = matching.partnerOf1(i);
+            if (j != SplitMatching::npos) {
+                CHECK(a.getEdgesByRef()[i].getPartition() == b.getEdgesByRef()[j].getPartition());
+                CHECK(matching.isMatched2(j));
+            }
+        }
+        double absSum = 0, squareSum = 0, expectedAbs = 0, expectedSquares = 0;
+        for (auto &edges : {eic, enic}) {
+            for (auto &e : edges) {
+                expectedAbs += abs(e.getLength());
+                expectedSquares += e.getLength() * e.getLength();
+            }
+        }
+        matching.getDifferenceSums(absSum, squareSum);
+        CHECK(abs(absSum - expectedAbs) < TOLERANCE);
+        CHECK(abs(squareSum - expectedSquares) < TOLERANCE);
+
+        // the same join through tables built beforehand
+        SplitTable tableA(a.getEdgesByRef()), tableB(b.getEdgesByRef());
+        CompatibilityIndex indexA(a.getEdgesByRef()), indexB(b.getEdgesByRef());
+        SplitMatching prepared;
+        prepared.match(a.getEdgesByRef(), tableA, b.getEdgesByRef(), tableB, &indexA, &indexB);
+        CHECK(prepared.numCommon() == matching.numCommon());
+        CHECK(prepared.numOnlyIn2() == matching.numOnlyIn2());
+        for (size_t i = 0; i < a.numEdges(); ++i) {
+            CHECK(prepared.partnerOf1(i) == matching.partnerOf1(i));
+        }
+        double preparedAbs = 0, preparedSquares = 0;
+        prepared.getDifferenceSums(preparedAbs, preparedSquares);
+        CHECK(preparedAbs == absSum);
+        CHECK(preparedSquares == squareSum);
+    }
+
+    SECTION("Split matrix") {
+        string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
+        string n2("((a:3,c:4):.5,(d:5,((b:6,e:7):.2,f:8):.3):.4);");
+        auto a = PhyloTree(n1, true);
+        auto b = PhyloTree(n2, true);
+        double dist = a.getDistanceFromOrigin();
+        double rf = Distance::getRobinsonFouldsDistance(a, b, false);
+        double wrf = Distance::getWeightedRobinsonFouldsDistance(a, b, false);
+        double euc = Distance::getEuclideanDistance(a, b, true);
+        REQUIRE_FALSE(a.hasSplitMatrix());
+        a.buildSplitMatrix();
+        b.buildSplitMatrix();
+        auto &m = a.getSplitMatrix();
+        REQUIRE(m.numSplits() == a.numEdges());
+        REQUIRE(m.wordsPerSplit() == 1);
+        for (size_t i = 1; i < m.numSplits(); ++i) {
+            CHECK(m.getSplit(i - 1) < m.getSplit(i));
+        }
+        CHECK(abs(a.getDistanceFromOrigin() - dist) < TOLERANCE);
+        CHECK(abs(Distance::getRobinsonFouldsDistance(a, b, false) - rf) < TOLERANCE);
+        CHECK(abs(Distance::getWeightedRobinsonFouldsDistance(a, b, false) - wrf) < TOLERANCE);
+        CHECK(abs(Distance::getEuclideanDistance(a, b, true) - euc) < TOLERANCE);
+        a.normalize();
+        REQUIRE_FALSE(a.hasSplitMatrix());
+    }
+
+    SECTION("Taxon namespace") {
+        string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
+        string n2("((a:3,c:4):.5,(d:5,((b:6,e:7):.2,f:8):.3):.4);");
+        auto taxa = TaxonNamespace::fromNewick(n2);
+        REQUIRE(taxa->size() == 6);
+        REQUIRE(taxa->indexOf("c") == 2);
+        REQUIRE(taxa->indexOf("z") == -1);
+        auto a = PhyloTree(n1, true, taxa);
+        auto b = PhyloTree(n2, true, taxa);
+        auto c = PhyloTree(n2, true);
+        REQUIRE(a.getNamespaceID() == taxa->getID());
+        REQUIRE(c.getNamespaceID() == 0);
+        REQUIRE(a.getLeaf2NumMap() == c.getLeaf2NumMap());
+        REQUIRE(a.hasSameLeaves(b));
+        REQUIRE(a.hasSameLeaves(c));
+        CHECK(a.getEdges() == PhyloTree(n1, true).getEdges());
+        CHECK(abs(Distance::getGeodesicDistance(a, b, false) - Distance::getGeodesicDistance(n1, n2, false, true, true)) < TOLERANCE);
+        CHECK_THROWS(PhyloTree("((a:3,b:4):.1,(c:5,(d:6,e:7):.2):.4);", true, taxa));
+        CHECK_THROWS(PhyloTree("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,g:8):.3):.4);", true, taxa));
+        REQUIRE(TaxonNamespace(taxa->getLabels()).getID() != taxa->getID());
+    }
+
     SECTION("Newick") {
         string n3("(g:1,(a:1,(b:1,c:1):1):1,(f:1,(e:1,d:1):1):1);");
         string n4("(g:2,(a:2,(b:2,c:2):2):2,(d:2,(e:2,f:2):2):2);");
@@ -415,20 +665,20 @@ TEST_CASE("Ratio") {
         auto a = Ratio();
         CHECK(a.getELength() == 0);
         CHECK(a.getFLength() == 0);
-        CHECK(a.getEEdges() == vector<PhyloTreeEdge>());
-        CHECK(a.getFEdges() == vector<PhyloTreeEdge>());
+        CHECK(a.getEEdges() == vector<int>());
+        CHECK(a.getFEdges() == vector<int>());
 
         auto b = Ratio(5.5, 10.9);
         CHECK(b.getELength() == 5.5);
         CHECK(b.getFLength() == 10.9);
-        CHECK(b.getEEdges() == vector<PhyloTreeEdge>());
-        CHECK(b.getFEdges() == vector<PhyloTreeEdge>());
+        CHECK(b.getEEdges() == vector<int>());
+        CHECK(b.getFEdges() == vector<int>());
 
         auto c = Ratio(b);
         CHECK(c.getELength() == 5.5);
         CHECK(c.getFLength() == 10.9);
-        CHECK(c.getEEdges() == vector<PhyloTreeEdge>());
-        CHECK(c.getFEdges() == vector<PhyloTreeEdge>());
+        CHECK(c.getEEdges() == vector<int>());
+        CHECK(c.getFEdges() == vector<int>());
 
         string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
         string n2("((a:3,c:4):.5,(d:5,((b:6,e:7):.2,f:8):.3):.4);");
@@ -451,6 +701,9 @@ TEST_CASE("Ratio") {
         auto g = Ratio::combine(d, e);
         CHECK(abs(g.getELength() - sqrt(0.84)) < TOLERANCE);
         CHECK(abs(g.getFLength() - sqrt(0.84)) < TOLERANCE);
+        CHECK(abs(g.getELengthSquared() - 0.84) < TOLERANCE);
+        CHECK(g.getEEdges().size() == d.getEEdges().size() + e.getEEdges().size());
+        CHECK(d.getEEdges()[0] == eEdges[0].getOriginalID());
 
         deque<Ratio> queue;
         {
@@ -482,34 +735,332 @@ TEST_CASE("Ratio") {
         auto t2 = PhyloTree(n2, true);
         auto fEdges = t2.getEdges();
         auto a = Ratio(eEdges, fEdges);
-        CHECK(a.containsOriginalEEdge(Bipartition("110000")));
-        CHECK(a.containsOriginalEEdge(Bipartition("000110")));
-        CHECK(a.containsOriginalEEdge(Bipartition("000111")));
-        CHECK(a.containsOriginalEEdge(Bipartition("001111")));
-        CHECK(a.containsOriginalEEdge(Bipartition("101000")));
-        CHECK(a.containsOriginalEEdge(Bipartition("010010")));
-        CHECK(a.containsOriginalEEdge(Bipartition("010011")));
-        CHECK(a.containsOriginalEEdge(Bipartition("010111")));
-        CHECK_FALSE(a.containsOriginalEEdge(Bipartition("000000")));
-        CHECK_FALSE(a.containsOriginalEEdge(Bipartition("111111")));
-        CHECK_FALSE(a.containsOriginalEEdge(Bipartition("001000")));
-        CHECK_FALSE(a.containsOriginalEEdge(Bipartition("001100")));
+        auto contains = [&](const Bipartition &edge) {
+            return a.containsOriginalEEdge(edge, t1.getOriginalEdges(), t2.getOriginalEdges());
+        };
+        REQUIRE(t1.getOriginalEdge(eEdges[0].getOriginalID()) == eEdges[0].getPartition());
+        CHECK(contains(Bipartition("110000")));
+        CHECK(contains(Bipartition("000110")));
+        CHECK(contains(Bipartition("000111")));
+        CHECK(contains(Bipartition("001111")));
+        CHECK(contains(Bipartition("101000")));
+        CHECK(contains(Bipartition("010010")));
+        CHECK(contains(Bipartition("010011")));
+        CHECK(contains(Bipartition("010111")));
+        CHECK_FALSE(contains(Bipartition("000000")));
+        CHECK_FALSE(contains(Bipartition("111111")));
+        CHECK_FALSE(contains(Bipartition("001000")));
+        CHECK_FALSE(contains(Bipartition("001100")));
     }
 }
 
 TEST_CASE("RatioSequence") {
+    SECTION("Non-descending combination") {
+        // ratios 1/4, 3/1, 2/2, 1/2, 5/1: 3/1, 2/2 and 1/2 pool into one block
+        RatioSequence rs("1,3,2,1,5", "4,1,2,2,1");
+        vector<RatioBlock> blocks;
+        rs.getNonDesBlocks(blocks);
+        REQUIRE(blocks.size() == 3);
+        CHECK(blocks[0].begin == 0);
+        CHECK(blocks[0].end == 1);
+        CHECK(blocks[1].begin == 1);
+        CHECK(blocks[1].end == 4);
+        CHECK(blocks[2].begin == 4);
+        CHECK(blocks[2].end == 5);
+        CHECK(blocks[1].eLengthSq == 14);
+        CHECK(blocks[1].fLengthSq == 9);
+
+        // same as combining the ratios pairwise
+        Ratio expected = Ratio::combine(rs[1], rs[2]);
+        expected = Ratio::combine(expected, rs[3]);
+        auto combined = rs.getNonDesRSWithMinDist();
+        REQUIRE(combined.size() == 3);
+        CHECK(combined[1].getELength() == expected.getELength());
+        CHECK(combined[1].getFLength() == expected.getFLength());
+        CHECK(combined[0].getRatio() <= combined[1].getRatio());
+        CHECK(combined[1].getRatio() <= combined[2].getRatio());
+        CHECK(rs.getMinNonDesRSDistance() == combined.getDistance());
+
+        // already non-descending: nothing to combine
+        auto again = combined.getNonDesRSWithMinDist();
+        CHECK(again.size() == 3);
+    }
 
+    SECTION("Combined edges") {
+        Ratio r1, r2, r3;
+        r1.addEEdge(0, 3);
+        r1.addFEdge(0, 1);
+        r2.addEEdge(1, 1);
+        r2.addFEdge(1, 1);
+        r2.addFEdge(2, 1);
+        r3.addEEdge(2, 4);
+        r3.addFEdge(3, 1);
+        RatioSequence rs;
+        rs.push_back(r1);
+        rs.push_back(r2);
+        rs.push_back(r3);
+        auto combined = rs.getNonDesRSWithMinDist();
+        REQUIRE(combined.size() == 2);
+        CHECK(combined[0].getEEdges() == vector<int>({0, 1}));
+        CHECK(combined[0].getFEdges() == vector<int>({0, 1, 2}));
+        CHECK(combined[1].getEEdges() == vector<int>({2}));
+
+        RatioSequence other("2", "1");
+        auto interleaved = RatioSequence::interleave(rs, other);
+        REQUIRE(interleaved.size() == 3);
+        CHECK(interleaved[0].getEEdges() == vector<int>({0, 1}));
+        CHECK(interleaved[1].getRatio() == 2);
+        CHECK(interleaved[2].getRatio() == 4);
+    }
 }
 
 TEST_CASE("Geodesic") {
+    SECTION("Split on common edges") {
+        // {a,b,c} and {d,e,f} are common; each is resolved differently inside
+        auto t1 = PhyloTree("(((a:1,b:1):1,c:1):1,((d:1,e:1):1,f:1):1);", true);
+        auto t2 = PhyloTree("(((a:1,c:1):1,b:1):1,((d:1,f:1):1,e:1):1);", true);
+        GeodesicWorkspace workspace;
+        Geodesic::getGeodesic(t1, t2, workspace);
+        REQUIRE(workspace.numSubproblems() == 2);
+        for (size_t i = 0; i < 2; ++i) {
+            auto &subproblem = workspace.getSubproblem(i);
+            CHECK(subproblem.numLeaves == 3);
+            REQUIRE(subproblem.aEdges.size() == 1);
+            REQUIRE(subproblem.bEdges.size() == 1);
+            CHECK(subproblem.aEdges[0].contains(0));
+            CHECK(subproblem.aEdges[0].contains(1));
+            CHECK(!subproblem.aEdges[0].contains(2));
+            CHECK(subproblem.bEdges[0].contains(0));
+            CHECK(!subproblem.bEdges[0].contains(1));
+            CHECK(subproblem.bEdges[0].contains(2));
+        }
+
+        // one side with no edges left gives no subproblem
+        auto t3 = PhyloTree("(((a:1,b:1):1,c:1):1,((d:1,e:1):1,f:1):1);", true);
+        Geodesic::getGeodesic(t1, t3, workspace);
+        CHECK(workspace.numSubproblems() == 0);
+    }
+
+    SECTION("Subproblems on several threads") {
+        // four common 50-leaf clades, each resolved differently inside, give four large subproblems
+        std::mt19937 rng(19);
+        auto randomClade = [&](size_t block) {
+            auto nodes = randomLeaves(rng, 50, "b" + std::to_string(block) + "_");
+            joinRandomly(rng, nodes, 1);
+            return nodes[0];
+        };
+        string n1 = "(", n2 = "(";
+        for (size_t block = 0; block < 4; ++block) {
+            n1 += (block ? "," : "") + randomClade(block);
+            n2 += (block ? "," : "") + randomClade(block);
+        }
+        auto t1 = PhyloTree(n1 + ");", false);
+        auto t2 = PhyloTree(n2 + ");", false);
+
+        GeodesicWorkspace serial, parallel;
+        parallel.setNumThreads(4);
+        CHECK(parallel.getNumThreads() == 4);
+        auto &geodesic = Geodesic::getGeodesic(t1, t2, serial);
+        string expected = geodesic.getRS().toString();
+        double distance = geodesic.getDist();
+        REQUIRE(serial.numSubproblems() >= 4);
+        for (int repeat = 0; repeat < 3; ++repeat) {
+            CHECK(Geodesic::getGeodesic(t1, t2, parallel).getRS().toString() == expected);
+            CHECK(parallel.numSubproblems() == serial.numSubproblems());
+            CHECK(Distance::getGeodesicDistance(t1, t2, false, parallel) == distance);
+        }
+    }
+
+    SECTION("Fork-join ratio refinement") {
+        // a tree and a copy with some leaves swapped split their ratios into halves big enough to fork at a
+        // low threshold
+        std::mt19937 rng(20);
+        // one shape for both trees: the same generator state joins the same positions whatever the labels are
+        auto shapedTree = [](const vector<string> &leaves) {
+            std::mt19937 shape(leaves.size());
+            return PhyloTree(randomNewick(shape, leaves), false);
+        };
+        GeodesicWorkspace serial, forked;
+        forked.setNumThreads(4);
+        forked.setRatioForkThreshold(4);
+        CHECK(forked.getRatioForkThreshold() == 4);
+        for (size_t swaps : {10, 20, 30, 40}) {
+            auto leaves = randomLeaves(rng, 100);
+            auto t1 = shapedTree(leaves);
+            for (size_t i = 0; i < swaps; ++i) {
+                std::swap(leaves[rng() % leaves.size()], leaves[rng() % leaves.size()]);
+            }
+            auto t2 = shapedTree(leaves);
+            for (auto algorithm : {MaxFlowAlgorithm::LabelScan, MaxFlowAlgorithm::PushRelabel}) {
+                serial.setMaxFlowAlgorithm(algorithm);
+                forked.setMaxFlowAlgorithm(algorithm);
+                auto &geodesic = Geodesic::getGeodesic(t1, t2, serial);
+                string expected = geodesic.getRS().toString();
+                double distance = geodesic.getDist();
+                CHECK(Geodesic::getGeodesic(t1, t2, forked).getRS().toString() == expected);
+                CHECK(Distance::getGeodesicDistance(t1, t2, false, forked) == distance);
+            }
+        }
+    }
 
+    SECTION("A cover with an empty side") {
+        // vertex_cover used to pad each side of the cover to n entries with zeros, so an empty B side
+        // matched B vertex 0 against the padding and put its split in the wrong ratio (2.30498863472521)
+        auto t1 = PhyloTree("(t4:0.5952,(t0:0.9682,(t1:0.8258,(t3:0.8365,t2:0.5886):0.6868):0.8082):0.5049);", true);
+        auto t2 = PhyloTree("((t4:0.9728,t3:0.9728):0.3766,(t1:0.1567,(t0:0.3820,t2:0.9221):0.6957):0.1732);", false);
+        CHECK(abs(Distance::getGeodesicDistance(t1, t2, false) - 2.2606893728755852) < TOLERANCE);
+    }
 }
 
 TEST_CASE("Bipartite Graph") {
     SECTION("Vertex Cover") {
-        vector<int> aVertices{0, 1, 2, 3};
-        vector<int> bVertices{0, 1, 2, 3};
-//        auto g = BipartiteGraph();
+        // sizes chosen so both sides span more than one 64-bit word
+        size_t nA = 70, nB = 130;
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> uniform(0.1, 2.0);
+        vector<deque<bool>> incidence(nA, deque<bool>(nB, false));
+        vector<double> aWeights, bWeights;
+        for (size_t i = 0; i < nA; ++i) {
+            for (size_t j = 0; j < nB; ++j) {
+                incidence[i][j] = uniform(rng) < 0.3;
+            }
+            aWeights.push_back(uniform(rng));
+        }
+        for (size_t j = 0; j < nB; ++j) {
+            bWeights.push_back(uniform(rng));
+        }
+        BipartiteGraph g(incidence, aWeights, bWeights);
+        bool same = true;
+        for (size_t i = 0; i < nA; ++i) {
+            for (size_t j = 0; j < nB; ++j) {
+                same = same && g.isEdge(i, j) == incidence[i][j];
+            }
+        }
+        CHECK(same);
+
+        // ascending subsets take the word-parallel scan, the reversed ones the cell-by-cell scan
+        vector<size_t> aVertices, bVertices;
+        for (size_t i = 0; i < nA; i += 2) aVertices.push_back(i);
+        for (size_t j = 1; j < nB; j += 3) bVertices.push_back(j);
+        auto cover = g.vertex_cover(aVertices, bVertices);
+        vector<size_t> aReversed(aVertices.rbegin(), aVertices.rend());
+        vector<size_t> bReversed(bVertices.rbegin(), bVertices.rend());
+        auto reversedCover = g.vertex_cover(aReversed, bReversed);
+        REQUIRE(cover.aSize == reversedCover.aSize);
+        REQUIRE(cover.bSize == reversedCover.bSize);
+        CHECK(cover.aSize > 0);
+        CHECK(cover.aSize < aVertices.size());
+        vector<size_t> a1(cover.aBegin(), cover.aEnd());
+        vector<size_t> a2(reversedCover.aBegin(), reversedCover.aEnd());
+        std::sort(a2.begin(), a2.end());
+        CHECK(a1 == a2);
+        vector<size_t> b1(cover.bBegin(), cover.bEnd());
+        vector<size_t> b2(reversedCover.bBegin(), reversedCover.bEnd());
+        std::sort(b2.begin(), b2.end());
+        CHECK(b1 == b2);
+
+        // a second call on the same graph only resets its own subset, and must not see the earlier flow
+        vector<size_t> aSub(aVertices.begin(), aVertices.begin() + 10), bSub(bVertices.begin(), bVertices.begin() + 10);
+        BipartiteGraph fresh(incidence, aWeights, bWeights);
+        auto reused = g.vertex_cover(aSub, bSub);
+        auto expected = fresh.vertex_cover(aSub, bSub);
+        CHECK(vector<size_t>(reused.aBegin(), reused.bEnd()) == vector<size_t>(expected.aBegin(), expected.bEnd()));
+        CHECK(reused.aSize == expected.aSize);
+    }
+
+    SECTION("Max-flow algorithms agree") {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> uniform(0.1, 2.0);
+        bool same = true;
+        for (double density : {0.05, 0.3, 0.8}) {
+            size_t nA = 90, nB = 75;
+            vector<deque<bool>> incidence(nA, deque<bool>(nB, false));
+            vector<double> aWeights, bWeights;
+            for (size_t i = 0; i < nA; ++i) {
+                for (size_t j = 0; j < nB; ++j) {
+                    incidence[i][j] = uniform(rng) < 0.1 + 1.9 * density; // uniform(rng) is in [0.1, 2)
+                }
+                aWeights.push_back(uniform(rng));
+            }
+            for (size_t j = 0; j < nB; ++j) {
+                bWeights.push_back(uniform(rng));
+            }
+            BipartiteGraph g(incidence, aWeights, bWeights);
+            for (size_t step = 1; step <= 4; ++step) {
+                vector<size_t> aVertices, bVertices;
+                for (size_t i = step - 1; i < nA; i += step) aVertices.push_back(i);
+                for (size_t j = 0; j < nB; j += step) bVertices.push_back(j);
+                // normalised weight of a cover; a minimum cover of weight 1 ties with the trivial ones
+                auto weight = [&](const VertexCover &cover) {
+                    double aTotal = 0, bTotal = 0, aCover = 0, bCover = 0;
+                    for (size_t i : aVertices) aTotal += aWeights[i] * aWeights[i];
+                    for (size_t j : bVertices) bTotal += bWeights[j] * bWeights[j];
+                    for (auto i = cover.aBegin(); i != cover.aEnd(); ++i) aCover += aWeights[*i] * aWeights[*i];
+                    for (auto j = cover.bBegin(); j != cover.bEnd(); ++j) bCover += bWeights[*j] * bWeights[*j];
+                    return aCover / aTotal + bCover / bTotal;
+                };
+                auto expected = g.vertex_cover(aVertices, bVertices);
+                for (auto algorithm : {MaxFlowAlgorithm::Dinic, MaxFlowAlgorithm::PushRelabel}) {
+                    g.setMaxFlowAlgorithm(algorithm);
+                    auto cover = g.vertex_cover(aVertices, bVertices);
+                    if (weight(expected) < 1 - 1e-9) {
+                        same = same && cover.aSize == expected.aSize && cover.bSize == expected.bSize &&
+                               std::equal(cover.aBegin(), cover.bEnd(), expected.aBegin());
+                    } else {
+                        same = same && abs(weight(cover) - weight(expected)) < 1e-9;
+                    }
+                }
+                g.setMaxFlowAlgorithm(MaxFlowAlgorithm::LabelScan);
+            }
+        }
+        CHECK(same);
+    }
+
+    SECTION("Warm start") {
+        // a staircase of crossings splits into long chains of ratios
+        size_t n = 60;
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<double> uniform(0.5, 1.5);
+        vector<deque<bool>> incidence(n, deque<bool>(n, false));
+        vector<double> aWeights, bWeights;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i; j < n; ++j) {
+                incidence[i][j] = true;
+            }
+            aWeights.push_back(uniform(rng) + (double) i / n);
+            bWeights.push_back(uniform(rng));
+        }
+        BipartiteGraph cold(incidence, aWeights, bWeights), warm(incidence, aWeights, bWeights);
+        vector<pair<vector<size_t>, vector<size_t>>> stack(1);
+        for (size_t i = 0; i < n; ++i) {
+            stack[0].first.push_back(i);
+            stack[0].second.push_back(i);
+        }
+        VertexCover coldCover, warmCover;
+        size_t calls = 0;
+        bool same = true;
+        while (!stack.empty()) {
+            auto ratio = stack.back();
+            stack.pop_back();
+            cold.vertex_cover(ratio.first, ratio.second, coldCover);
+            warm.vertex_cover(ratio.first, ratio.second, warmCover, calls++ > 0);
+            // all of A and all of B tie as trivial covers, and either ends the refinement
+            bool coldTrivial = coldCover.aSize == 0 || coldCover.aSize == ratio.first.size();
+            bool warmTrivial = warmCover.aSize == 0 || warmCover.aSize == ratio.first.size();
+            same = same && (coldTrivial ? warmTrivial : coldCover.aSize == warmCover.aSize &&
+                   coldCover.bSize == warmCover.bSize && std::equal(coldCover.aBegin(), coldCover.bEnd(), warmCover.aBegin()));
+            if (coldTrivial)
+                continue;
+            pair<vector<size_t>, vector<size_t>> r1, r2;
+            for (size_t a : ratio.first)
+                (std::find(coldCover.aBegin(), coldCover.aEnd(), a) != coldCover.aEnd() ? r1 : r2).first.push_back(a);
+            for (size_t b : ratio.second)
+                (std::find(coldCover.bBegin(), coldCover.bEnd(), b) != coldCover.bEnd() ? r2 : r1).second.push_back(b);
+            stack.push_back(r2);
+            stack.push_back(r1);
+        }
+        CHECK(calls > 5);
+        CHECK(same);
     }
 }
 
@@ -526,6 +1077,86 @@ TEST_CASE("Vertex") {
     CHECK(abs(e.weight - 0.16) < TOLERANCE);
 }
 
+TEST_CASE("WorkStealingScheduler") {
+    SECTION("Runs every job once") {
+        std::mt19937 rng(18);
+        for (size_t threads : {1, 2, 3, 8}) {
+            WorkStealingScheduler scheduler(threads);
+            REQUIRE(scheduler.numThreads() == threads);
+            for (size_t numJobs : {0, 1, 5, 1000}) {
+                vector<std::atomic<int>> runs(numJobs);
+                std::atomic<bool> badThread(false);
+                auto job = [&](size_t i, size_t thread) {
+                    runs[i]++;
+                    if (thread >= threads) badThread = true;
+                };
+                scheduler.run(numJobs, job);
+                vector<double> costs(numJobs);
+                for (auto &c : costs) {
+                    c = std::pow(10.0, rng() % 5);
+                }
+                scheduler.run(costs, job);
+                for (auto &r : runs) {
+                    CHECK(r == 2);
+                }
+                CHECK(!badThread);
+            }
+        }
+    }
+
+    SECTION("Rethrows a job's exception") {
+        WorkStealingScheduler scheduler(4);
+        CHECK_THROWS_AS(scheduler.run(100, [](size_t i, size_t) {
+            if (i == 37) throw std::runtime_error("job failed");
+        }), const std::runtime_error &);
+    }
+}
+
+TEST_CASE("GeodesicCostModel") {
+    PhyloTree t1("((a:1,b:1):1,(c:1,d:1):1,(e:1,f:1):1);", false);
+    PhyloTree t2("((a:1,c:1):1,(b:1,d:1):1,(e:1,f:1):1);", false);
+    PhyloTree t3("((a:1,d:1):1,(e:1,c:1):1,(b:1,f:1):1);", false);
+    GeodesicCostModel model(vector<PhyloTree>{t1, t2, t3});
+    REQUIRE(model.size() == 3);
+
+    // identical trees cost only the decomposition
+    CHECK(model.estimate(0, 0) == GeodesicCostModel::estimate(6, 0, 0));
+    CHECK(model.estimate(0, 1) == GeodesicCostModel::estimate(6, 2, 2));
+    CHECK(model.estimate(0, 1) == model.estimate(1, 0));
+    CHECK(model.estimate(0, 1) == GeodesicCostModel::estimate(t1, t2));
+    CHECK(model.estimate(0, 2) > model.estimate(0, 1));
+    CHECK(model.add(t3) == 3);
+    CHECK(model.estimate(2, 3) == model.estimate(0, 0));
+}
+
+TEST_CASE("MonotonicArena") {
+    MonotonicArena arena(64);
+    auto a = static_cast<double *>(arena.allocate(10 * sizeof(double), alignof(double)));
+    auto b = static_cast<char *>(arena.allocate(100, 1));
+    auto c = static_cast<double *>(arena.allocate(sizeof(double), alignof(double)));
+    CHECK((reinterpret_cast<uintptr_t>(c) % alignof(double)) == 0);
+    CHECK(arena.used() == 10 * sizeof(double) + 100 + sizeof(double));
+    CHECK(arena.numChunkAllocations() > 1);
+    a[9] = 1.5;
+    b[99] = 'x';
+    *c = 2.5;
+    CHECK(a[9] == 1.5);
+
+    // after a reset the same sequence of requests fits in the single coalesced chunk
+    arena.reset();
+    size_t chunks = arena.numChunkAllocations();
+    CHECK(arena.used() == 0);
+    arena.allocate(10 * sizeof(double), alignof(double));
+    arena.allocate(100, 1);
+    arena.allocate(sizeof(double), alignof(double));
+    CHECK(arena.numChunkAllocations() == chunks);
+
+    ArenaVector<int> v{ArenaAllocator<int>(&arena)};
+    v.reserve(16);
+    v.push_back(3);
+    CHECK(v.back() == 3);
+}
+
 TEST_CASE("Distance") {
     SECTION("Robinson-Foulds") {
         string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
@@ -550,6 +1181,230 @@ TEST_CASE("Distance") {
 
     }
 
+    SECTION("Robinson-Foulds from a cluster table") {
+        string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
+        string n2("((a:3,c:4):.5,(d:5,((b:6,e:7):.2,f:8):.3):.4);");
+        CHECK(abs(Distance::getClusterTableRobinsonFouldsDistance(n1, n2, false, true, true) - 8) < TOLERANCE);
+        CHECK(abs(Distance::getClusterTableRobinsonFouldsDistance(n1, n2, true, true, true) - 1) < TOLERANCE);
+        CHECK_THROWS(Distance::getClusterTableRobinsonFouldsDistance(n1, "((a:1,b:1):1,(c:1,g:1):1);", false, true, true));
+
+        // random multifurcating trees, with unary nodes and roots of degree two, in every rooting combination
+        std::mt19937 rng(16);
+        for (size_t n : {3, 5, 12, 40}) {
+            for (int trial = 0; trial < 20; ++trial) {
+                string s1 = randomNewick(rng, n, false, true), s2 = randomNewick(rng, n, false, true);
+                for (int rooting = 0; rooting < 4; ++rooting) {
+                    bool rooted1 = rooting & 1, rooted2 = rooting & 2;
+                    PhyloTree t1(s1, rooted1), t2(s2, rooted2);
+                    Topology a(s1, rooted1), b(s2, rooted2);
+                    CHECK(Distance::getRobinsonFouldsDistance(a, b, false) == Distance::getRobinsonFouldsDistance(t1, t2, false));
+                    CHECK(Distance::getRobinsonFouldsDistance(a, a, false) == 0);
+                    if (t1.numEdges() + t2.numEdges() > 0) {
+                        CHECK(abs(Distance::getRobinsonFouldsDistance(a, b, true) - Distance::getRobinsonFouldsDistance(t1, t2, true)) < TOLERANCE);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("Distance matrix") {
+        std::mt19937 rng(17);
+        vector<PhyloTree> trees;
+        vector<string> before;
+        for (size_t i = 0; i < 9; ++i) {
+            trees.push_back(randomTree(rng, 12));
+            before.push_back(trees.back().toString());
+        }
+        const size_t n = trees.size();
+        CHECK(Distance::condensedIndex(n, 0, 1) == 0);
+        CHECK(Distance::condensedIndex(n, 1, 2) == n - 1);
+        CHECK(Distance::condensedIndex(n, n - 2, n - 1) == n * (n - 1) / 2 - 1);
+
+        for (auto metric : {DistanceMetric::RobinsonFoulds, DistanceMetric::WeightedRobinsonFoulds,
+                            DistanceMetric::Euclidean, DistanceMetric::Geodesic}) {
+            for (bool normalise : {false, true}) {
+                auto serial = Distance::getDistanceMatrix(trees, metric, normalise, 1);
+                auto parallel = Distance::getDistanceMatrix(trees, metric, normalise, 4);
+                REQUIRE(serial.size() == n * (n - 1) / 2);
+                CHECK(parallel == serial);
+                GeodesicWorkspace workspace;
+                for (size_t i = 0; i < n; ++i) {
+                    for (size_t j = i + 1; j < n; ++j) {
+                        PhyloTree a(trees[i]), b(trees[j]);
+                        double expected = Distance::getDistance(a, b, metric, normalise, workspace);
+                        CHECK(abs(serial[Distance::condensedIndex(n, i, j)] - expected) < TOLERANCE);
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(trees[i].toString() == before[i]);
+        }
+
+        CHECK(Distance::getDistanceMatrix(vector<PhyloTree>(1, trees[0]), DistanceMetric::Geodesic, false).empty());
+        trees.push_back(PhyloTree("((a:1,b:1):1,c:1,d:1);", false));
+        CHECK_THROWS(Distance::getDistanceMatrix(trees, DistanceMetric::RobinsonFoulds, false, 3));
+    }
+
+    SECTION("Distances between two collections") {
+        std::mt19937 rng(37);
+        vector<PhyloTree> queries, references;
+        for (size_t i = 0; i < 5; ++i) {
+            queries.push_back(randomTree(rng, 14));
+        }
+        for (size_t i = 0; i < 19; ++i) {
+            references.push_back(randomTree(rng, 14));
+        }
+        const size_t numQueries = queries.size(), numReferences = references.size();
+
+        for (auto metric : {DistanceMetric::RobinsonFoulds, DistanceMetric::WeightedRobinsonFoulds,
+                            DistanceMetric::Euclidean, DistanceMetric::Geodesic}) {
+            for (bool normalise : {false, true}) {
+                // one more than needed, to see that nothing is written past the matrix
+                vector<double> serial(numQueries * numReferences + 1, -1), parallel(serial);
+                Distance::getDistanceMatrix(queries, references, metric, normalise, serial.data(), 1);
+                Distance::getDistanceMatrix(queries, references, metric, normalise, parallel.data(), 4);
+                CHECK(serial.back() == -1);
+                CHECK(parallel == serial);
+                GeodesicWorkspace workspace;
+                for (size_t q = 0; q < numQueries; ++q) {
+                    for (size_t r = 0; r < numReferences; ++r) {
+                        PhyloTree a(queries[q]), b(references[r]);
+                        double expected = Distance::getDistance(a, b, metric, normalise, workspace);
+                        if (metric == DistanceMetric::Geodesic) {
+                            CHECK(abs(serial[q * numReferences + r] - expected) < TOLERANCE);
+                        }
+                        else {
+                            CHECK(serial[q * numReferences + r] == expected);
+                        }
+                    }
+                }
+            }
+        }
+
+        double untouched = -1;
+        Distance::getDistanceMatrix({}, references, DistanceMetric::Geodesic, false, &untouched);
+        CHECK(untouched == -1);
+        references.push_back(PhyloTree("((a:1,b:1):1,c:1,d:1);", false));
+        vector<double> out(numQueries * references.size());
+        CHECK_THROWS(Distance::getDistanceMatrix(queries, references, DistanceMetric::Euclidean, false, out.data()));
+
+        PreparedTree rf(queries[0], DistanceMetric::RobinsonFoulds), geodesic(queries[1], DistanceMetric::Geodesic);
+        GeodesicWorkspace workspace;
+        SplitMatching matching;
+        CHECK_THROWS(Distance::getDistance(rf, geodesic, false, workspace, matching));
+    }
+
+    SECTION("Distances to a reference tree") {
+        std::mt19937 rng(53);
+        vector<string> newicks;
+        for (size_t i = 0; i < 24; ++i) {
+            newicks.push_back(randomNewick(rng, 13));
+        }
+        // the last tree is the reference itself, at distance 0
+        PhyloTree reference(newicks.back(), false);
+
+        for (auto metric : {DistanceMetric::RobinsonFoulds, DistanceMetric::WeightedRobinsonFoulds,
+                            DistanceMetric::Euclidean, DistanceMetric::Geodesic}) {
+            for (bool normalise : {false, true}) {
+                ReferenceDistances distances(reference, metric, normalise, 3);
+                vector<PhyloTree> trees;
+                vector<double> expected;
+                GeodesicWorkspace workspace;
+                for (auto &newick : newicks) {
+                    trees.emplace_back(newick, false);
+                    PhyloTree a(reference), b(trees.back());
+                    expected.push_back(Distance::getDistance(a, b, metric, normalise, workspace));
+                }
+                CHECK(expected.back() == 0);
+
+                vector<double> fromTrees(trees.size() + 1, -1);
+                distances.getDistances(trees, fromTrees.data());
+                CHECK(fromTrees.back() == -1);
+                fromTrees.pop_back();
+                vector<double> fromNewicks = distances.getDistances(newicks, false);
+                std::stringstream lines;
+                for (auto &newick : newicks) {
+                    lines << newick << "\n\n";
+                }
+                vector<double> fromLines = distances.getDistances(lines, false);
+                REQUIRE(fromNewicks.size() == expected.size());
+                REQUIRE(fromLines.size() == expected.size());
+                for (size_t k = 0; k < expected.size(); ++k) {
+                    if (metric == DistanceMetric::RobinsonFoulds || metric == DistanceMetric::Geodesic) {
+                        CHECK(fromTrees[k] == expected[k]);
+                    }
+                    else {
+                        CHECK(abs(fromTrees[k] - expected[k]) < TOLERANCE);
+                    }
+                    CHECK(fromNewicks[k] == fromTrees[k]);
+                    CHECK(fromLines[k] == fromTrees[k]);
+                    PhyloTree single(newicks[k], false);
+                    CHECK(distances.getDistance(single) == fromTrees[k]);
+                }
+            }
+        }
+
+        ReferenceDistances distances(reference, DistanceMetric::Geodesic, false, 2);
+        size_t next = 0;
+        vector<size_t> seen(newicks.size());
+        CHECK(distances.stream([&](string &newick) {
+            if (next == newicks.size()) return false;
+            newick = newicks[next++];
+            return true;
+        }, false, [&](size_t index, double) { ++seen[index]; }, 5) == newicks.size());
+        CHECK(std::all_of(seen.begin(), seen.end(), [](size_t times) { return times == 1; }));
+
+        // other leaves, or a label the reference does not have
+        PhyloTree other("((a:1,b:1):1,c:1,d:1);", false);
+        CHECK_THROWS(distances.getDistance(other));
+        vector<string> unknown = {newicks[0], "((t0:1,t1:1):1,t2:1,x:1);"};
+        CHECK_THROWS(distances.getDistances(unknown, false));
+    }
+
+    SECTION("Extending a distance matrix") {
+        std::mt19937 rng(29);
+        vector<PhyloTree> trees, newTrees;
+        for (size_t i = 0; i < 7; ++i) {
+            trees.push_back(randomTree(rng, 12));
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            newTrees.push_back(randomTree(rng, 12));
+        }
+        vector<PhyloTree> all(trees);
+        all.insert(all.end(), newTrees.begin(), newTrees.end());
+
+        for (auto metric : {DistanceMetric::RobinsonFoulds, DistanceMetric::Geodesic}) {
+            auto expected = Distance::getDistanceMatrix(all, metric, true, 1);
+            // marked old entries show that they are carried over rather than computed again
+            auto old = Distance::getDistanceMatrix(trees, metric, true, 1);
+            for (auto &entry : old) {
+                entry += 1000;
+            }
+            auto extended = Distance::extendDistanceMatrix(old, trees, newTrees, metric, true, 3);
+            REQUIRE(extended.size() == expected.size());
+            const size_t n = trees.size(), total = all.size();
+            for (size_t i = 0; i < total; ++i) {
+                for (size_t j = i + 1; j < total; ++j) {
+                    double entry = extended[Distance::condensedIndex(total, i, j)];
+                    if (j < n) entry -= 1000;
+                    CHECK(abs(entry - expected[Distance::condensedIndex(total, i, j)]) < TOLERANCE);
+                }
+            }
+        }
+
+        // from nothing, and by nothing
+        CHECK(Distance::extendDistanceMatrix({}, {}, all, DistanceMetric::Euclidean, false, 2) ==
+              Distance::getDistanceMatrix(all, DistanceMetric::Euclidean, false, 1));
+        auto matrix = Distance::getDistanceMatrix(all, DistanceMetric::Euclidean, false, 1);
+        CHECK(Distance::extendDistanceMatrix(matrix, all, {}, DistanceMetric::Euclidean, false, 2) == matrix);
+
+        CHECK_THROWS(Distance::extendDistanceMatrix(matrix, trees, newTrees, DistanceMetric::Euclidean, false));
+        newTrees.push_back(PhyloTree("((a:1,b:1):1,c:1,d:1);", false));
+        CHECK_THROWS(Distance::extendDistanceMatrix(Distance::getDistanceMatrix(trees, DistanceMetric::Euclidean, false),
+                                                    trees, newTrees, DistanceMetric::Euclidean, false));
+    }
+
     SECTION("Weighted Robinson-Foulds") {
         string n1("((a:3,b:4):.1,(c:5,((d:6,e:7):.2,f:8):.3):.4);");
         string n2("((a:3,c:4):.5,(d:5,((b:6,e:7):.2,f:8):.3):.4);");
@@ -626,6 +1481,31 @@ TEST_CASE("Distance") {
         CHECK(abs(Distance::getGeodesicDistance(t3, t4, true) - Distance::getGeodesicDistance(s3, s4, true, false, false)) < TOLERANCE);
         CHECK(abs(Distance::getGeodesicDistance(t5, t6, false) - Distance::getGeodesicDistance(s5, s6, false, true, true)) < TOLERANCE);
         CHECK(abs(Distance::getGeodesicDistance(t5, t6, true) - Distance::getGeodesicDistance(s5, s6, true, true, true)) < TOLERANCE);
+
+        GeodesicWorkspace workspace;
+        CHECK(abs(Distance::getGeodesicDistance(t9, t10, false, workspace) - 19.904540675743142) < TOLERANCE);
+        CHECK(abs(Distance::getGeodesicDistance(t7, t8, true, workspace) - 0.1522374775995074) < TOLERANCE);
+        CHECK(abs(Distance::getGeodesicDistance(t1, t2, false, workspace) - 2.76188615828) < TOLERANCE);
+        size_t chunks = workspace.getArena().numChunkAllocations();
+
+        // the k-way merge of the subproblems gives the same sequence as interleaving them one at a time
+        auto &geodesic = Geodesic::getGeodesic(t9, t10, workspace);
+        REQUIRE(workspace.numSubproblems() > 2);
+        RatioSequence folded;
+        for (size_t i = 0; i < workspace.numSubproblems(); ++i) {
+            folded = RatioSequence::interleave(folded, workspace.getSubproblem(i).rs);
+        }
+        CHECK(geodesic.getRS().toString() == folded.toString());
+        CHECK(abs(Distance::getGeodesicDistance(t9, t10, false, workspace) - 19.904540675743142) < TOLERANCE);
+        CHECK(workspace.getArena().numChunkAllocations() == chunks);
+        for (bool warmStart : {false, true}) {
+            workspace.setWarmStart(warmStart);
+            for (auto algorithm : {MaxFlowAlgorithm::LabelScan, MaxFlowAlgorithm::Dinic, MaxFlowAlgorithm::PushRelabel}) {
+                workspace.setMaxFlowAlgorithm(algorithm);
+                CHECK(abs(Distance::getGeodesicDistance(t9, t10, false, workspace) - Distance::getGeodesicDistance(t9, t10, false)) < TOLERANCE);
+                CHECK(abs(Distance::getGeodesicDistance(t5, t6, true, workspace) - Distance::getGeodesicDistance(t5, t6, true)) < TOLERANCE);
+            }
+        }
         clock_t start = clock();
         for (size_t i = 0; i < 100; ++i) {
             Distance::getGeodesicDistance(t9, t10, false);
@@ -639,3 +1519,252 @@ TEST_CASE("Distance") {
 
     }
 }
+
+/* A directory under /tmp for the tests that write files, removed with everything in it even when a REQUIRE fails */
+struct ScratchDirectory {
+    string path;
+
+    ScratchDirectory() {
+        char pattern[] = "/tmp/cgtp_test_XXXXXX";
+        REQUIRE(mkdtemp(pattern) != nullptr);
+        path = pattern;
+    }
+
+    ~ScratchDirectory() {
+        remove(path);
+    }
+
+    static void remove(const string &dir) {
+        if (DIR *d = opendir(dir.c_str())) {
+            while (dirent *entry = readdir(d)) {
+                string name = entry->d_name;
+                if (name == "." || name == "..") continue;
+                if (unlink((dir + "/" + name).c_str()) != 0) remove(dir + "/" + name);
+            }
+            closedir(d);
+        }
+        rmdir(dir.c_str());
+    }
+};
+
+TEST_CASE("CondensedMatrixFile") {
+    ScratchDirectory scratch;
+    const string path = scratch.path + "/matrix";
+    const size_t n = 7;
+    auto value = [](size_t i, size_t j) { return 1.0 / (1 + i) + j * 0.125; };
+
+    for (auto dtype : {MatrixDtype::Float64, MatrixDtype::Float32}) {
+        const uint64_t taxa = TaxonNamespace::hash({"a", "b", "c"});
+        {
+            CondensedMatrixFile matrix(path, n, DistanceMetric::WeightedRobinsonFoulds, true, dtype, taxa);
+            REQUIRE(matrix.numEntries() == n * (n - 1) / 2);
+            CHECK(matrix.get(2, 5) == 0);
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = i + 1; j < n; ++j) {
+                    if ((i + j) % 2) matrix.set(i, j, value(i, j));
+                    else matrix.set(j, i, value(i, j));
+                }
+            }
+            // the diagonal is not stored, and nothing past the matrix is reachable; none of these writes lands
+            CHECK_THROWS_AS(matrix.set(1, 1, 99), const std::invalid_argument &);
+            CHECK_THROWS_AS(matrix.set(0, 0, 99), const std::invalid_argument &);
+            CHECK_THROWS_AS(matrix.set(0, n, 99), const std::out_of_range &);
+            CHECK_THROWS_AS(matrix.set(n, n, 99), const std::out_of_range &);
+            CHECK_THROWS_AS(matrix.set(matrix.numEntries(), 99), const std::out_of_range &);
+            CHECK_THROWS_AS(matrix.get(n, 0), const std::out_of_range &);
+            CHECK_THROWS_AS(matrix.get(matrix.numEntries()), const std::out_of_range &);
+            matrix.release(0, matrix.numEntries());
+            // released entries are still there
+            CHECK(matrix.get(0, 1) == (dtype == MatrixDtype::Float32 ? (float) value(0, 1) : value(0, 1)));
+        }
+
+        const CondensedMatrixFile matrix(path);
+        CHECK(matrix.size() == n);
+        CHECK(matrix.getMetric() == DistanceMetric::WeightedRobinsonFoulds);
+        CHECK(matrix.isNormalised());
+        CHECK(matrix.getDtype() == dtype);
+        CHECK(matrix.getTaxonHash() == taxa);
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(matrix.get(i, i) == 0);
+            for (size_t j = i + 1; j < n; ++j) {
+                double expected = dtype == MatrixDtype::Float32 ? (float) value(i, j) : value(i, j);
+                CHECK(matrix.get(i, j) == expected);
+                CHECK(matrix.get(j, i) == expected);
+                CHECK(matrix.get(Distance::condensedIndex(n, i, j)) == expected);
+            }
+        }
+
+        // the layout numpy.memmap reads: the entries right after the header, in condensed order
+        std::ifstream raw(path, std::ios::binary);
+        raw.seekg(CondensedMatrixFile::HEADER_SIZE + Distance::condensedIndex(n, 3, 4) *
+                  (dtype == MatrixDtype::Float32 ? 4 : 8));
+        double stored;
+        if (dtype == MatrixDtype::Float32) {
+            float single;
+            raw.read(reinterpret_cast<char *>(&single), sizeof(single));
+            stored = single;
+        }
+        else {
+            raw.read(reinterpret_cast<char *>(&stored), sizeof(stored));
+        }
+        CHECK(stored == matrix.get(3, 4));
+    }
+
+    CHECK(TaxonNamespace::hash({"a", "b"}) != TaxonNamespace::hash({"ab"}));
+    CHECK(TaxonNamespace({"b", "a"}).hash() == TaxonNamespace::hash({"a", "b"}));
+    std::ofstream(scratch.path + "/other") << "not a matrix";
+    CHECK_THROWS(CondensedMatrixFile(scratch.path + "/other"));
+    CHECK_THROWS(CondensedMatrixFile(scratch.path + "/missing"));
+
+    // extending a matrix on disk into a new file
+    std::mt19937 rng(31);
+    vector<PhyloTree> trees, newTrees;
+    for (size_t i = 0; i < 9; ++i) {
+        (i < 6 ? trees : newTrees).push_back(randomTree(rng, 10));
+    }
+    vector<PhyloTree> all(trees);
+    all.insert(all.end(), newTrees.begin(), newTrees.end());
+    const uint64_t taxa = TaxonNamespace::hash(trees[0].getLeaf2NumMap());
+    {
+        CondensedMatrixFile old(path, trees.size(), DistanceMetric::Geodesic, false, MatrixDtype::Float64, taxa);
+        auto entries = Distance::getDistanceMatrix(trees, DistanceMetric::Geodesic, false, 1);
+        for (size_t k = 0; k < entries.size(); ++k) {
+            old.set(k, entries[k]);
+        }
+    }
+    const CondensedMatrixFile old(path);
+    Distance::extendDistanceMatrix(old, trees, newTrees, scratch.path + "/extended", 2);
+    const CondensedMatrixFile extended(scratch.path + "/extended");
+    CHECK(extended.size() == all.size());
+    CHECK(extended.getMetric() == DistanceMetric::Geodesic);
+    CHECK(extended.getTaxonHash() == taxa);
+    auto expected = Distance::getDistanceMatrix(all, DistanceMetric::Geodesic, false, 1);
+    for (size_t k = 0; k < expected.size(); ++k) {
+        CHECK(abs(extended.get(k) - expected[k]) < TOLERANCE);
+    }
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, trees, newTrees, path));
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, newTrees, trees, scratch.path + "/wrong"));
+
+    // the matrix's own file under another name, or as the temporary file, is refused and left untouched
+    const string name = path.substr(path.rfind('/') + 1);
+    REQUIRE(link(path.c_str(), (scratch.path + "/linked").c_str()) == 0);
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, trees, newTrees, scratch.path + "/./" + name));
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, trees, newTrees, scratch.path + "/linked"));
+    REQUIRE(link(path.c_str(), (scratch.path + "/aliased.tmp").c_str()) == 0);
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, trees, newTrees, scratch.path + "/aliased"));
+    auto entries = Distance::getDistanceMatrix(trees, DistanceMetric::Geodesic, false, 1);
+    REQUIRE(old.numEntries() == entries.size());
+    for (size_t k = 0; k < entries.size(); ++k) {
+        CHECK(old.get(k) == entries[k]);
+    }
+    CHECK(access((scratch.path + "/extended.tmp").c_str(), F_OK) != 0);
+
+    // extending over an existing file replaces it only once the extended matrix is complete
+    Distance::extendDistanceMatrix(old, trees, newTrees, scratch.path + "/wrong", 2);
+    CHECK(CondensedMatrixFile(scratch.path + "/wrong").size() == all.size());
+    vector<PhyloTree> otherLeaves = {PhyloTree("((a:1,b:1):1,c:1,d:1);", false)};
+    CHECK_THROWS(Distance::extendDistanceMatrix(old, trees, otherLeaves, scratch.path + "/wrong"));
+    CHECK(CondensedMatrixFile(scratch.path + "/wrong").size() == all.size());
+    CHECK(access((scratch.path + "/wrong.tmp").c_str(), F_OK) != 0);
+}
+
+TEST_CASE("TiledDistanceMatrix") {
+    std::mt19937 rng(23);
+    vector<PhyloTree> trees;
+    for (size_t i = 0; i < 11; ++i) {
+        trees.push_back(randomTree(rng, 10));
+    }
+    const size_t n = trees.size();
+
+    ScratchDirectory scratch;
+    const string directory = scratch.path + "/run";
+
+    SECTION("Block size from the memory budget") {
+        CHECK(TiledDistanceMatrix::blockSizeFor(trees, 1) == 1);
+        CHECK(TiledDistanceMatrix::blockSizeFor(trees, 1 << 30) == n);
+        size_t small = TiledDistanceMatrix::blockSizeFor(trees, 64 * 1024);
+        size_t large = TiledDistanceMatrix::blockSizeFor(trees, 256 * 1024);
+        CHECK(small <= large);
+
+        vector<PhyloTree> sorted(trees);
+        for (auto &tree : sorted) {
+            tree.sortEdges();
+        }
+        CHECK(TiledDistanceMatrix::fingerprint(sorted) == TiledDistanceMatrix::fingerprint(trees));
+        sorted.pop_back();
+        CHECK(TiledDistanceMatrix::fingerprint(sorted) != TiledDistanceMatrix::fingerprint(trees));
+    }
+
+    SECTION("Resuming and sharing a run") {
+        // the smallest budget for blocks of three trees
+        size_t budget = 1024;
+        while (TiledDistanceMatrix::blockSizeFor(trees, budget) < 3) budget += 1024;
+        auto expected = Distance::getDistanceMatrix(trees, DistanceMetric::Geodesic, false, 1);
+        {
+            TiledDistanceMatrix first(directory, trees, DistanceMetric::Geodesic, false, budget);
+            REQUIRE(first.blockSize() == 3);
+            REQUIRE(first.numTiles() == 10);
+            CHECK(first.numFinishedTiles() == 0);
+            CHECK(first.run(2, 3) == 3);
+            CHECK(first.numFinishedTiles() == 3);
+            CHECK_FALSE(first.isComplete());
+            CHECK_THROWS(first.assemble());
+        }
+        // a second worker on the same run, with a budget that would give another block size
+        TiledDistanceMatrix second(directory, trees, DistanceMetric::Geodesic, false, 1 << 30);
+        TiledDistanceMatrix third(directory, trees, DistanceMetric::Geodesic, false, budget);
+        REQUIRE(second.blockSize() == third.blockSize());
+        CHECK(second.run(1, 2) == 2);
+        size_t rest = second.numTiles() - 5;
+        CHECK((third.run(3) + second.run(1)) == rest);
+        CHECK(second.isComplete());
+        CHECK(third.run() == 0);
+
+        auto tiled = second.assemble();
+        REQUIRE(tiled.size() == expected.size());
+        for (size_t k = 0; k < tiled.size(); ++k) {
+            CHECK(abs(tiled[k] - expected[k]) < TOLERANCE);
+        }
+        const CondensedMatrixFile matrix(directory + "/matrix");
+        CHECK(matrix.size() == n);
+        CHECK(matrix.getTaxonHash() == TaxonNamespace::hash(trees[0].getLeaf2NumMap()));
+        CHECK(matrix.get(7, 2) == tiled[Distance::condensedIndex(n, 2, 7)]);
+
+        // other trees or settings cannot join the run
+        CHECK_THROWS(TiledDistanceMatrix(directory, trees, DistanceMetric::RobinsonFoulds, false, budget));
+        CHECK_THROWS(TiledDistanceMatrix(directory, trees, DistanceMetric::Geodesic, true, budget));
+        vector<PhyloTree> fewer(trees.begin(), trees.end() - 1);
+        CHECK_THROWS(TiledDistanceMatrix(directory, fewer, DistanceMetric::Geodesic, false, budget));
+    }
+
+    SECTION("Single precision") {
+        TiledDistanceMatrix matrix(directory, trees, DistanceMetric::Euclidean, true, 16 * 1024, MatrixDtype::Float32);
+        CHECK(matrix.run(2) == matrix.numTiles());
+        CHECK(matrix.getMatrix().getDtype() == MatrixDtype::Float32);
+        auto expected = Distance::getDistanceMatrix(trees, DistanceMetric::Euclidean, true, 1);
+        auto tiled = matrix.assemble();
+        for (size_t k = 0; k < tiled.size(); ++k) {
+            CHECK(tiled[k] == (float) expected[k]);
+        }
+        // a second worker takes the dtype the run was started with
+        TiledDistanceMatrix other(directory, trees, DistanceMetric::Euclidean, true, 16 * 1024);
+        CHECK(other.getMatrix().getDtype() == MatrixDtype::Float32);
+    }
+
+    SECTION("Tiles locked by a live worker are left to it") {
+        TiledDistanceMatrix matrix(directory, trees, DistanceMetric::RobinsonFoulds, false, 16 * 1024);
+        REQUIRE(matrix.numTiles() > 1);
+        string lockPath = directory + "/tile_0_0.lock";
+        int held = open(lockPath.c_str(), O_CREAT | O_RDWR, 0666);
+        REQUIRE(held >= 0);
+        REQUIRE(flock(held, LOCK_EX | LOCK_NB) == 0);
+        CHECK(matrix.run(1) == matrix.numTiles() - 1);
+        CHECK_FALSE(matrix.isComplete());
+        // the holder dies without cleaning up: its lock file stays, but the lock is gone
+        close(held);
+        CHECK(matrix.run(1) == 1);
+        CHECK(matrix.isComplete());
+        CHECK(matrix.assemble() == Distance::getDistanceMatrix(trees, DistanceMetric::RobinsonFoulds, false, 1));
+    }
+
+}